@@ -0,0 +1,91 @@
+///
+/// Cost of the checked build policy on Stack hot paths. Build the same file twice, together with the
+/// wrapper sources, and compare the output:
+///     g++ -O2 -std=c++20 -I.. -DLUA_WRAPPER_CHECKED=1 stack_checks.cpp ../lua_*.cpp -llua5.1 -o checked
+///     g++ -O2 -std=c++20 -I.. -DLUA_WRAPPER_CHECKED=0 stack_checks.cpp ../lua_*.cpp -llua5.1 -o unchecked
+/// Every case prints nanoseconds per operation.
+///
+#include "lua_wrapper.h"
+
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+const int kIterations = 1000000;
+
+template <typename Body>
+void measure(const char * name, Body body)
+{
+    typedef std::chrono::steady_clock Clock;
+    // warm up caches and the lua string table
+    for (int i = 0; i < kIterations / 10; ++i)
+    {
+        body(i);
+    }
+
+    const Clock::time_point start = Clock::now();
+    for (int i = 0; i < kIterations; ++i)
+    {
+        body(i);
+    }
+    const double elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    printf("%-24s %8.2f ns/op\n", name, elapsed / kIterations);
+}
+} // anonymous
+
+int main()
+{
+    printf("LUA_WRAPPER_CHECKED=%d\n", LUA_WRAPPER_CHECKED);
+
+    lua::Stack stack;
+    const char * script = "function add(a, b) return a + b end";
+    stack.loadBuffer(script, strlen(script), "=bench");
+
+    lua::Table table;
+    table.create();
+    const lua::Value key("value");
+    table.set(key, lua::Value(1));
+
+    measure("push and get number", [&stack](const int i)
+    {
+        stack.push(i);
+        const lua::Value value = stack.get(-1);
+        stack.pop(1);
+        (void)value;
+    });
+    measure("read int", [&stack](const int i)
+    {
+        stack.push(i);
+        int value = 0;
+        stack.read(-1, value);
+        stack.pop(1);
+    });
+    measure("table set", [&table, &key](const int i)
+    {
+        table.set(key, lua::Value(i));
+    });
+    measure("table get", [&table, &key](const int)
+    {
+        const lua::Value value = table.get(key);
+        (void)value;
+    });
+    measure("table copy reference", [&table](const int)
+    {
+        const lua::Table copy(table);
+        (void)copy;
+    });
+
+    lua::Function add("add");
+    std::vector<lua::Value> params = { lua::Value(1), lua::Value(2) };
+    std::vector<lua::Value> results(1);
+    measure("function call", [&add, &params, &results](const int)
+    {
+        add.call(params, results);
+    });
+
+    stack.destroy();
+    return 0;
+}
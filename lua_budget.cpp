@@ -0,0 +1,198 @@
+#include "lua_budget.h"
+
+#include <unordered_map>
+
+namespace lua
+{
+namespace
+{
+const size_t kMaxUsageEntries = 4096;  ///< functions reported separately, the rest share one entry
+Budget g_defaultBudget;
+Budget::Scope * g_current = nullptr;
+std::unordered_map<lua_State *, Budget::Scope *> g_scopes;
+std::unordered_map<std::string, Budget::Usage> g_usage;
+
+bool isMainThread(lua_State * state)
+{
+    const bool isMain = 1 == lua_pushthread(state);
+    lua_pop(state, 1);
+    return isMain;
+}
+
+int getEventMask(const int event)
+{
+    return LUA_HOOKTAILRET == event ? LUA_MASKRET : 1 << event;
+}
+} // namespace
+
+// class Budget::Scope
+Budget::Scope::Scope(lua_State * state, const Budget & budget, const void * function)
+    : m_state(nullptr)
+    , m_budget(budget)
+    , m_function(function)
+    , m_instructions(0)
+    , m_isAborted(false)
+    , m_isYielded(false)
+    , m_previous(nullptr)
+    , m_outer(nullptr)
+    , m_previousHook(nullptr)
+    , m_previousMask(0)
+    , m_previousCount(0)
+{
+    if (!state || !budget.isLimited()) return;
+
+    m_state = state;
+    m_start = Clock::now();
+    m_deadline = m_start + std::chrono::microseconds(budget.time);
+
+    m_previousHook = lua_gethook(state);
+    m_previousMask = lua_gethookmask(state);
+    m_previousCount = lua_gethookcount(state);
+
+    Scope *& active = g_scopes[state];
+    m_previous = active;
+    active = this;
+    m_outer = g_current;
+    g_current = this;
+
+    // other events are forwarded to the previous hook
+    const int mask = (m_previousHook ? m_previousMask & ~LUA_MASKCOUNT : 0) | LUA_MASKCOUNT;
+    lua_sethook(state, hook, mask, budget.granularity > 0 ? budget.granularity : 1);
+}
+
+Budget::Scope::~Scope()
+{
+    if (!m_state) return;
+
+    lua_sethook(m_state, m_previousHook, m_previousMask, m_previousCount);
+    if (m_previous)
+    {
+        g_scopes[m_state] = m_previous;
+    }
+    else
+    {
+        g_scopes.erase(m_state);
+    }
+    g_current = m_outer;
+
+    if (!m_function) return;
+
+    Usage & usage = *static_cast<Usage *>(const_cast<void *>(m_function));
+    ++usage.calls;
+    usage.instructions += m_instructions;
+    usage.time += std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_start).count();
+    usage.aborts += m_isAborted ? 1 : 0;
+    usage.yields += m_isYielded ? 1 : 0;
+}
+
+void Budget::Scope::hook(lua_State * state, lua_Debug * ar)
+{
+    auto it = g_scopes.find(state);
+    Scope * scope = it != g_scopes.end() ? it->second : nullptr;
+    const bool isOwnState = nullptr != scope;
+    if (!scope)
+    {
+        // coroutines created inside a budgeted call inherit the hook and are charged to the innermost scope
+        if (LUA_HOOKCOUNT != ar->event || !g_current) return;
+        scope = g_current;
+    }
+    else if (LUA_HOOKCOUNT != ar->event)
+    {
+        // nested scopes forward to the hook which was installed before the outermost one
+        const Scope * forward = scope;
+        while (forward && hook == forward->m_previousHook)
+        {
+            forward = forward->m_previous;
+        }
+        if (forward && forward->m_previousHook && 0 != (forward->m_previousMask & getEventMask(ar->event)))
+        {
+            forward->m_previousHook(state, ar);
+        }
+        return;
+    }
+
+    const Budget & budget = scope->m_budget;
+    scope->m_instructions += budget.granularity;
+
+    const bool isOutOfInstructions = budget.instructions > 0 && scope->m_instructions >= budget.instructions;
+    const bool isOutOfTime = budget.time > 0 && Clock::now() >= scope->m_deadline;
+    if (!isOutOfInstructions && !isOutOfTime) return;
+
+    // a borrowed scope can't yield a coroutine it does not resume, so it is aborted
+    if (Action::Yield == budget.action && isOwnState && !isMainThread(state))
+    {
+        scope->m_isYielded = true;
+        lua_yield(state, 0);
+        return;
+    }
+
+    scope->m_isAborted = true;
+    luaL_error(state, "budget exceeded");
+}
+
+// class Budget
+Budget::Budget(const size_t instructions, const int64_t time, const Action action, const int granularity)
+    : instructions(instructions)
+    , time(time)
+    , action(action)
+    , granularity(granularity)
+{
+}
+
+void Budget::setDefault(const Budget & budget)
+{
+    g_defaultBudget = budget;
+}
+
+const Budget & Budget::getDefault()
+{
+    return g_defaultBudget;
+}
+
+const void * Budget::identify(lua_State * state, const int index)
+{
+    // closures of the same prototype share usage, addresses of collected closures are reused
+    std::string name;
+    std::string key;
+    lua_Debug ar;
+    lua_pushvalue(state, index);
+    if (0 != lua_getinfo(state, ">S", &ar))
+    {
+        name = std::string(ar.short_src) + ":" + std::to_string(ar.linedefined);
+        key = name + "-" + std::to_string(ar.lastlinedefined);
+    }
+    if (g_usage.size() >= kMaxUsageEntries && g_usage.find(key) == g_usage.end())
+    {
+        name = key = "[other]";
+    }
+
+    auto it = g_usage.find(key);
+    if (it == g_usage.end())
+    {
+        Usage usage = {};
+        usage.name = name;
+        it = g_usage.emplace(key, usage).first;
+    }
+    return &it->second;
+}
+
+void Budget::getUsage(std::vector<Usage> & usage)
+{
+    usage.clear();
+    usage.reserve(g_usage.size());
+    for (const auto & it : g_usage)
+    {
+        usage.push_back(it.second);
+    }
+}
+
+void Budget::resetUsage()
+{
+    for (auto & it : g_usage)
+    {
+        const std::string name = it.second.name;
+        it.second = Usage();
+        it.second.name = name;
+    }
+}
+} // lua
@@ -0,0 +1,134 @@
+#ifndef STREN_LUA_BUDGET_H
+#define STREN_LUA_BUDGET_H
+
+#include "lua_ext.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+///
+/// class Budget
+///
+/// Limits execution of a lua call by instructions and wall clock time. Limits are checked by a count hook
+/// every "granularity" instructions, so a budget can be overrun by at most that many instructions.
+/// Coroutines created inside a budgeted call inherit the hook and are charged to the innermost scope, they
+/// are aborted instead of yielded; coroutines created before the call run unmetered when resumed inside it.
+/// Usage is collected per function prototype, at most for 4096 prototypes, the rest are reported as "[other]".
+///
+class Budget
+{
+public:
+    ///
+    /// what to do when budget is exceeded
+    ///
+    enum class Action
+    {
+        Abort,          ///< raise lua error "budget exceeded"
+        Yield           ///< yield the coroutine, aborts if the code does not run in a coroutine
+    };
+    ///
+    /// struct Usage
+    ///
+    struct Usage
+    {
+        std::string name;               ///< source:line of the function definition
+        size_t      calls;              ///< amount of budgeted calls or resumes
+        size_t      instructions;       ///< executed instructions, rounded up to the budget granularity
+        int64_t     time;               ///< wall clock time in microseconds
+        size_t      aborts;             ///< amount of calls aborted by budget
+        size_t      yields;             ///< amount of calls preempted by budget
+    };
+    class Scope;
+public:
+    size_t  instructions;   ///< instructions limit, 0 - unlimited
+    int64_t time;           ///< wall clock limit in microseconds, 0 - unlimited
+    Action  action;         ///< action on exceeded budget
+    int     granularity;    ///< instructions between checks
+public:
+    ///
+    /// Constructor
+    ///
+    Budget(const size_t instructions = 0, const int64_t time = 0, const Action action = Action::Abort, const int granularity = 1000);
+    ///
+    /// check if budget has any limit
+    ///
+    inline bool isLimited() const { return instructions > 0 || time > 0; }
+    ///
+    /// set budget applied to every call without explicit budget
+    ///
+    static void setDefault(const Budget & budget);
+    ///
+    /// get budget applied to every call without explicit budget
+    ///
+    static const Budget & getDefault();
+    ///
+    /// get key of the function at the stack index to report usage for, closures of one prototype share it
+    ///
+    static const void * identify(lua_State * state, const int index);
+    ///
+    /// get usage of all budgeted functions
+    ///
+    static void getUsage(std::vector<Usage> & usage);
+    ///
+    /// drop collected usage
+    ///
+    static void resetUsage();
+};
+///
+/// class Budget::Scope
+///
+/// Enforces budget on the lua state while the scope is alive.
+///
+class Budget::Scope
+{
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    lua_State *       m_state;          ///< budgeted lua state
+    Budget            m_budget;         ///< enforced limits
+    const void *      m_function;       ///< function the usage is reported for
+    Clock::time_point m_start;          ///< scope start time
+    Clock::time_point m_deadline;       ///< wall clock deadline
+    size_t            m_instructions;   ///< instructions executed in the scope
+    bool              m_isAborted;      ///< true if budget aborted the call
+    bool              m_isYielded;      ///< true if budget yielded the coroutine
+    Scope *           m_previous;       ///< outer scope of the same lua state
+    Scope *           m_outer;          ///< scope which was innermost before this one, any lua state
+    lua_Hook          m_previousHook;   ///< hook installed before the scope
+    int               m_previousMask;   ///< mask of the previous hook
+    int               m_previousCount;  ///< count of the previous hook
+public:
+    ///
+    /// Constructor, function is a key returned by Budget::identify
+    ///
+    Scope(lua_State * state, const Budget & budget, const void * function);
+    ///
+    /// Destructor, reports usage and restores the previous hook
+    ///
+    ~Scope();
+    ///
+    /// check if budget aborted the call
+    ///
+    inline bool isAborted() const { return m_isAborted; }
+    ///
+    /// check if budget yielded the coroutine
+    ///
+    inline bool isYielded() const { return m_isYielded; }
+    ///
+    /// get executed instructions
+    ///
+    inline size_t getInstructions() const { return m_instructions; }
+private:
+    ///
+    /// count hook
+    ///
+    static void hook(lua_State * state, lua_Debug * ar);
+};
+} // lua
+
+#endif // STREN_LUA_BUDGET_H
@@ -0,0 +1,573 @@
+#include "lua_channel.h"
+#include "lua_frozen_table.h"
+
+#include <cmath>
+#include <cstring>
+#include <new>
+
+namespace lua
+{
+namespace
+{
+const char * kMetatableName = "lua.Channel";
+
+// value tags of encoded messages
+enum Tag : uint8_t
+{
+    TagNil,
+    TagFalse,
+    TagTrue,
+    TagInteger,     ///< int32
+    TagNumber,      ///< double
+    TagString,      ///< uint32 length and bytes
+    TagArray,       ///< uint32 count and values of keys 1..count
+    TagMap,         ///< uint32 count and key value pairs
+    TagFrozen       ///< uint32 index in Message::frozen
+};
+
+// blocking calls have to yield from lua code, lua 5.1 can't continue a C function after yield
+const char * kBlockingCalls =
+    "local trysend, tryreceive, isclosed, yield = ...\n"
+    "local function send(self, value)\n"
+    "    while not trysend(self, value) do\n"
+    "        if isclosed(self) then return false end\n"
+    "        yield()\n"
+    "    end\n"
+    "    return true\n"
+    "end\n"
+    "local function receive(self)\n"
+    "    while true do\n"
+    "        local ok, value = tryreceive(self)\n"
+    "        if ok then return value end\n"
+    "        if isclosed(self) then return nil end\n"
+    "        yield()\n"
+    "    end\n"
+    "end\n"
+    "return send, receive\n";
+
+// messages never leave the process, so numbers are stored in native byte order
+template <typename T>
+inline void write(std::string & out, const T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+///
+/// class Encoder
+///
+class Encoder
+{
+private:
+    lua_State *          m_state;       ///< source state
+    Channel::Message &   m_message;     ///< output
+    const char *         m_error;       ///< first error
+public:
+    Encoder(lua_State * state, Channel::Message & message)
+        : m_state(state)
+        , m_message(message)
+        , m_error(nullptr)
+    {
+    }
+
+    inline const char * getError() const { return m_error; }
+
+    bool write(const int index, const int depth, const int maxDepth)
+    {
+        std::string & out = m_message.data;
+        switch (lua_type(m_state, index))
+        {
+        case LUA_TNIL:
+            out.push_back((char)TagNil);
+            return true;
+        case LUA_TBOOLEAN:
+            out.push_back((char)(lua_toboolean(m_state, index) ? TagTrue : TagFalse));
+            return true;
+        case LUA_TNUMBER:
+        {
+            const lua_Number number = lua_tonumber(m_state, index);
+            // -0 and fractions keep the double form
+            if (number >= -2147483648.0 && number <= 2147483647.0 && (lua_Number)(int32_t)number == number && !(0 == number && std::signbit(number)))
+            {
+                out.push_back((char)TagInteger);
+                lua::write(out, (int32_t)number);
+            }
+            else
+            {
+                out.push_back((char)TagNumber);
+                lua::write(out, (double)number);
+            }
+            return true;
+        }
+        case LUA_TSTRING:
+        {
+            size_t length = 0;
+            const char * str = lua_tolstring(m_state, index, &length);
+            out.push_back((char)TagString);
+            lua::write(out, (uint32_t)length);
+            out.append(str, length);
+            return true;
+        }
+        case LUA_TTABLE:
+            return writeTable(index, depth, maxDepth);
+        case LUA_TUSERDATA:
+        {
+            Channel::Message::Frozen frozen;
+            if (FrozenTable::toFrozen(m_state, index, frozen.data, frozen.node))
+            {
+                out.push_back((char)TagFrozen);
+                lua::write(out, (uint32_t)m_message.frozen.size());
+                m_message.frozen.push_back(std::move(frozen));
+                return true;
+            }
+            return fail("userdata can't be sent");
+        }
+        case LUA_TLIGHTUSERDATA:
+            return fail("userdata can't be sent");
+        default:
+            return fail("functions and threads can't be sent");
+        }
+    }
+private:
+    bool fail(const char * error)
+    {
+        if (!m_error)
+        {
+            m_error = error;
+        }
+        return false;
+    }
+
+    bool writeTable(const int index, const int depth, const int maxDepth)
+    {
+        if (depth >= maxDepth) return fail("table is too deep or cyclic");
+        if (!lua_checkstack(m_state, 3)) return fail("lua stack overflow");
+
+        std::string & out = m_message.data;
+        const size_t length = lua_objlen(m_state, index);
+        size_t count = 0;
+        bool isArray = true;
+        lua_pushnil(m_state);
+        while (lua_next(m_state, index))
+        {
+            ++count;
+            if (isArray)
+            {
+                // border of a table with holes is any border, so every key has to be checked
+                const lua_Number key = LUA_TNUMBER == lua_type(m_state, -2) ? lua_tonumber(m_state, -2) : 0;
+                isArray = key >= 1 && key <= (lua_Number)length && (lua_Number)(size_t)key == key;
+            }
+            lua_pop(m_state, 1);
+        }
+
+        // keys 1..length and nothing else
+        if (isArray && count == length)
+        {
+            out.push_back((char)TagArray);
+            lua::write(out, (uint32_t)length);
+            for (size_t i = 1; i <= length; ++i)
+            {
+                lua_rawgeti(m_state, index, (int)i);
+                const bool isWritten = write(lua_gettop(m_state), depth + 1, maxDepth);
+                lua_pop(m_state, 1);
+                if (!isWritten) return false;
+            }
+            return true;
+        }
+
+        out.push_back((char)TagMap);
+        lua::write(out, (uint32_t)count);
+        lua_pushnil(m_state);
+        while (lua_next(m_state, index))
+        {
+            const int value = lua_gettop(m_state);
+            if (!write(value - 1, depth + 1, maxDepth) || !write(value, depth + 1, maxDepth))
+            {
+                lua_pop(m_state, 2);
+                return false;
+            }
+            lua_pop(m_state, 1);
+        }
+        return true;
+    }
+};
+
+///
+/// class Decoder
+///
+class Decoder
+{
+private:
+    lua_State *               m_state;      ///< target state
+    const Channel::Message &  m_message;    ///< input
+    size_t                    m_position;   ///< read position
+public:
+    Decoder(lua_State * state, const Channel::Message & message)
+        : m_state(state)
+        , m_message(message)
+        , m_position(0)
+    {
+    }
+
+    inline bool isDone() const { return m_position == m_message.data.size(); }
+
+    // pushes exactly one value on success and nothing on failure
+    bool push(const int depth, const int maxDepth)
+    {
+        if (depth >= maxDepth || !lua_checkstack(m_state, 3)) return false;
+
+        uint8_t tag = 0;
+        if (!read(tag)) return false;
+
+        switch (tag)
+        {
+        case TagNil:
+            lua_pushnil(m_state);
+            return true;
+        case TagFalse:
+        case TagTrue:
+            lua_pushboolean(m_state, TagTrue == tag);
+            return true;
+        case TagInteger:
+        {
+            int32_t integer = 0;
+            if (!read(integer)) return false;
+            lua_pushnumber(m_state, integer);
+            return true;
+        }
+        case TagNumber:
+        {
+            double number = 0;
+            if (!read(number)) return false;
+            lua_pushnumber(m_state, number);
+            return true;
+        }
+        case TagString:
+        {
+            uint32_t length = 0;
+            if (!read(length) || m_message.data.size() - m_position < length) return false;
+            lua_pushlstring(m_state, m_message.data.data() + m_position, length);
+            m_position += length;
+            return true;
+        }
+        case TagArray:
+        {
+            uint32_t count = 0;
+            if (!read(count) || m_message.data.size() - m_position < count) return false;
+            const int top = lua_gettop(m_state);
+            lua_createtable(m_state, (int)count, 0);
+            for (uint32_t i = 1; i <= count; ++i)
+            {
+                if (!push(depth + 1, maxDepth))
+                {
+                    lua_settop(m_state, top);
+                    return false;
+                }
+                lua_rawseti(m_state, -2, (int)i);
+            }
+            return true;
+        }
+        case TagMap:
+        {
+            uint32_t count = 0;
+            if (!read(count) || (m_message.data.size() - m_position) / 2 < count) return false;
+            const int top = lua_gettop(m_state);
+            lua_createtable(m_state, 0, (int)count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                // nil and NaN keys only come from damaged data, rawset would raise on them
+                if (!push(depth + 1, maxDepth) || lua_isnil(m_state, -1) || !lua_equal(m_state, -1, -1) || !push(depth + 1, maxDepth))
+                {
+                    lua_settop(m_state, top);
+                    return false;
+                }
+                lua_rawset(m_state, -3);
+            }
+            return true;
+        }
+        case TagFrozen:
+        {
+            uint32_t index = 0;
+            if (!read(index) || index >= m_message.frozen.size()) return false;
+            const Channel::Message::Frozen & frozen = m_message.frozen[index];
+            frozen.data->push(m_state, frozen.node);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+private:
+    template <typename T>
+    bool read(T & value)
+    {
+        if (m_message.data.size() - m_position < sizeof(value)) return false;
+
+        memcpy(&value, m_message.data.data() + m_position, sizeof(value));
+        m_position += sizeof(value);
+        return true;
+    }
+};
+
+inline std::shared_ptr<Channel> * checkChannel(lua_State * state, const int index)
+{
+    return static_cast<std::shared_ptr<Channel> *>(luaL_checkudata(state, index, kMetatableName));
+}
+
+int luaTrySend(lua_State * state)
+{
+    Channel & channel = **checkChannel(state, 1);
+    luaL_checkany(state, 2);
+
+    Channel::Message message;
+    std::string error;
+    if (!Channel::encode(state, 2, message, &error))
+    {
+        return luaL_error(state, "[channel] %s", error.c_str());
+    }
+    lua_pushboolean(state, channel.trySend(message));
+    return 1;
+}
+
+int luaTryReceive(lua_State * state)
+{
+    Channel & channel = **checkChannel(state, 1);
+    Channel::Message message;
+    if (!channel.tryReceive(message))
+    {
+        lua_pushboolean(state, 0);
+        return 1;
+    }
+
+    lua_pushboolean(state, 1);
+    if (!Channel::decode(state, message))
+    {
+        return luaL_error(state, "[channel] damaged message");
+    }
+    return 2;
+}
+
+int luaClose(lua_State * state)
+{
+    (*checkChannel(state, 1))->close();
+    return 0;
+}
+
+int luaIsClosed(lua_State * state)
+{
+    lua_pushboolean(state, (*checkChannel(state, 1))->isClosed());
+    return 1;
+}
+
+int luaSize(lua_State * state)
+{
+    lua_pushinteger(state, (lua_Integer)(*checkChannel(state, 1))->getSize());
+    return 1;
+}
+
+int luaGc(lua_State * state)
+{
+    typedef std::shared_ptr<Channel> Pointer;
+    checkChannel(state, 1)->~Pointer();
+    return 0;
+}
+
+void pushMetatable(lua_State * state)
+{
+    if (0 == luaL_newmetatable(state, kMetatableName)) return;
+
+    static const luaL_reg methods[] =
+    {
+        { "trysend", luaTrySend },
+        { "tryreceive", luaTryReceive },
+        { "close", luaClose },
+        { "isclosed", luaIsClosed },
+        { "size", luaSize },
+        { nullptr, nullptr }
+    };
+    lua_newtable(state);
+    for (const luaL_reg * reg = methods; reg->name; ++reg)
+    {
+        lua_pushcfunction(state, reg->func);
+        lua_setfield(state, -2, reg->name);
+    }
+
+    if (0 == luaL_loadbuffer(state, kBlockingCalls, strlen(kBlockingCalls), "=channel"))
+    {
+        lua_pushcfunction(state, luaTrySend);
+        lua_pushcfunction(state, luaTryReceive);
+        lua_pushcfunction(state, luaIsClosed);
+        lua_getglobal(state, "coroutine");
+        lua_getfield(state, -1, "yield");
+        lua_remove(state, -2);
+        if (0 == lua_pcall(state, 4, 2, 0))
+        {
+            lua_setfield(state, -3, "receive");
+            lua_setfield(state, -2, "send");
+        }
+        else
+        {
+            lua_pop(state, 1);
+        }
+    }
+    else
+    {
+        lua_pop(state, 1);
+    }
+
+    lua_setfield(state, -2, "__index");
+    lua_pushcfunction(state, luaGc);
+    lua_setfield(state, -2, "__gc");
+    lua_pushboolean(state, 0);
+    lua_setfield(state, -2, "__metatable");
+}
+} // anonymous
+
+Channel::Channel(const size_t capacity)
+    : m_mask(1)
+    , m_enqueue(0)
+    , m_dequeue(0)
+    , m_isClosed(false)
+{
+    while (m_mask + 1 < capacity)
+    {
+        m_mask = (m_mask << 1) | 1;
+    }
+    m_cells.reset(new Cell[m_mask + 1]);
+    for (size_t i = 0; i <= m_mask; ++i)
+    {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+size_t Channel::getSize() const
+{
+    const size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+    const size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+}
+
+void Channel::close()
+{
+    m_isClosed.store(true, std::memory_order_release);
+}
+
+bool Channel::trySend(Message & message)
+{
+    if (isClosed()) return false;
+
+    size_t position = m_enqueue.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Cell & cell = m_cells[position & m_mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (0 == difference)
+        {
+            // cell is free for this lap, claim it
+            if (m_enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                cell.message = std::move(message);
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            // receivers have not freed the cell yet
+            return false;
+        }
+        else
+        {
+            position = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Channel::tryReceive(Message & message)
+{
+    size_t position = m_dequeue.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Cell & cell = m_cells[position & m_mask];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        const intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (0 == difference)
+        {
+            if (m_dequeue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                message = std::move(cell.message);
+                cell.message = Message();
+                cell.sequence.store(position + m_mask + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (difference < 0)
+        {
+            return false;
+        }
+        else
+        {
+            position = m_dequeue.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Channel::trySend(lua_State * state, const int index, std::string * error)
+{
+    if (isClosed()) return false;
+
+    Message message;
+    return encode(state, index, message, error) && trySend(message);
+}
+
+bool Channel::tryReceive(lua_State * state)
+{
+    Message message;
+    return tryReceive(message) && decode(state, message);
+}
+
+bool Channel::encode(lua_State * state, const int index, Message & message, std::string * error)
+{
+    const int absoluteIndex = (index > 0 || index <= LUA_REGISTRYINDEX) ? index : lua_gettop(state) + index + 1;
+    message.data.clear();
+    message.frozen.clear();
+
+    Encoder encoder(state, message);
+    if (encoder.write(absoluteIndex, 0, kMaxDepth)) return true;
+
+    if (error)
+    {
+        *error = encoder.getError() ? encoder.getError() : "value can't be sent";
+    }
+    return false;
+}
+
+bool Channel::decode(lua_State * state, const Message & message)
+{
+    Decoder decoder(state, message);
+    if (!decoder.push(0, kMaxDepth)) return false;
+    if (decoder.isDone()) return true;
+
+    lua_pop(state, 1);
+    return false;
+}
+
+void Channel::push(lua_State * state, const std::shared_ptr<Channel> & channel)
+{
+    void * memory = lua_newuserdata(state, sizeof(std::shared_ptr<Channel>));
+    new (memory) std::shared_ptr<Channel>(channel);
+    pushMetatable(state);
+    lua_setmetatable(state, -2);
+}
+
+std::shared_ptr<Channel> Channel::toChannel(lua_State * state, const int index)
+{
+    void * memory = lua_touserdata(state, index);
+    if (!memory || !lua_getmetatable(state, index)) return nullptr;
+
+    luaL_getmetatable(state, kMetatableName);
+    const bool isChannel = 0 != lua_rawequal(state, -1, -2);
+    lua_pop(state, 2);
+    return isChannel ? *static_cast<std::shared_ptr<Channel> *>(memory) : nullptr;
+}
+} // lua
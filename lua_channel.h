@@ -0,0 +1,131 @@
+#ifndef STREN_LUA_CHANNEL_H
+#define STREN_LUA_CHANNEL_H
+
+#include "lua_ext.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+class FrozenTable;
+///
+/// class Channel
+///
+/// Bounded lock-free queue of messages between lua virtual machines on any threads, any amount of
+/// senders and receivers. A message is encoded once from the sender's stack into a flat buffer and
+/// pushed straight into the receiver's stack when it is taken out. Frozen tables inside a message are
+/// not encoded, the receiver gets a view of the same shared data. Scripts get the channel as userdata:
+///     ch:trysend(value)       - returns false if channel is full or closed
+///     ch:tryreceive()         - returns true, value or false if channel is empty
+///     ch:send(value)          - yields the coroutine while channel is full, returns false if it is closed
+///     ch:receive()            - yields the coroutine while channel is empty, returns nil if it is closed
+///     ch:close()              - senders fail from now on, receivers take what is left
+/// Blocking calls resume on the next resume of the coroutine, so they suit Scheduler tasks.
+/// Messages hold nil, booleans, numbers, strings, tables and frozen tables; tables are copied,
+/// cycles and functions are rejected.
+/// Received tables are built in full when they are taken out. They are plain tables, so receivers can
+/// use pairs, ipairs and # and modify them; a lazy view could offer none of this in lua 5.1, which has
+/// no __pairs and no __len for tables. Strings are copied as well, because lua interns every string.
+/// Data which is large or read only partially should be sent as a frozen table: it travels by reference
+/// and is decoded on access.
+///
+class Channel
+{
+public:
+    ///
+    /// struct Message
+    ///
+    struct Message
+    {
+        ///
+        /// struct Frozen
+        ///
+        struct Frozen
+        {
+            std::shared_ptr<const FrozenTable> data;    ///< shared data
+            uint32_t                           node;    ///< sent subtable
+        };
+        std::string         data;       ///< encoded value
+        std::vector<Frozen> frozen;     ///< frozen tables referenced by data
+    };
+private:
+    static const int kMaxDepth = 512;   ///< nesting limit, also stops on cycles
+    ///
+    /// struct Cell
+    ///
+    struct Cell
+    {
+        std::atomic<size_t> sequence;   ///< turn of the cell, see Vyukov's bounded MPMC queue
+        Message             message;    ///< stored message
+    };
+
+    std::unique_ptr<Cell[]>          m_cells;       ///< ring
+    size_t                           m_mask;        ///< capacity - 1
+    alignas(64) std::atomic<size_t>  m_enqueue;     ///< next position to write
+    alignas(64) std::atomic<size_t>  m_dequeue;     ///< next position to read
+    alignas(64) std::atomic<bool>    m_isClosed;    ///< no more sends
+public:
+    ///
+    /// Constructor, capacity is rounded up to a power of two
+    ///
+    explicit Channel(const size_t capacity);
+    ///
+    /// get maximum amount of queued messages
+    ///
+    inline size_t getCapacity() const { return m_mask + 1; }
+    ///
+    /// get approximate amount of queued messages
+    ///
+    size_t getSize() const;
+    ///
+    /// forbid further sends
+    ///
+    void close();
+    ///
+    /// check if channel is closed
+    ///
+    inline bool isClosed() const { return m_isClosed.load(std::memory_order_acquire); }
+    ///
+    /// queue message, returns false if channel is full or closed; message is moved only on success
+    ///
+    bool trySend(Message & message);
+    ///
+    /// take message, returns false if channel is empty
+    ///
+    bool tryReceive(Message & message);
+    ///
+    /// encode value at index and queue it, returns false if channel is full or closed or value can't be sent
+    ///
+    bool trySend(lua_State * state, const int index, std::string * error = nullptr);
+    ///
+    /// take message and push its value, returns false and pushes nothing if channel is empty
+    ///
+    bool tryReceive(lua_State * state);
+    ///
+    /// encode value at index of any lua state
+    ///
+    static bool encode(lua_State * state, const int index, Message & message, std::string * error = nullptr);
+    ///
+    /// push value of the message to any lua state, returns false if message is damaged
+    ///
+    static bool decode(lua_State * state, const Message & message);
+    ///
+    /// push channel userdata to any lua state
+    ///
+    static void push(lua_State * state, const std::shared_ptr<Channel> & channel);
+    ///
+    /// get channel from userdata at index, nullptr if value is not a channel
+    ///
+    static std::shared_ptr<Channel> toChannel(lua_State * state, const int index);
+private:
+    Channel(const Channel &) = delete;
+    Channel & operator=(const Channel &) = delete;
+};
+} // lua
+
+#endif // STREN_LUA_CHANNEL_H
@@ -0,0 +1,19 @@
+#ifndef STREN_LUA_CONFIG_H
+#define STREN_LUA_CONFIG_H
+
+///
+/// Build configuration of the wrapper. Header code depends on these settings, so the library and every
+/// client have to see the same values: change them here or pass them as project wide compile definitions,
+/// never per translation unit.
+///
+
+///
+/// LUA_WRAPPER_CHECKED selects how much the wrapper validates: 1 - every call checks the lua state,
+/// asserts on wrong value types and StackGuard asserts on unbalanced stack; 0 - hot paths compile down
+/// to the raw C API calls.
+///
+#if !defined(LUA_WRAPPER_CHECKED)
+#define LUA_WRAPPER_CHECKED 1
+#endif
+
+#endif // STREN_LUA_CONFIG_H
@@ -0,0 +1,277 @@
+#include "lua_event_bus.h"
+#include "lua_stack.h"
+#include "utils.h"
+
+#include <algorithm>
+
+namespace lua
+{
+EventBus::EventBus()
+    : m_lastListener(kInvalidListener)
+    , m_pendingCount(0)
+    , m_isFlushing(false)
+{
+}
+
+EventBus::~EventBus()
+{
+    Stack stack;
+    for (auto & it : m_channels)
+    {
+        release(it.second.pending);
+        if (LUA_NOREF != it.second.events)
+        {
+            stack.deleteReference(it.second.events);
+        }
+    }
+}
+
+void EventBus::loadLibs(const char * id)
+{
+    static const luaL_reg regs[] =
+    {
+        { "subscribe", luaSubscribe },
+        { "unsubscribe", luaUnsubscribe },
+        { "emit", luaEmit },
+        { nullptr, nullptr }
+    };
+
+    Stack stack;
+    stack.loadLibs(id, regs, this);
+}
+
+EventBus::ListenerId EventBus::subscribe(const std::string & type, const Function & function)
+{
+    Channel & channel = getChannel(type);
+    const ListenerId id = ++m_lastListener;
+    channel.listeners.push_back({ id, function, false });
+    m_listeners.emplace(id, &channel);
+    return id;
+}
+
+bool EventBus::unsubscribe(const ListenerId listener)
+{
+    auto it = m_listeners.find(listener);
+    if (it == m_listeners.end()) return false;
+
+    std::vector<Listener> & listeners = it->second->listeners;
+    auto found = std::find_if(listeners.begin(), listeners.end(), [listener](const Listener & item) { return item.id == listener; });
+    if (m_isFlushing)
+    {
+        // flush walks listeners by index, they are compacted when it is over
+        found->isRemoved = true;
+    }
+    else
+    {
+        listeners.erase(found);
+    }
+    m_listeners.erase(it);
+    return true;
+}
+
+void EventBus::emit(const std::string & type, const Value & event)
+{
+    if (event.isTable() || event.isFunction())
+    {
+        // caller keeps its reference, the bus owns a copy
+        Stack stack;
+        emit(type, Value(stack.copyReference(event.getReference()), event.isTable()));
+    }
+    else
+    {
+        emit(type, Value(event));
+    }
+}
+
+void EventBus::emit(const std::string & type, Value && event)
+{
+    Channel & channel = getChannel(type);
+    channel.pending.push_back(std::move(event));
+    ++m_pendingCount;
+    if (!channel.isQueued)
+    {
+        channel.isQueued = true;
+        m_queue.push_back(&channel);
+    }
+}
+
+size_t EventBus::getListenerCount(const std::string & type) const
+{
+    auto it = m_channels.find(type);
+    if (it == m_channels.end()) return 0;
+
+    const std::vector<Listener> & listeners = it->second.listeners;
+    return std::count_if(listeners.begin(), listeners.end(), [](const Listener & listener) { return !listener.isRemoved; });
+}
+
+size_t EventBus::flush(std::vector<std::string> * errors)
+{
+    if (m_isFlushing || m_queue.empty()) return 0;
+
+    // events emitted by listeners go to the next flush
+    m_isFlushing = true;
+    m_flushQueue.swap(m_queue);
+    m_pendingCount = 0;
+
+    size_t calls = 0;
+    for (Channel * channel : m_flushQueue)
+    {
+        channel->isQueued = false;
+        channel->dispatching.swap(channel->pending);
+        calls += dispatch(*channel, errors);
+        release(channel->dispatching);
+    }
+
+    for (Channel * channel : m_flushQueue)
+    {
+        std::vector<Listener> & listeners = channel->listeners;
+        listeners.erase(std::remove_if(listeners.begin(), listeners.end(), [](const Listener & listener) { return listener.isRemoved; }), listeners.end());
+    }
+    m_flushQueue.clear();
+    m_isFlushing = false;
+    return calls;
+}
+
+void EventBus::clear()
+{
+    for (Channel * channel : m_queue)
+    {
+        channel->isQueued = false;
+        release(channel->pending);
+    }
+    m_queue.clear();
+    m_pendingCount = 0;
+}
+
+void EventBus::release(std::vector<Value> & events)
+{
+    Stack stack;
+    for (const Value & event : events)
+    {
+        if (event.isTable() || event.isFunction())
+        {
+            stack.deleteReference(event.getReference());
+        }
+    }
+    events.clear();
+}
+
+EventBus::Channel & EventBus::getChannel(const std::string & type)
+{
+    auto it = m_channels.find(type);
+    if (it != m_channels.end()) return it->second;
+
+    Channel & channel = m_channels[type];
+    channel.type = type;
+    channel.events = LUA_NOREF;
+    channel.eventsCount = 0;
+    channel.isQueued = false;
+    return channel;
+}
+
+size_t EventBus::dispatch(Channel & channel, std::vector<std::string> * errors)
+{
+    const size_t listenerCount = channel.listeners.size();
+    if (0 == listenerCount) return 0;
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return 0;
+
+    const int count = (int)channel.dispatching.size();
+    if (LUA_NOREF == channel.events)
+    {
+        lua_createtable(state, count, 0);
+        lua_pushvalue(state, -1);
+        channel.events = stack.popReference("EventBus::dispatch");
+    }
+    else
+    {
+        lua_getref(state, channel.events);
+    }
+    const int events = lua_gettop(state);
+    for (int i = 0; i < count; ++i)
+    {
+        stack.push(channel.dispatching[i]);
+        lua_rawseti(state, events, i + 1);
+    }
+    // drop the tail of a longer previous batch
+    for (int i = count; i < channel.eventsCount; ++i)
+    {
+        lua_pushnil(state);
+        lua_rawseti(state, events, i + 1);
+    }
+    channel.eventsCount = count;
+
+    size_t calls = 0;
+    std::string error;
+    // listeners subscribed by callbacks are appended, so indices stay valid and they wait for the next flush
+    for (size_t i = 0; i < listenerCount; ++i)
+    {
+        if (channel.listeners[i].isRemoved) continue;
+        if (!stack.pushFunction(channel.listeners[i].function.getRef())) continue;
+
+        lua_pushvalue(state, events);
+        lua_pushinteger(state, count);
+        lua_pushlstring(state, channel.type.data(), channel.type.size());
+        ++calls;
+        if (!stack.call(3, 0, &error))
+        {
+            if (errors)
+            {
+                errors->push_back(std::move(error));
+            }
+            else
+            {
+                stren::assertMessage(false, error.c_str());
+            }
+            error.clear();
+        }
+    }
+    stack.pop(1);
+    return calls;
+}
+
+EventBus * EventBus::getEventBus(lua_State * state)
+{
+    return static_cast<EventBus *>(lua_touserdata(state, lua_upvalueindex(1)));
+}
+
+int EventBus::luaSubscribe(lua_State * state)
+{
+    EventBus * bus = getEventBus(state);
+    const char * type = luaL_checkstring(state, 1);
+    luaL_checktype(state, 2, LUA_TFUNCTION);
+
+    // callback may run on a coroutine, references are made on the main state
+    Stack stack;
+    lua_pushvalue(state, 2);
+    lua_xmove(state, stack.getState(), 1);
+    const Function function(stack.popReference("EventBus::subscribe"));
+    lua_pushinteger(state, (lua_Integer)bus->subscribe(type, function));
+    return 1;
+}
+
+int EventBus::luaUnsubscribe(lua_State * state)
+{
+    EventBus * bus = getEventBus(state);
+    const ListenerId listener = (ListenerId)luaL_checkinteger(state, 1);
+    lua_pushboolean(state, bus->unsubscribe(listener));
+    return 1;
+}
+
+int EventBus::luaEmit(lua_State * state)
+{
+    EventBus * bus = getEventBus(state);
+    const char * type = luaL_checkstring(state, 1);
+    luaL_checkany(state, 2);
+
+    Stack stack;
+    lua_pushvalue(state, 2);
+    lua_xmove(state, stack.getState(), 1);
+    // reference made by get is handed over to the bus
+    bus->emit(type, stack.get(-1));
+    stack.pop(1);
+    return 0;
+}
+} // lua
@@ -0,0 +1,146 @@
+#ifndef STREN_LUA_EVENT_BUS_H
+#define STREN_LUA_EVENT_BUS_H
+
+#include "lua_function.h"
+#include "lua_value.h"
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lua
+{
+///
+/// class EventBus
+///
+/// Collects events emitted during the frame and delivers them in batches. On flush every listener
+/// of an event type is called once as listener(events, count, type), where events is an array of all
+/// events of that type, so the cost of entering lua grows with listeners rather than with events.
+/// The array is built once per type and reused between flushes: listeners must copy events they keep.
+///     bus.loadLibs();                             -- events.subscribe("damage", function(list, n) ... end)
+///     bus.emit("damage", Value(42));
+///     bus.flush();
+/// Ordering: types are delivered in order of their first event since the last flush, events keep
+/// emission order, listeners are called in subscription order. A failing listener does not stop others.
+/// Events emitted and listeners subscribed while flushing are handled by the next flush.
+/// Table and function events are kept by reference: the bus owns the reference of an emitted event and
+/// releases it once the event is delivered or dropped.
+///
+class EventBus
+{
+public:
+    typedef size_t ListenerId;
+    static const ListenerId kInvalidListener = 0;   ///< id which is never given to a listener
+private:
+    ///
+    /// struct Listener
+    ///
+    struct Listener
+    {
+        ListenerId id;          ///< listener id
+        Function   function;    ///< lua function
+        bool       isRemoved;   ///< unsubscribed while flushing
+    };
+    ///
+    /// struct Channel
+    ///
+    struct Channel
+    {
+        std::string           type;             ///< event type
+        std::vector<Listener> listeners;        ///< subscribers in subscription order
+        std::vector<Value>    pending;          ///< events emitted since the last flush
+        std::vector<Value>    dispatching;      ///< events being delivered, keeps capacity between flushes
+        int                   events;           ///< reused events array
+        int                   eventsCount;      ///< amount of events left in the array by the last flush
+        bool                  isQueued;         ///< channel is in the flush queue
+    };
+
+    std::unordered_map<std::string, Channel>  m_channels;       ///< channels by event type
+    std::unordered_map<ListenerId, Channel *> m_listeners;      ///< channel of every listener
+    std::vector<Channel *>                    m_queue;          ///< channels with pending events in order of the first event
+    std::vector<Channel *>                    m_flushQueue;     ///< channels being flushed, keeps capacity between flushes
+    ListenerId                                m_lastListener;   ///< last given id
+    size_t                                    m_pendingCount;   ///< amount of pending events
+    bool                                      m_isFlushing;     ///< true while delivering events
+public:
+    ///
+    /// Constructor
+    ///
+    EventBus();
+    ///
+    /// Destructor
+    ///
+    ~EventBus();
+    ///
+    /// register lua api in the global table with the given name
+    ///
+    void loadLibs(const char * id = "events");
+    ///
+    /// subscribe lua function to the event type
+    ///
+    ListenerId subscribe(const std::string & type, const Function & function);
+    ///
+    /// unsubscribe listener, returns false if it is unknown
+    ///
+    bool unsubscribe(const ListenerId listener);
+    ///
+    /// queue event till the next flush, table or function reference of the event is copied
+    ///
+    void emit(const std::string & type, const Value & event);
+    ///
+    /// queue event till the next flush, the bus takes over table or function reference of the event
+    ///
+    void emit(const std::string & type, Value && event);
+    ///
+    /// get amount of queued events
+    ///
+    inline size_t getPendingCount() const { return m_pendingCount; }
+    ///
+    /// get amount of listeners of the event type
+    ///
+    size_t getListenerCount(const std::string & type) const;
+    ///
+    /// deliver queued events, returns amount of listener calls; errors receives messages of failed
+    /// listeners, without it failures assert
+    ///
+    size_t flush(std::vector<std::string> * errors = nullptr);
+    ///
+    /// drop queued events
+    ///
+    void clear();
+private:
+    EventBus(const EventBus &) = delete;
+    EventBus & operator=(const EventBus &) = delete;
+    ///
+    /// get or create channel
+    ///
+    Channel & getChannel(const std::string & type);
+    ///
+    /// release references of table and function events and drop them
+    ///
+    static void release(std::vector<Value> & events);
+    ///
+    /// deliver events of one channel
+    ///
+    size_t dispatch(Channel & channel, std::vector<std::string> * errors);
+    ///
+    /// get event bus from upvalue
+    ///
+    static EventBus * getEventBus(lua_State * state);
+    ///
+    /// lua: events.subscribe(type, function)
+    ///
+    static int luaSubscribe(lua_State * state);
+    ///
+    /// lua: events.unsubscribe(id)
+    ///
+    static int luaUnsubscribe(lua_State * state);
+    ///
+    /// lua: events.emit(type, event)
+    ///
+    static int luaEmit(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_EVENT_BUS_H
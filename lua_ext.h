@@ -7,4 +7,14 @@ extern "C" {
 #include <lauxlib.h>
 }
 
+#include "lua_config.h"
+
+#if LUA_WRAPPER_CHECKED
+#define LUA_CHECK(condition, message) stren::assertMessage((condition), (message))
+#define LUA_STATE_OK(state) (nullptr != (state))
+#else
+#define LUA_CHECK(condition, message) ((void)0)
+#define LUA_STATE_OK(state) true
+#endif
+
 #endif // LUA_EXT_H
@@ -0,0 +1,659 @@
+#include "lua_frozen_table.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+namespace lua
+{
+namespace
+{
+const char * kMetatableName = "lua.FrozenTable";
+const uint32_t kBuildAttempts = 8;              ///< bucket layouts tried before falling back to probing
+const uint32_t kMaxDisplacement = 1u << 16;     ///< displacements tried for one bucket
+const uint32_t kDirect = 0x80000000u;           ///< displacement flag, bucket of one key stores its position
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+bool isArrayIndex(const double number, const uint32_t arraySize)
+{
+    return number >= 1.0 && number <= arraySize && number == std::floor(number);
+}
+
+/// map 32 bits of hash to [0, range) without division
+inline uint32_t reduce(const uint64_t hash, const uint32_t range)
+{
+    return static_cast<uint32_t>(((hash & 0xFFFFFFFFULL) * range) >> 32);
+}
+} // namespace
+
+///
+/// class FrozenTable::Builder
+///
+class FrozenTable::Builder
+{
+private:
+    FrozenTable &                             m_table;      ///< table being built
+    lua_State *                               m_state;      ///< source lua state
+    std::unordered_map<const void *, uint32_t> m_visited;   ///< lua table to node
+    std::unordered_map<std::string, uint32_t> m_stringIds;  ///< string to pool index
+public:
+    Builder(FrozenTable & table, lua_State * state)
+        : m_table(table)
+        , m_state(state)
+    {
+    }
+    ///
+    /// add table at index, returns node index
+    ///
+    uint32_t addTable(const int index)
+    {
+        const void * pointer = lua_topointer(m_state, index);
+        auto it = m_visited.find(pointer);
+        if (it != m_visited.end()) return it->second;
+
+        // node is registered before recursion, so cycles and shared subtables point to the same node
+        const uint32_t id = static_cast<uint32_t>(m_table.m_nodes.size());
+        m_table.m_nodes.push_back(Node());
+        m_visited[pointer] = id;
+
+        const uint32_t arraySize = static_cast<uint32_t>(lua_objlen(m_state, index));
+        Slot nilSlot = {};
+        std::vector<Slot> array(arraySize, nilSlot);
+        std::vector<Entry> entries;
+
+        lua_checkstack(m_state, 4);
+        lua_pushnil(m_state);
+        while (0 != lua_next(m_state, index))
+        {
+            const int top = lua_gettop(m_state);
+            Slot value;
+            if (makeSlot(top, value))
+            {
+                const int keyType = lua_type(m_state, top - 1);
+                if (LUA_TNUMBER == keyType && isArrayIndex(lua_tonumber(m_state, top - 1), arraySize))
+                {
+                    array[static_cast<uint32_t>(lua_tonumber(m_state, top - 1)) - 1] = value;
+                }
+                else if (LUA_TNUMBER == keyType || LUA_TSTRING == keyType || LUA_TBOOLEAN == keyType)
+                {
+                    Entry entry;
+                    makeSlot(top - 1, entry.key);
+                    entry.value = value;
+                    entries.push_back(entry);
+                }
+            }
+            lua_pop(m_state, 1);
+        }
+
+        Node & node = m_table.m_nodes[id];
+        node.arrayBegin = static_cast<uint32_t>(m_table.m_array.size());
+        node.arraySize = arraySize;
+        m_table.m_array.insert(m_table.m_array.end(), array.begin(), array.end());
+        placeEntries(node, entries);
+        return id;
+    }
+private:
+    ///
+    /// convert lua value at index to slot, returns false for unsupported types
+    ///
+    bool makeSlot(const int index, Slot & slot)
+    {
+        slot = Slot();
+        switch (lua_type(m_state, index))
+        {
+        case LUA_TBOOLEAN:
+            slot.type = Type::Bool;
+            slot.boolean = lua_toboolean(m_state, index) ? 1 : 0;
+            return true;
+        case LUA_TNUMBER:
+            slot.type = Type::Number;
+            slot.number = lua_tonumber(m_state, index);
+            return true;
+        case LUA_TSTRING:
+        {
+            size_t length = 0;
+            const char * str = lua_tolstring(m_state, index, &length);
+            slot.type = Type::String;
+            slot.index = addString(str, length);
+            return true;
+        }
+        case LUA_TTABLE:
+            slot.type = Type::Table;
+            slot.index = addTable(index);
+            return true;
+        default:
+            return false;
+        }
+    }
+    ///
+    /// add string to the pool, returns its index
+    ///
+    uint32_t addString(const char * str, const size_t length)
+    {
+        std::string value(str, length);
+        auto it = m_stringIds.find(value);
+        if (it != m_stringIds.end()) return it->second;
+
+        const uint32_t id = static_cast<uint32_t>(m_table.m_strings.size());
+        StringRef ref = { static_cast<uint32_t>(m_table.m_chars.size()), static_cast<uint32_t>(length) };
+        m_table.m_strings.push_back(ref);
+        m_table.m_chars.append(str, length);
+        m_stringIds[value] = id;
+        return id;
+    }
+    ///
+    /// place entries into the hash part of the node
+    ///
+    void placeEntries(Node & node, const std::vector<Entry> & entries)
+    {
+        node.hashBegin = static_cast<uint32_t>(m_table.m_hash.size());
+        node.hashCapacity = 0;
+        node.hashCount = static_cast<uint32_t>(entries.size());
+        node.bucketBegin = static_cast<uint32_t>(m_table.m_buckets.size());
+        node.bucketCount = 0;
+        node.seed = 0;
+        if (entries.empty()) return;
+
+        std::vector<uint64_t> hashes;
+        hashes.reserve(entries.size());
+        for (const Entry & entry : entries)
+        {
+            hashes.push_back(m_table.hash(entry.key));
+        }
+
+        // smaller buckets are easier to place, they cost more displacements
+        for (uint32_t attempt = 0; attempt < kBuildAttempts; ++attempt)
+        {
+            const uint32_t keysPerBucket = attempt < 2 ? 4 : (attempt < 4 ? 2 : 1);
+            const uint32_t bucketCount = std::max<uint32_t>(1, node.hashCount / keysPerBucket);
+            if (displace(node, entries, hashes, bucketCount, attempt)) return;
+        }
+        // keys with equal 64 bit hashes can't be separated by any seed
+        probe(node, entries, hashes);
+    }
+    ///
+    /// build minimal perfect hash part, returns false if some bucket can't be placed
+    ///
+    bool displace(Node & node, const std::vector<Entry> & entries, const std::vector<uint64_t> & hashes, const uint32_t bucketCount, const uint32_t seed)
+    {
+        const uint32_t count = node.hashCount;
+        std::vector<std::vector<uint32_t>> buckets(bucketCount);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            buckets[reduce(mix(hashes[i], seed) >> 32, bucketCount)].push_back(i);
+        }
+        std::vector<uint32_t> order(bucketCount);
+        for (uint32_t i = 0; i < bucketCount; ++i)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&buckets](const uint32_t left, const uint32_t right) { return buckets[left].size() > buckets[right].size(); });
+
+        // largest buckets go first while most entries are free, single keys take whatever is left
+        const uint32_t kEmpty = ~0u;
+        std::vector<uint32_t> slots(count, kEmpty);
+        std::vector<uint32_t> displacements(bucketCount, 0);
+        std::vector<uint32_t> positions;
+        uint32_t freeSlot = 0;
+        for (const uint32_t bucket : order)
+        {
+            const std::vector<uint32_t> & keys = buckets[bucket];
+            if (keys.empty()) break;
+
+            if (1 == keys.size())
+            {
+                while (kEmpty != slots[freeSlot])
+                {
+                    ++freeSlot;
+                }
+                slots[freeSlot] = keys[0];
+                displacements[bucket] = kDirect | freeSlot;
+                continue;
+            }
+
+            bool isPlaced = false;
+            for (uint32_t displacement = 0; displacement < kMaxDisplacement && !isPlaced; ++displacement)
+            {
+                positions.clear();
+                isPlaced = true;
+                for (const uint32_t key : keys)
+                {
+                    const uint32_t position = reduce(mix(hashes[key], seed + 1 + displacement), count);
+                    if (kEmpty != slots[position] || std::find(positions.begin(), positions.end(), position) != positions.end())
+                    {
+                        isPlaced = false;
+                        break;
+                    }
+                    positions.push_back(position);
+                }
+                if (isPlaced)
+                {
+                    for (size_t i = 0, iEnd = keys.size(); i < iEnd; ++i)
+                    {
+                        slots[positions[i]] = keys[i];
+                    }
+                    displacements[bucket] = displacement;
+                }
+            }
+            if (!isPlaced) return false;
+        }
+
+        node.hashCapacity = count;
+        node.bucketCount = bucketCount;
+        node.seed = seed;
+        m_table.m_buckets.insert(m_table.m_buckets.end(), displacements.begin(), displacements.end());
+        m_table.m_hash.resize(node.hashBegin + count);
+        Entry * hash = &m_table.m_hash[node.hashBegin];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            hash[i] = entries[slots[i]];
+        }
+        return true;
+    }
+    ///
+    /// put entries into hash part using linear probing
+    ///
+    void probe(Node & node, const std::vector<Entry> & entries, const std::vector<uint64_t> & hashes)
+    {
+        uint32_t capacity = 1;
+        while (capacity < entries.size() * 2)
+        {
+            capacity <<= 1;
+        }
+        node.hashCapacity = capacity;
+
+        Entry empty = {};
+        m_table.m_hash.resize(node.hashBegin + capacity, empty);
+        Entry * hash = &m_table.m_hash[node.hashBegin];
+        for (size_t i = 0, iEnd = entries.size(); i < iEnd; ++i)
+        {
+            uint32_t position = m_table.locate(node, hashes[i]);
+            while (Type::Nil != hash[position].key.type)
+            {
+                position = (position + 1) & (capacity - 1);
+            }
+            hash[position] = entries[i];
+        }
+    }
+};
+
+// class FrozenTable
+std::shared_ptr<const FrozenTable> FrozenTable::freeze(const Table & table)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return nullptr;
+
+    lua_getref(state, table.getRef());
+    if (!lua_istable(state, -1))
+    {
+        stack.pop(1);
+        stren::assertMessage(false, "[lua] table not found");
+        return nullptr;
+    }
+
+    std::shared_ptr<FrozenTable> frozen = std::make_shared<FrozenTable>();
+    Builder builder(*frozen, state);
+    builder.addTable(lua_gettop(state));
+    stack.pop(1);
+
+    frozen->m_nodes.shrink_to_fit();
+    frozen->m_array.shrink_to_fit();
+    frozen->m_hash.shrink_to_fit();
+    frozen->m_buckets.shrink_to_fit();
+    frozen->m_strings.shrink_to_fit();
+    frozen->m_chars.shrink_to_fit();
+    return frozen;
+}
+
+void FrozenTable::push(Stack & stack) const
+{
+    if (stack.getState())
+    {
+        pushView(stack.getState(), 0);
+    }
+}
+
+void FrozenTable::push(lua_State * state, const uint32_t node) const
+{
+    if (node < m_nodes.size())
+    {
+        pushView(state, node);
+    }
+}
+
+bool FrozenTable::toFrozen(lua_State * state, const int index, std::shared_ptr<const FrozenTable> & data, uint32_t & node)
+{
+    void * memory = lua_touserdata(state, index);
+    if (!memory || !lua_getmetatable(state, index)) return false;
+
+    luaL_getmetatable(state, kMetatableName);
+    const bool isFrozen = 0 != lua_rawequal(state, -1, -2);
+    lua_pop(state, 2);
+    if (!isFrozen) return false;
+
+    const View * view = static_cast<const View *>(memory);
+    data = view->data;
+    node = view->node;
+    return true;
+}
+
+void FrozenTable::makeGlobal(const char * name) const
+{
+    Stack stack;
+    if (stack.getState())
+    {
+        push(stack);
+        lua_setglobal(stack.getState(), name);
+    }
+}
+
+size_t FrozenTable::getMemorySize() const
+{
+    return m_nodes.capacity() * sizeof(Node) +
+        m_array.capacity() * sizeof(Slot) +
+        m_hash.capacity() * sizeof(Entry) +
+        m_buckets.capacity() * sizeof(uint32_t) +
+        m_strings.capacity() * sizeof(StringRef) +
+        m_chars.capacity();
+}
+
+uint64_t FrozenTable::hash(const double number, const char * str, const size_t length)
+{
+    uint64_t hash = kFnvOffset;
+    if (str)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash = (hash ^ static_cast<unsigned char>(str[i])) * kFnvPrime;
+        }
+    }
+    else
+    {
+        // -0.0 and 0.0 are the same key
+        const double value = 0.0 == number ? 0.0 : number;
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+        hash = (hash ^ bits) * kFnvPrime;
+    }
+    return hash;
+}
+
+uint64_t FrozenTable::hash(const Slot & key) const
+{
+    switch (key.type)
+    {
+    case Type::String:
+        return hash(0.0, m_chars.data() + m_strings[key.index].offset, m_strings[key.index].length);
+    case Type::Bool:
+        return hash(key.boolean ? 2.0 : 1.0, nullptr, 0) ^ 1;
+    default:
+        return hash(key.number, nullptr, 0);
+    }
+}
+
+uint64_t FrozenTable::mix(const uint64_t hash, const uint32_t seed)
+{
+    uint64_t value = hash + seed * 0x9E3779B97F4A7C15ULL;
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+uint32_t FrozenTable::locate(const Node & node, const uint64_t keyHash) const
+{
+    if (0 == node.bucketCount) return mix(keyHash, node.seed) & (node.hashCapacity - 1);
+
+    const uint32_t displacement = m_buckets[node.bucketBegin + reduce(mix(keyHash, node.seed) >> 32, node.bucketCount)];
+    if (0 != (displacement & kDirect)) return displacement & ~kDirect;
+
+    return reduce(mix(keyHash, node.seed + 1 + displacement), node.hashCapacity);
+}
+
+bool FrozenTable::isEqual(const Slot & key, lua_State * state, const int index) const
+{
+    switch (key.type)
+    {
+    case Type::Bool:
+        return LUA_TBOOLEAN == lua_type(state, index) && (0 != key.boolean) == (0 != lua_toboolean(state, index));
+    case Type::Number:
+        return LUA_TNUMBER == lua_type(state, index) && key.number == lua_tonumber(state, index);
+    case Type::String:
+    {
+        if (LUA_TSTRING != lua_type(state, index)) return false;
+
+        size_t length = 0;
+        const char * str = lua_tolstring(state, index, &length);
+        const StringRef & ref = m_strings[key.index];
+        return length == ref.length && 0 == memcmp(str, m_chars.data() + ref.offset, length);
+    }
+    default:
+        return false;
+    }
+}
+
+const FrozenTable::Slot * FrozenTable::find(const Node & node, lua_State * state, const int index) const
+{
+    if (LUA_TNUMBER == lua_type(state, index))
+    {
+        const double number = lua_tonumber(state, index);
+        if (isArrayIndex(number, node.arraySize))
+        {
+            const Slot & slot = m_array[node.arrayBegin + static_cast<uint32_t>(number) - 1];
+            return Type::Nil != slot.type ? &slot : nullptr;
+        }
+    }
+
+    const Entry * entry = findEntry(node, state, index);
+    return entry ? &entry->value : nullptr;
+}
+
+const FrozenTable::Entry * FrozenTable::findEntry(const Node & node, lua_State * state, const int index) const
+{
+    if (0 == node.hashCount) return nullptr;
+
+    uint64_t keyHash = 0;
+    switch (lua_type(state, index))
+    {
+    case LUA_TSTRING:
+    {
+        size_t length = 0;
+        const char * str = lua_tolstring(state, index, &length);
+        keyHash = hash(0.0, str, length);
+        break;
+    }
+    case LUA_TNUMBER:
+        keyHash = hash(lua_tonumber(state, index), nullptr, 0);
+        break;
+    case LUA_TBOOLEAN:
+        keyHash = hash(lua_toboolean(state, index) ? 2.0 : 1.0, nullptr, 0) ^ 1;
+        break;
+    default:
+        return nullptr;
+    }
+
+    const Entry * hashPart = &m_hash[node.hashBegin];
+    uint32_t position = locate(node, keyHash);
+    if (0 != node.bucketCount) return isEqual(hashPart[position].key, state, index) ? &hashPart[position] : nullptr;
+
+    while (Type::Nil != hashPart[position].key.type)
+    {
+        if (isEqual(hashPart[position].key, state, index)) return &hashPart[position];
+
+        position = (position + 1) & (node.hashCapacity - 1);
+    }
+    return nullptr;
+}
+
+void FrozenTable::pushSlot(lua_State * state, const Slot & slot, const int parent, const int key) const
+{
+    switch (slot.type)
+    {
+    case Type::Bool:
+        lua_pushboolean(state, slot.boolean);
+        break;
+    case Type::Number:
+        lua_pushnumber(state, slot.number);
+        break;
+    case Type::String:
+        lua_pushlstring(state, m_chars.data() + m_strings[slot.index].offset, m_strings[slot.index].length);
+        break;
+    case Type::Table:
+    {
+        // subtable views are cached in the environment of the parent view
+        lua_getfenv(state, parent);
+        const int cache = lua_gettop(state);
+        lua_pushvalue(state, key);
+        lua_rawget(state, cache);
+        if (lua_isnil(state, -1))
+        {
+            lua_pop(state, 1);
+            pushView(state, slot.index);
+            lua_pushvalue(state, key);
+            lua_pushvalue(state, -2);
+            lua_rawset(state, cache);
+        }
+        lua_remove(state, cache);
+        break;
+    }
+    default:
+        lua_pushnil(state);
+        break;
+    }
+}
+
+void FrozenTable::pushView(lua_State * state, const uint32_t node) const
+{
+    void * memory = lua_newuserdata(state, sizeof(View));
+    new (memory) View{ shared_from_this(), node };
+
+    pushMetatable(state);
+    lua_setmetatable(state, -2);
+    lua_newtable(state);
+    lua_setfenv(state, -2);
+}
+
+void FrozenTable::pushMetatable(lua_State * state)
+{
+    if (0 != luaL_newmetatable(state, kMetatableName))
+    {
+        static const luaL_reg metamethods[] =
+        {
+            { "__index", luaIndex },
+            { "__len", luaLen },
+            { "__pairs", luaPairs },
+            { "__call", luaPairs },
+            { "__newindex", luaNewIndex },
+            { "__gc", luaGc },
+            { nullptr, nullptr }
+        };
+        for (const luaL_reg * reg = metamethods; reg->name; ++reg)
+        {
+            lua_pushcfunction(state, reg->func);
+            lua_setfield(state, -2, reg->name);
+        }
+        lua_pushboolean(state, 0);
+        lua_setfield(state, -2, "__metatable");
+    }
+}
+
+int FrozenTable::luaIndex(lua_State * state)
+{
+    const View * view = static_cast<const View *>(luaL_checkudata(state, 1, kMetatableName));
+    const FrozenTable & data = *view->data;
+    const Slot * slot = data.find(data.m_nodes[view->node], state, 2);
+    if (slot)
+    {
+        data.pushSlot(state, *slot, 1, 2);
+    }
+    else
+    {
+        lua_pushnil(state);
+    }
+    return 1;
+}
+
+int FrozenTable::luaLen(lua_State * state)
+{
+    const View * view = static_cast<const View *>(luaL_checkudata(state, 1, kMetatableName));
+    lua_pushinteger(state, view->data->m_nodes[view->node].arraySize);
+    return 1;
+}
+
+int FrozenTable::luaNext(lua_State * state)
+{
+    const View * view = static_cast<const View *>(luaL_checkudata(state, 1, kMetatableName));
+    const FrozenTable & data = *view->data;
+    const Node & node = data.m_nodes[view->node];
+    const uint32_t hashCapacity = node.hashCapacity;
+    lua_settop(state, 2);
+
+    // iteration goes through the array part and then through the hash part
+    uint32_t position = 0;
+    if (!lua_isnil(state, 2))
+    {
+        if (LUA_TNUMBER == lua_type(state, 2) && isArrayIndex(lua_tonumber(state, 2), node.arraySize))
+        {
+            position = static_cast<uint32_t>(lua_tonumber(state, 2));
+        }
+        else
+        {
+            const Entry * entry = data.findEntry(node, state, 2);
+            if (!entry) return luaL_error(state, "invalid key to 'next'");
+
+            position = node.arraySize + static_cast<uint32_t>(entry - &data.m_hash[node.hashBegin]) + 1;
+        }
+    }
+
+    for (; position < node.arraySize; ++position)
+    {
+        const Slot & slot = data.m_array[node.arrayBegin + position];
+        if (Type::Nil != slot.type)
+        {
+            lua_pushinteger(state, position + 1);
+            data.pushSlot(state, slot, 1, lua_gettop(state));
+            return 2;
+        }
+    }
+    for (uint32_t i = position - node.arraySize; i < hashCapacity; ++i)
+    {
+        const Entry & entry = data.m_hash[node.hashBegin + i];
+        if (Type::Nil != entry.key.type)
+        {
+            data.pushSlot(state, entry.key, 1, 0);
+            data.pushSlot(state, entry.value, 1, lua_gettop(state));
+            return 2;
+        }
+    }
+    lua_pushnil(state);
+    return 1;
+}
+
+int FrozenTable::luaPairs(lua_State * state)
+{
+    luaL_checkudata(state, 1, kMetatableName);
+    lua_pushcfunction(state, luaNext);
+    lua_pushvalue(state, 1);
+    lua_pushnil(state);
+    return 3;
+}
+
+int FrozenTable::luaNewIndex(lua_State * state)
+{
+    return luaL_error(state, "frozen table is read-only");
+}
+
+int FrozenTable::luaGc(lua_State * state)
+{
+    View * view = static_cast<View *>(luaL_checkudata(state, 1, kMetatableName));
+    view->~View();
+    return 0;
+}
+} // lua
@@ -0,0 +1,196 @@
+#ifndef STREN_LUA_FROZEN_TABLE_H
+#define STREN_LUA_FROZEN_TABLE_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+class Stack;
+class Table;
+///
+/// class FrozenTable
+///
+/// Immutable copy of a lua table and all its subtables which does not belong to any lua virtual machine.
+/// Data lives in flat arrays and a string pool. Hash parts are minimal perfect hash tables built with hash and
+/// displace: keys are split into small buckets by hash, every bucket gets a displacement which puts its keys
+/// into free entries, so a lookup is one bucket read and one key compare. One frozen table can be shared by
+/// any amount of virtual machines, each of them sees it as a read-only userdata with __index, __len, __pairs
+/// and __call (iterator for lua 5.1):
+///     for key, value in items() do ... end
+/// Keys may be booleans, numbers and strings; values may also be tables. Functions and userdata are skipped.
+///
+class FrozenTable : public std::enable_shared_from_this<FrozenTable>
+{
+private:
+    ///
+    /// types of stored values
+    ///
+    enum class Type : uint8_t
+    {
+        Nil,
+        Bool,
+        Number,
+        String,
+        Table
+    };
+    ///
+    /// struct Slot
+    ///
+    struct Slot
+    {
+        Type     type;          ///< value type
+        uint8_t  boolean;       ///< boolean value
+        uint32_t index;         ///< string or table index
+        double   number;        ///< number value
+    };
+    ///
+    /// struct Entry
+    ///
+    struct Entry
+    {
+        Slot key;               ///< entry key, Nil - empty entry
+        Slot value;             ///< entry value
+    };
+    ///
+    /// struct Node
+    ///
+    struct Node
+    {
+        uint32_t arrayBegin;    ///< first element of the array part in m_array
+        uint32_t arraySize;     ///< size of the array part
+        uint32_t hashBegin;     ///< first entry of the hash part in m_hash
+        uint32_t hashCapacity;  ///< amount of entries in the hash part
+        uint32_t hashCount;     ///< amount of used entries in the hash part
+        uint32_t bucketBegin;   ///< first displacement of the node in m_buckets
+        uint32_t bucketCount;   ///< amount of buckets, 0 - keys with equal hashes, hash part uses linear probing
+        uint32_t seed;          ///< hash seed of the node
+    };
+    ///
+    /// struct StringRef
+    ///
+    struct StringRef
+    {
+        uint32_t offset;        ///< offset in m_chars
+        uint32_t length;        ///< string length
+    };
+    ///
+    /// struct View
+    ///
+    struct View
+    {
+        std::shared_ptr<const FrozenTable> data;    ///< shared data
+        uint32_t                           node;    ///< viewed table
+    };
+
+    class Builder;
+
+    std::vector<Node>      m_nodes;     ///< all tables, the first one is the root
+    std::vector<Slot>      m_array;     ///< array parts of all tables
+    std::vector<Entry>     m_hash;      ///< hash parts of all tables
+    std::vector<uint32_t>  m_buckets;   ///< bucket displacements of all hash parts
+    std::vector<StringRef> m_strings;   ///< string pool index
+    std::string            m_chars;     ///< string pool data
+public:
+    ///
+    /// freeze lua table and everything reachable from it
+    ///
+    static std::shared_ptr<const FrozenTable> freeze(const Table & table);
+    ///
+    /// push read-only view of the frozen table to the stack
+    ///
+    void push(Stack & stack) const;
+    ///
+    /// push read-only view of the frozen subtable to the stack of any lua state
+    ///
+    void push(lua_State * state, const uint32_t node) const;
+    ///
+    /// get frozen data and subtable behind the view at index, returns false if value is not a frozen table
+    ///
+    static bool toFrozen(lua_State * state, const int index, std::shared_ptr<const FrozenTable> & data, uint32_t & node);
+    ///
+    /// make read-only view of the frozen table global
+    ///
+    void makeGlobal(const char * name) const;
+    ///
+    /// get amount of frozen tables
+    ///
+    inline size_t getTablesCount() const { return m_nodes.size(); }
+    ///
+    /// get memory used by frozen data in bytes
+    ///
+    size_t getMemorySize() const;
+private:
+    ///
+    /// hash key without seed
+    ///
+    static uint64_t hash(const double number, const char * str, const size_t length);
+    ///
+    /// hash stored key without seed
+    ///
+    uint64_t hash(const Slot & key) const;
+    ///
+    /// mix seed into key hash
+    ///
+    static uint64_t mix(const uint64_t hash, const uint32_t seed);
+    ///
+    /// get position of the key in the hash part, first probe if hash part is not perfect
+    ///
+    uint32_t locate(const Node & node, const uint64_t keyHash) const;
+    ///
+    /// compare stored key with lua key at index
+    ///
+    bool isEqual(const Slot & key, lua_State * state, const int index) const;
+    ///
+    /// find value by lua key at index, returns nullptr if there is no such key
+    ///
+    const Slot * find(const Node & node, lua_State * state, const int index) const;
+    ///
+    /// find hash entry by lua key at index, returns nullptr if there is no such key
+    ///
+    const Entry * findEntry(const Node & node, lua_State * state, const int index) const;
+    ///
+    /// push stored slot, tables are pushed as views cached in the environment of the parent view at "parent"
+    ///
+    void pushSlot(lua_State * state, const Slot & slot, const int parent, const int key) const;
+    ///
+    /// push view of the table node
+    ///
+    void pushView(lua_State * state, const uint32_t node) const;
+    ///
+    /// push metatable shared by all views
+    ///
+    static void pushMetatable(lua_State * state);
+    ///
+    /// lua: view[key]
+    ///
+    static int luaIndex(lua_State * state);
+    ///
+    /// lua: #view
+    ///
+    static int luaLen(lua_State * state);
+    ///
+    /// lua: next(view, key)
+    ///
+    static int luaNext(lua_State * state);
+    ///
+    /// lua: pairs(view) and view()
+    ///
+    static int luaPairs(lua_State * state);
+    ///
+    /// lua: view[key] = value
+    ///
+    static int luaNewIndex(lua_State * state);
+    ///
+    /// destroy view
+    ///
+    static int luaGc(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_FROZEN_TABLE_H
@@ -1,6 +1,7 @@
 #include "lua_function.h"
 
 #include "lua_wrapper.h"
+#include "lua_memory_profiler.h"
 #include "utils.h"
 
 namespace lua
@@ -51,13 +52,23 @@ Function::Function(Function && func)
 Function & Function::operator=(const Function & func)
 {
     Stack stack;
-    stack.deleteReference(m_reference);
+    if (!ReleaseQueue::defer(m_reference))
+    {
+        stack.deleteReference(m_reference);
+    }
     m_reference = stack.copyReference(func.m_reference);
     return *this;
 }
 
 Function & Function ::operator=(Function && func)
 {
+    if (this == &func) return *this;
+
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
     m_reference = func.m_reference;
     func.m_reference = LUA_NOREF;
     return *this;
@@ -65,7 +76,7 @@ Function & Function ::operator=(Function && func)
 
 Function::~Function()
 {
-    if (m_reference != LUA_NOREF)
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
     {
         Stack stack;
         stack.deleteReference(m_reference);
@@ -74,8 +85,32 @@ Function::~Function()
 
 bool Function::call(const std::vector<Value> & params, std::vector<Value> & results)
 {
+    MemoryProfiler::Scope scope("Function::call");
+    Stack stack;
+    return stack.callFunction(m_reference, params, results);
+}
+
+bool Function::call(const std::vector<Value> & params, std::vector<Value> & results, const Budget & budget)
+{
+    MemoryProfiler::Scope scope("Function::call");
+    Stack stack;
+    return stack.callFunction(m_reference, params, results, budget);
+}
+
+bool Function::call(const std::vector<Value> & params, ValueBuffer & results)
+{
+    MemoryProfiler::Scope scope("Function::call");
     Stack stack;
     return stack.callFunction(m_reference, params, results);
 }
 
+void Function::reportBatchErrors(const size_t failed, const size_t total, const std::string & error)
+{
+    if (failed > 0)
+    {
+        const std::string message = "[lua] " + std::to_string(failed) + " of " + std::to_string(total) + " batched calls failed: " + error;
+        stren::assertMessage(false, message.c_str());
+    }
+}
+
 } // lua
\ No newline at end of file
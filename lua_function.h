@@ -2,8 +2,16 @@
 #define STREN_LUA_FUNCTION_H
 
 #include <vector>
+#include <iterator>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include "lua_ext.h"
+#include "lua_stack.h"
+#include "lua_value.h"
+#include "lua_memory_profiler.h"
 
 #include "string_ext.h"
 
@@ -11,6 +19,8 @@ namespace lua
 {
 class Value;
 class Stack;
+class Budget;
+class ValueBuffer;
 ///
 /// class Function
 ///
@@ -18,6 +28,14 @@ class Function
 {
 
 public:
+    ///
+    /// what to do when one of the batched calls fails
+    ///
+    enum class ErrorPolicy
+    {
+        Stop,           ///< stop the batch on the first error
+        Skip            ///< write nil result and continue
+    };
     static const std::vector<Value> kEmptyParams;       ///< @todo
 private:
     static std::vector<Value> KEmptyResults;            ///< @todo
@@ -64,10 +82,225 @@ public:
     ///
     ~Function();
     ///
+    /// get reference of the function
+    ///
+    inline int getRef() const { return m_reference; }
+    ///
     /// call lua function with the given parameters and a vector for the results
     ///
     bool call(const std::vector<Value> & params = kEmptyParams, std::vector<Value> & results = KEmptyResults);
+    ///
+    /// call lua function within the execution budget, returns false if budget aborted the call
+    ///
+    bool call(const std::vector<Value> & params, std::vector<Value> & results, const Budget & budget);
+    ///
+    /// call lua function and store all its results in order, reuse the buffer between calls to avoid allocations
+    ///
+    bool call(const std::vector<Value> & params, ValueBuffer & results);
+    ///
+    /// call lua function once per element of the range and write the first result of every call to the output
+    /// converted to the output value type, element is either a single argument or a tuple of arguments;
+    /// returns amount of successful calls; errors receives messages of failed calls, without it failures assert
+    ///
+    template <typename Range, typename OutputIt>
+    size_t callMany(const Range & argsList, OutputIt out, const ErrorPolicy policy = ErrorPolicy::Stop, std::vector<std::string> * errors = nullptr);
+    ///
+    /// call lua function count times with i-th elements of the columns as arguments and write the first result
+    /// of every call to the output; returns amount of successful calls, failures assert
+    ///
+    template <typename OutputIt, typename... Columns>
+    size_t callColumns(const size_t count, OutputIt out, const ErrorPolicy policy, const Columns &... columns);
+    ///
+    /// call lua function count times with i-th elements of the columns as arguments and write the first result
+    /// of every call to the output; returns amount of successful calls, errors receives messages of failed calls
+    ///
+    template <typename OutputIt, typename... Columns>
+    size_t callColumns(const size_t count, OutputIt out, const ErrorPolicy policy, std::vector<std::string> * errors, const Columns &... columns);
+private:
+    ///
+    /// push single argument
+    ///
+    template <typename T>
+    static int pushArgs(Stack & stack, const T & arg);
+    ///
+    /// push arguments from tuple
+    ///
+    template <typename... Args>
+    static int pushArgs(Stack & stack, const std::tuple<Args...> & args);
+    ///
+    /// push arguments from pair
+    ///
+    template <typename First, typename Second>
+    static int pushArgs(Stack & stack, const std::pair<First, Second> & args);
+    ///
+    /// write top of the stack to the output converted to its value type, nil on failure
+    ///
+    template <typename OutputIt>
+    static void writeResult(Stack & stack, OutputIt & out, const bool isSucceeded);
+    ///
+    /// report errors of the batch once
+    ///
+    static void reportBatchErrors(const size_t failed, const size_t total, const std::string & error);
 };
+
+template <typename T>
+int Function::pushArgs(Stack & stack, const T & arg)
+{
+    stack.push(arg);
+    return 1;
+}
+
+template <typename... Args>
+int Function::pushArgs(Stack & stack, const std::tuple<Args...> & args)
+{
+    std::apply([&stack](const Args &... arg) { (stack.push(arg), ...); }, args);
+    return static_cast<int>(sizeof...(Args));
+}
+
+template <typename First, typename Second>
+int Function::pushArgs(Stack & stack, const std::pair<First, Second> & args)
+{
+    stack.push(args.first);
+    stack.push(args.second);
+    return 2;
+}
+
+///
+/// value type written by output iterator, insert iterators use value type of their container
+///
+template <typename OutputIt, typename = void>
+struct OutputValue
+{
+    typedef typename std::iterator_traits<OutputIt>::value_type type;
+};
+
+template <typename OutputIt>
+struct OutputValue<OutputIt, std::void_t<typename OutputIt::container_type>>
+{
+    typedef typename OutputIt::container_type::value_type type;
+};
+
+template <typename OutputIt>
+void Function::writeResult(Stack & stack, OutputIt & out, const bool isSucceeded)
+{
+    typedef typename OutputValue<OutputIt>::type Result;
+    if constexpr (std::is_void<Result>::value || std::is_same<Result, Value>::value)
+    {
+        *out = isSucceeded ? stack.get(-1) : Value();
+    }
+    else
+    {
+        Result result = Result();
+        if (isSucceeded)
+        {
+            stack.read(-1, result);
+        }
+        *out = result;
+    }
+}
+
+template <typename Range, typename OutputIt>
+size_t Function::callMany(const Range & argsList, OutputIt out, const ErrorPolicy policy, std::vector<std::string> * errors)
+{
+    MemoryProfiler::Scope scope("Function::callMany");
+    Stack stack;
+    if (!stack.pushFunction(m_reference)) return 0;
+
+    // function stays on the stack, every call uses its copy
+    const int functionIndex = stack.getSize();
+    size_t succeeded = 0;
+    size_t failed = 0;
+    std::string error;
+    std::string callError;
+    for (const auto & args : argsList)
+    {
+        stack.pushCopy(functionIndex);
+        const int paramsCount = pushArgs(stack, args);
+        if (stack.call(paramsCount, 1, &callError))
+        {
+            writeResult(stack, out, true);
+            stack.pop(1);
+            ++succeeded;
+        }
+        else
+        {
+            if (errors)
+            {
+                errors->push_back(std::move(callError));
+            }
+            else if (0 == failed)
+            {
+                error.swap(callError);
+            }
+            ++failed;
+            callError.clear();
+            if (ErrorPolicy::Stop == policy) break;
+            writeResult(stack, out, false);
+        }
+        ++out;
+    }
+    stack.pop(1);
+
+    if (!errors)
+    {
+        reportBatchErrors(failed, succeeded + failed, error);
+    }
+    return succeeded;
+}
+
+template <typename OutputIt, typename... Columns>
+size_t Function::callColumns(const size_t count, OutputIt out, const ErrorPolicy policy, const Columns &... columns)
+{
+    return callColumns(count, out, policy, static_cast<std::vector<std::string> *>(nullptr), columns...);
+}
+
+template <typename OutputIt, typename... Columns>
+size_t Function::callColumns(const size_t count, OutputIt out, const ErrorPolicy policy, std::vector<std::string> * errors, const Columns &... columns)
+{
+    MemoryProfiler::Scope scope("Function::callColumns");
+    Stack stack;
+    if (!stack.pushFunction(m_reference)) return 0;
+
+    const int functionIndex = stack.getSize();
+    size_t succeeded = 0;
+    size_t failed = 0;
+    std::string error;
+    std::string callError;
+    for (size_t i = 0; i < count; ++i)
+    {
+        stack.pushCopy(functionIndex);
+        (stack.push(columns[i]), ...);
+        if (stack.call(static_cast<int>(sizeof...(Columns)), 1, &callError))
+        {
+            writeResult(stack, out, true);
+            stack.pop(1);
+            ++succeeded;
+        }
+        else
+        {
+            if (errors)
+            {
+                errors->push_back(std::move(callError));
+            }
+            else if (0 == failed)
+            {
+                error.swap(callError);
+            }
+            ++failed;
+            callError.clear();
+            if (ErrorPolicy::Stop == policy) break;
+            writeResult(stack, out, false);
+        }
+        ++out;
+    }
+    stack.pop(1);
+
+    if (!errors)
+    {
+        reportBatchErrors(failed, succeeded + failed, error);
+    }
+    return succeeded;
+}
 } // lua
 
 #endif // STREN_LUA_FUNCTION_H
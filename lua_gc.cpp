@@ -0,0 +1,186 @@
+#include "lua_gc.h"
+#include "lua_stack.h"
+
+#include <cstring>
+
+namespace lua
+{
+const int64_t GarbageCollector::kHistogramBounds[GarbageCollector::kHistogramSize] = { 50, 100, 250, 500, 1000, 2000, 5000, INT64_MAX };
+
+namespace
+{
+int64_t toMicroseconds(const std::chrono::steady_clock::duration & duration)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+} // namespace
+
+GarbageCollector::GarbageCollector(const int64_t budget)
+    : m_budget(budget)
+    , m_maxBudget(budget * 4)
+    , m_stepSize(0)
+    , m_allocationRateLimit(0)
+    , m_memoryLimit(0)
+    , m_lastMemory(0)
+    , m_allocationRate(0.0)
+    , m_isManual(false)
+    , m_lastUpdate(Clock::now())
+{
+    resetStats();
+
+    Stack stack;
+    m_lastMemory = stack.getAllocatedBytes();
+}
+
+void GarbageCollector::setBudget(const int64_t budget)
+{
+    m_budget = budget;
+}
+
+void GarbageCollector::setMaxBudget(const int64_t maxBudget)
+{
+    m_maxBudget = maxBudget;
+}
+
+void GarbageCollector::setStepSize(const int stepSize)
+{
+    m_stepSize = stepSize;
+}
+
+void GarbageCollector::setPause(const int pause)
+{
+    Stack stack;
+    stack.setGarbagePause(pause);
+}
+
+void GarbageCollector::setStepMultiplier(const int stepMultiplier)
+{
+    Stack stack;
+    stack.setGarbageStepMultiplier(stepMultiplier);
+}
+
+void GarbageCollector::setAllocationRateLimit(const size_t bytesPerSecond)
+{
+    m_allocationRateLimit = bytesPerSecond;
+}
+
+void GarbageCollector::setMemoryLimit(const size_t bytes)
+{
+    m_memoryLimit = bytes;
+}
+
+void GarbageCollector::setManual(const bool isManual)
+{
+    m_isManual = isManual;
+
+    Stack stack;
+    if (m_isManual)
+    {
+        stack.stopGarbageCollector();
+    }
+    else
+    {
+        stack.restartGarbageCollector();
+    }
+}
+
+bool GarbageCollector::update()
+{
+    const Clock::time_point start = Clock::now();
+
+    Stack stack;
+    const size_t memory = stack.getAllocatedBytes();
+    const double elapsed = std::chrono::duration<double>(start - m_lastUpdate).count();
+    m_allocationRate = (elapsed > 0.0 && memory > m_lastMemory) ? (memory - m_lastMemory) / elapsed : 0.0;
+    m_lastUpdate = start;
+
+    bool isCycleFinished = false;
+    if (m_memoryLimit > 0 && memory > m_memoryLimit)
+    {
+        collect();
+        isCycleFinished = true;
+    }
+    else
+    {
+        const bool isUnderPressure = m_allocationRateLimit > 0 && m_allocationRate > m_allocationRateLimit;
+        const int64_t budget = isUnderPressure ? m_maxBudget : m_budget;
+
+        Clock::time_point stepStart = start;
+        do
+        {
+            isCycleFinished = stack.stepGarbage(m_stepSize);
+            const Clock::time_point stepEnd = Clock::now();
+            const int64_t stepTime = toMicroseconds(stepEnd - stepStart);
+            stepStart = stepEnd;
+
+            ++m_stats.steps;
+            m_stats.totalStepTime += stepTime;
+            if (stepTime > m_stats.maxStepTime)
+            {
+                m_stats.maxStepTime = stepTime;
+            }
+        }
+        while (!isCycleFinished && toMicroseconds(stepStart - start) < budget);
+
+        if (isCycleFinished)
+        {
+            ++m_stats.cycles;
+        }
+        // LUA_GCSTEP re-arms the collector threshold, so stop it again
+        if (m_isManual)
+        {
+            stack.stopGarbageCollector();
+        }
+    }
+
+    const int64_t updateTime = toMicroseconds(Clock::now() - start);
+    m_stats.lastUpdateTime = updateTime;
+    if (updateTime > m_stats.maxUpdateTime)
+    {
+        m_stats.maxUpdateTime = updateTime;
+    }
+    addToHistogram(updateTime);
+
+    m_lastMemory = stack.getAllocatedBytes();
+    return isCycleFinished;
+}
+
+void GarbageCollector::collect()
+{
+    const Clock::time_point start = Clock::now();
+
+    Stack stack;
+    stack.collectGarbage();
+    if (m_isManual)
+    {
+        stack.stopGarbageCollector();
+    }
+
+    const int64_t time = toMicroseconds(Clock::now() - start);
+    ++m_stats.fullCollections;
+    m_stats.totalFullCollectionTime += time;
+    if (time > m_stats.maxFullCollectionTime)
+    {
+        m_stats.maxFullCollectionTime = time;
+    }
+    m_lastMemory = stack.getAllocatedBytes();
+}
+
+void GarbageCollector::resetStats()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void GarbageCollector::addToHistogram(const int64_t time)
+{
+    for (size_t i = 0; i < kHistogramSize; ++i)
+    {
+        if (time < kHistogramBounds[i])
+        {
+            ++m_stats.histogram[i];
+            return;
+        }
+    }
+    ++m_stats.histogram[kHistogramSize - 1];
+}
+} // lua
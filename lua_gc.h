@@ -0,0 +1,119 @@
+#ifndef STREN_LUA_GC_H
+#define STREN_LUA_GC_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace lua
+{
+///
+/// class GarbageCollector
+///
+/// Spreads the cost of lua garbage collection over frames: every update() runs LUA_GCSTEP slices
+/// until the time budget is spent, and records how long every slice took.
+///
+class GarbageCollector
+{
+public:
+    static const size_t kHistogramSize = 8;                 ///< amount of buckets in the pause histogram
+    static const int64_t kHistogramBounds[kHistogramSize];  ///< upper bounds of the buckets in microseconds
+    ///
+    /// struct Stats
+    ///
+    struct Stats
+    {
+        size_t  steps;                          ///< amount of performed LUA_GCSTEP slices
+        size_t  cycles;                         ///< amount of finished collection cycles
+        size_t  fullCollections;                ///< amount of forced full collections
+        int64_t totalStepTime;                  ///< time spent in slices in microseconds
+        int64_t maxStepTime;                    ///< the longest slice in microseconds
+        int64_t lastUpdateTime;                 ///< time spent in the last update in microseconds
+        int64_t maxUpdateTime;                  ///< the longest update in microseconds
+        int64_t totalFullCollectionTime;        ///< time spent in full collections in microseconds
+        int64_t maxFullCollectionTime;          ///< the longest full collection in microseconds
+        size_t  histogram[kHistogramSize];      ///< update pauses split by kHistogramBounds
+    };
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    int64_t           m_budget;                 ///< time budget for a single update in microseconds
+    int64_t           m_maxBudget;              ///< time budget for a single update under allocation pressure
+    int               m_stepSize;               ///< LUA_GCSTEP argument in kilobytes
+    size_t            m_allocationRateLimit;    ///< bytes per second which turn on m_maxBudget, 0 - disabled
+    size_t            m_memoryLimit;            ///< bytes which force a full collection, 0 - disabled
+    size_t            m_lastMemory;             ///< allocated bytes after the previous update
+    double            m_allocationRate;         ///< bytes per second between the last two updates
+    bool              m_isManual;               ///< true if automatic collection is stopped
+    Clock::time_point m_lastUpdate;             ///< time of the previous update
+    Stats             m_stats;                  ///< collected telemetry
+public:
+    ///
+    /// Constructor
+    ///
+    GarbageCollector(const int64_t budget = 1000);
+    ///
+    /// set time budget of a single update in microseconds
+    ///
+    void setBudget(const int64_t budget);
+    ///
+    /// set time budget used when allocation rate exceeds the limit
+    ///
+    void setMaxBudget(const int64_t maxBudget);
+    ///
+    /// set size of a single LUA_GCSTEP slice in kilobytes
+    ///
+    void setStepSize(const int stepSize);
+    ///
+    /// set garbage collector pause of the lua virtual machine in percents
+    ///
+    void setPause(const int pause);
+    ///
+    /// set garbage collector step multiplier of the lua virtual machine in percents
+    ///
+    void setStepMultiplier(const int stepMultiplier);
+    ///
+    /// set allocation rate in bytes per second which switches update to the max budget, 0 - disabled
+    ///
+    void setAllocationRateLimit(const size_t bytesPerSecond);
+    ///
+    /// set amount of allocated bytes which forces a full collection, 0 - disabled
+    ///
+    void setMemoryLimit(const size_t bytes);
+    ///
+    /// stop automatic collection so garbage is collected by update() only
+    ///
+    void setManual(const bool isManual);
+    ///
+    /// check if automatic collection is stopped
+    ///
+    inline bool isManual() const { return m_isManual; }
+    ///
+    /// run collection slices until the time budget is spent, returns true if a cycle was finished
+    ///
+    bool update();
+    ///
+    /// run full collection and record its duration
+    ///
+    void collect();
+    ///
+    /// get allocation rate in bytes per second measured by the last update
+    ///
+    inline double getAllocationRate() const { return m_allocationRate; }
+    ///
+    /// get collected telemetry
+    ///
+    inline const Stats & getStats() const { return m_stats; }
+    ///
+    /// reset collected telemetry
+    ///
+    void resetStats();
+private:
+    ///
+    /// put update pause into histogram
+    ///
+    void addToHistogram(const int64_t time);
+};
+} // lua
+
+#endif // STREN_LUA_GC_H
@@ -0,0 +1,711 @@
+#include "lua_json.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+#include "lua_value.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace lua
+{
+namespace
+{
+inline bool isSpace(const char c)
+{
+    return ' ' == c || '\n' == c || '\r' == c || '\t' == c;
+}
+
+inline bool isNumberChar(const char c)
+{
+    return (c >= '0' && c <= '9') || '-' == c || '+' == c || '.' == c || 'e' == c || 'E' == c;
+}
+
+bool readHex(const char * data, const size_t size, unsigned & code)
+{
+    if (size < 4) return false;
+
+    code = 0;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        const char c = data[i];
+        code <<= 4;
+        if (c >= '0' && c <= '9') code |= c - '0';
+        else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+        else return false;
+    }
+    return true;
+}
+
+void appendUtf8(std::string & out, const unsigned code)
+{
+    if (code < 0x80)
+    {
+        out += (char)code;
+    }
+    else if (code < 0x800)
+    {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else if (code < 0x10000)
+    {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        out += (char)(0xF0 | (code >> 18));
+        out += (char)(0x80 | ((code >> 12) & 0x3F));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+    }
+}
+
+size_t formatNumber(const double number, char * buffer, const size_t size)
+{
+    const int length = (number == std::floor(number) && std::fabs(number) < 1e15)
+        ? snprintf(buffer, size, "%lld", (long long)number)
+        : snprintf(buffer, size, "%.17g", number);
+    return length > 0 ? (size_t)length : 0;
+}
+} // anonymous
+
+JsonDecoder::JsonDecoder()
+    : m_state(State::Value)
+    , m_status(DecodeStatus::NeedMore)
+    , m_scanned(0)
+    , m_isEscaped(false)
+    , m_offset(0)
+{
+}
+
+void JsonDecoder::reset()
+{
+    m_builder.reset();
+    m_state = State::Value;
+    m_status = DecodeStatus::NeedMore;
+    m_pending.clear();
+    m_error.clear();
+    m_offset = 0;
+    m_scanned = 0;
+    m_isEscaped = false;
+}
+
+DecodeStatus JsonDecoder::feed(const char * data, const size_t size)
+{
+    if (DecodeStatus::NeedMore != m_status) return m_status;
+
+    size_t taken = 0;
+    if (!m_pending.empty())
+    {
+        // complete only the unfinished token, the rest of the chunk is parsed in place
+        taken = findTokenEnd(data, size);
+        if (std::string::npos == taken)
+        {
+            m_pending.append(data, size);
+            return m_status;
+        }
+        m_pending.append(data, taken);
+        const size_t used = parse(m_pending.data(), m_pending.size(), false);
+        m_offset += used;
+        if (DecodeStatus::NeedMore == m_status && used < m_pending.size())
+        {
+            // terminator started another token, only happens on malformed input
+            m_pending.erase(0, used);
+            m_pending.append(data + taken, size - taken);
+            const size_t tailUsed = parse(m_pending.data(), m_pending.size(), false);
+            m_offset += tailUsed;
+            m_pending.erase(0, tailUsed);
+            m_scanned = 0;
+            m_isEscaped = false;
+            return m_status;
+        }
+        m_pending.clear();
+    }
+
+    const size_t used = parse(data + taken, size - taken, false);
+    m_offset += used;
+    if (DecodeStatus::NeedMore == m_status)
+    {
+        m_pending.assign(data + taken + used, size - taken - used);
+        m_scanned = 0;
+        m_isEscaped = false;
+    }
+    return m_status;
+}
+
+size_t JsonDecoder::findTokenEnd(const char * data, const size_t size)
+{
+    if ('"' != m_pending[0])
+    {
+        // number or literal ends at the first character which can't continue it
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (!isNumberChar(data[i]) && !(data[i] >= 'a' && data[i] <= 'z')) return i + 1;
+        }
+        return std::string::npos;
+    }
+
+    // string is scanned once, escape state is kept between feeds
+    if (0 == m_scanned)
+    {
+        m_scanned = 1;
+    }
+    for (; m_scanned < m_pending.size(); ++m_scanned)
+    {
+        m_isEscaped = !m_isEscaped && '\\' == m_pending[m_scanned];
+    }
+    for (size_t i = 0; i < size; ++i)
+    {
+        if (m_isEscaped)
+        {
+            m_isEscaped = false;
+        }
+        else if ('\\' == data[i])
+        {
+            m_isEscaped = true;
+        }
+        else if ('"' == data[i])
+        {
+            return i + 1;
+        }
+    }
+    m_scanned += size;
+    return std::string::npos;
+}
+
+DecodeStatus JsonDecoder::finish()
+{
+    if (DecodeStatus::NeedMore == m_status)
+    {
+        const size_t used = parse(m_pending.data(), m_pending.size(), true);
+        if (DecodeStatus::NeedMore == m_status)
+        {
+            fail("unexpected end of document", used);
+        }
+        m_offset += used;
+        m_pending.clear();
+    }
+    return m_status;
+}
+
+bool JsonDecoder::getResult(Table & table)
+{
+    return DecodeStatus::Done == m_status && m_builder.getResult(table);
+}
+
+Value JsonDecoder::getResult()
+{
+    return DecodeStatus::Done == m_status ? m_builder.getResult() : Value();
+}
+
+bool JsonDecoder::decode(const char * data, const size_t size, Table & table, std::string * error)
+{
+    JsonDecoder decoder;
+    decoder.feed(data, size);
+    decoder.finish();
+    if (decoder.getResult(table)) return true;
+
+    if (error)
+    {
+        *error = DecodeStatus::Done == decoder.getStatus() ? "root is not an object or array" : decoder.getError();
+    }
+    return false;
+}
+
+size_t JsonDecoder::parse(const char * data, const size_t size, const bool isFinal)
+{
+    size_t pos = 0;
+    while (DecodeStatus::NeedMore == m_status)
+    {
+        while (pos < size && isSpace(data[pos])) ++pos;
+        if (pos == size) break;
+
+        const char c = data[pos];
+        switch (m_state)
+        {
+        case State::ValueOrEnd:
+            if (']' == c)
+            {
+                ++pos;
+                completeContainer();
+                break;
+            }
+            // fall through
+        case State::Value:
+            if (!parseValue(data, size, pos, isFinal)) return pos;
+            break;
+        case State::KeyOrEnd:
+            if ('}' == c)
+            {
+                ++pos;
+                completeContainer();
+                break;
+            }
+            // fall through
+        case State::Key:
+            if ('"' != c)
+            {
+                fail("expected string key", pos);
+                break;
+            }
+            if (!parseString(data, size, pos, isFinal)) return pos;
+            if (DecodeStatus::NeedMore != m_status) break;
+            m_builder.addValue();
+            m_state = State::Colon;
+            break;
+        case State::Colon:
+            if (':' != c)
+            {
+                fail("expected ':'", pos);
+                break;
+            }
+            ++pos;
+            m_state = State::Value;
+            break;
+        case State::CommaOrEnd:
+            if (',' == c)
+            {
+                ++pos;
+                m_state = m_builder.isInArray() ? State::Value : State::Key;
+            }
+            else if ((']' == c && m_builder.isInArray()) || ('}' == c && m_builder.isInMap()))
+            {
+                ++pos;
+                completeContainer();
+            }
+            else
+            {
+                fail("expected ',' or end of container", pos);
+            }
+            break;
+        case State::Done:
+            fail("unexpected data after document", pos);
+            break;
+        }
+    }
+    return pos;
+}
+
+bool JsonDecoder::parseValue(const char * data, const size_t size, size_t & pos, const bool isFinal)
+{
+    const char c = data[pos];
+    if ('{' == c || '[' == c)
+    {
+        if (m_builder.getDepth() >= kMaxDepth)
+        {
+            fail("document is too deep", pos);
+            return true;
+        }
+        ++pos;
+        if ('{' == c)
+        {
+            m_builder.beginMap(0);
+            m_state = State::KeyOrEnd;
+        }
+        else
+        {
+            m_builder.beginArray(0);
+            m_state = State::ValueOrEnd;
+        }
+        return true;
+    }
+    if ('"' == c)
+    {
+        if (!parseString(data, size, pos, isFinal)) return false;
+        if (DecodeStatus::NeedMore == m_status)
+        {
+            completeValue();
+        }
+        return true;
+    }
+    if ('t' == c || 'f' == c || 'n' == c)
+    {
+        return parseLiteral(data, size, pos, isFinal);
+    }
+    if ('-' == c || (c >= '0' && c <= '9'))
+    {
+        return parseNumber(data, size, pos, isFinal);
+    }
+
+    fail("unexpected character", pos);
+    return true;
+}
+
+bool JsonDecoder::parseString(const char * data, const size_t size, size_t & pos, const bool isFinal)
+{
+    size_t end = pos + 1;
+    bool hasEscapes = false;
+    while (end < size && '"' != data[end])
+    {
+        if ('\\' == data[end])
+        {
+            hasEscapes = true;
+            ++end;
+        }
+        ++end;
+    }
+    if (end >= size)
+    {
+        if (isFinal)
+        {
+            fail("unterminated string", pos);
+        }
+        return isFinal;
+    }
+
+    lua_State * state = m_builder.getState();
+    if (!hasEscapes)
+    {
+        lua_pushlstring(state, data + pos + 1, end - pos - 1);
+        pos = end + 1;
+        return true;
+    }
+
+    m_scratch.clear();
+    for (size_t i = pos + 1; i < end; ++i)
+    {
+        char c = data[i];
+        if ('\\' != c)
+        {
+            m_scratch += c;
+            continue;
+        }
+
+        c = data[++i];
+        switch (c)
+        {
+        case '"':
+        case '\\':
+        case '/':
+            m_scratch += c;
+            break;
+        case 'b': m_scratch += '\b'; break;
+        case 'f': m_scratch += '\f'; break;
+        case 'n': m_scratch += '\n'; break;
+        case 'r': m_scratch += '\r'; break;
+        case 't': m_scratch += '\t'; break;
+        case 'u':
+        {
+            unsigned code = 0;
+            if (!readHex(data + i + 1, end - i - 1, code))
+            {
+                fail("invalid unicode escape", i);
+                return true;
+            }
+            i += 4;
+
+            unsigned low = 0;
+            if (code >= 0xD800 && code <= 0xDBFF && i + 2 < end && '\\' == data[i + 1] && 'u' == data[i + 2] &&
+                readHex(data + i + 3, end - i - 3, low) && low >= 0xDC00 && low <= 0xDFFF)
+            {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                i += 6;
+            }
+            appendUtf8(m_scratch, code);
+            break;
+        }
+        default:
+            fail("invalid escape", i);
+            return true;
+        }
+    }
+
+    lua_pushlstring(state, m_scratch.data(), m_scratch.size());
+    pos = end + 1;
+    return true;
+}
+
+bool JsonDecoder::parseNumber(const char * data, const size_t size, size_t & pos, const bool isFinal)
+{
+    size_t end = pos;
+    while (end < size && isNumberChar(data[end])) ++end;
+    if (end == size && !isFinal) return false;
+
+    char buffer[64];
+    const size_t length = end - pos;
+    if (length >= sizeof(buffer))
+    {
+        fail("number is too long", pos);
+        return true;
+    }
+    memcpy(buffer, data + pos, length);
+    buffer[length] = '\0';
+
+    char * last = nullptr;
+    const double number = strtod(buffer, &last);
+    if (last != buffer + length)
+    {
+        fail("invalid number", pos);
+        return true;
+    }
+
+    lua_pushnumber(m_builder.getState(), number);
+    pos = end;
+    completeValue();
+    return true;
+}
+
+bool JsonDecoder::parseLiteral(const char * data, const size_t size, size_t & pos, const bool isFinal)
+{
+    const char c = data[pos];
+    const char * literal = 't' == c ? "true" : ('f' == c ? "false" : "null");
+    const size_t length = strlen(literal);
+    const size_t available = size - pos;
+
+    if (0 != memcmp(data + pos, literal, available < length ? available : length))
+    {
+        fail("invalid literal", pos);
+        return true;
+    }
+    if (available < length)
+    {
+        if (isFinal)
+        {
+            fail("unexpected end of document", pos);
+        }
+        return isFinal;
+    }
+
+    lua_State * state = m_builder.getState();
+    if ('n' == c)
+    {
+        lua_pushnil(state);
+    }
+    else
+    {
+        lua_pushboolean(state, 't' == c);
+    }
+    pos += length;
+    completeValue();
+    return true;
+}
+
+void JsonDecoder::completeValue()
+{
+    m_builder.addValue();
+    if (m_builder.isDone())
+    {
+        m_state = State::Done;
+        m_status = DecodeStatus::Done;
+    }
+    else
+    {
+        m_state = State::CommaOrEnd;
+    }
+}
+
+void JsonDecoder::completeContainer()
+{
+    m_builder.endContainer();
+    if (m_builder.isDone())
+    {
+        m_state = State::Done;
+        m_status = DecodeStatus::Done;
+    }
+    else
+    {
+        m_state = State::CommaOrEnd;
+    }
+}
+
+void JsonDecoder::fail(const char * message, const size_t pos)
+{
+    m_status = DecodeStatus::Error;
+    m_error = std::string("[json] ") + message + " at byte " + std::to_string(m_offset + pos);
+    m_builder.reset();
+}
+
+JsonEncoder::JsonEncoder(const Sink & sink, const size_t bufferSize)
+    : m_sink(sink)
+    , m_bufferSize(bufferSize)
+{
+    m_buffer.reserve(bufferSize);
+}
+
+bool JsonEncoder::encode(const Table & table)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    lua_getref(state, table.getRef());
+    const bool isEncoded = write(state, lua_gettop(state), 0);
+    lua_pop(state, 1);
+    flush();
+    return isEncoded;
+}
+
+bool JsonEncoder::encode(const Table & table, std::string & out)
+{
+    JsonEncoder encoder([&out](const char * data, size_t size) { out.append(data, size); });
+    return encoder.encode(table);
+}
+
+bool JsonEncoder::write(lua_State * state, const int index, const int depth)
+{
+    switch (lua_type(state, index))
+    {
+    case LUA_TBOOLEAN:
+        if (lua_toboolean(state, index))
+        {
+            append("true", 4);
+        }
+        else
+        {
+            append("false", 5);
+        }
+        break;
+    case LUA_TNUMBER:
+        writeNumber(lua_tonumber(state, index));
+        break;
+    case LUA_TSTRING:
+    {
+        size_t length = 0;
+        const char * str = lua_tolstring(state, index, &length);
+        writeString(str, length);
+        break;
+    }
+    case LUA_TTABLE:
+        return writeTable(state, index, depth + 1);
+    default:
+        append("null", 4);
+        break;
+    }
+    return true;
+}
+
+bool JsonEncoder::writeTable(lua_State * state, const int index, const int depth)
+{
+    if (depth > kMaxDepth || !lua_checkstack(state, 3)) return false;
+
+    const size_t length = getSequenceLength(state, index);
+    if (length > 0)
+    {
+        append("[", 1);
+        for (size_t i = 1; i <= length; ++i)
+        {
+            if (i > 1)
+            {
+                append(",", 1);
+            }
+            lua_rawgeti(state, index, (int)i);
+            const bool isWritten = write(state, lua_gettop(state), depth);
+            lua_pop(state, 1);
+            if (!isWritten) return false;
+        }
+        append("]", 1);
+        return true;
+    }
+
+    append("{", 1);
+    bool isFirst = true;
+    lua_pushnil(state);
+    while (lua_next(state, index))
+    {
+        const int keyType = lua_type(state, -2);
+        if (LUA_TSTRING != keyType && LUA_TNUMBER != keyType)
+        {
+            lua_pop(state, 1);
+            continue;
+        }
+
+        if (!isFirst)
+        {
+            append(",", 1);
+        }
+        isFirst = false;
+
+        if (LUA_TSTRING == keyType)
+        {
+            size_t length = 0;
+            const char * str = lua_tolstring(state, -2, &length);
+            writeString(str, length);
+        }
+        else
+        {
+            // lua_tolstring would turn the key into a string and break lua_next
+            char buffer[32];
+            writeString(buffer, formatNumber(lua_tonumber(state, -2), buffer, sizeof(buffer)));
+        }
+        append(":", 1);
+
+        if (!write(state, lua_gettop(state), depth))
+        {
+            lua_pop(state, 2);
+            return false;
+        }
+        lua_pop(state, 1);
+    }
+    append("}", 1);
+    return true;
+}
+
+void JsonEncoder::writeNumber(const double number)
+{
+    if (number != number || std::isinf(number))
+    {
+        append("null", 4);
+        return;
+    }
+
+    char buffer[32];
+    append(buffer, formatNumber(number, buffer, sizeof(buffer)));
+}
+
+void JsonEncoder::writeString(const char * str, const size_t length)
+{
+    static const char * const kHex = "0123456789abcdef";
+
+    append("\"", 1);
+    size_t begin = 0;
+    for (size_t i = 0; i < length; ++i)
+    {
+        const unsigned char c = (unsigned char)str[i];
+        if (c >= 0x20 && '"' != c && '\\' != c) continue;
+
+        append(str + begin, i - begin);
+        begin = i + 1;
+        switch (c)
+        {
+        case '"': append("\\\"", 2); break;
+        case '\\': append("\\\\", 2); break;
+        case '\n': append("\\n", 2); break;
+        case '\r': append("\\r", 2); break;
+        case '\t': append("\\t", 2); break;
+        case '\b': append("\\b", 2); break;
+        case '\f': append("\\f", 2); break;
+        default:
+        {
+            const char escape[6] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF] };
+            append(escape, sizeof(escape));
+            break;
+        }
+        }
+    }
+    append(str + begin, length - begin);
+    append("\"", 1);
+}
+
+void JsonEncoder::append(const char * data, const size_t size)
+{
+    m_buffer.append(data, size);
+    if (m_buffer.size() >= m_bufferSize)
+    {
+        flush();
+    }
+}
+
+void JsonEncoder::flush()
+{
+    if (!m_buffer.empty())
+    {
+        m_sink(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+}
+} // lua
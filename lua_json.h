@@ -0,0 +1,191 @@
+#ifndef STREN_LUA_JSON_H
+#define STREN_LUA_JSON_H
+
+#include "lua_table_builder.h"
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+namespace lua
+{
+class Table;
+class Value;
+///
+/// class JsonDecoder
+///
+/// Incremental JSON parser which builds lua tables directly, without intermediate document tree.
+/// Input may be split at any byte, unfinished token is kept until the next feed:
+///     JsonDecoder decoder;
+///     while (decoder.feed(chunk, size) == DecodeStatus::NeedMore) { ... read next chunk ... }
+///     decoder.finish();
+///     decoder.getResult(table);
+/// null becomes nil, so it leaves holes in arrays and drops object members.
+///
+class JsonDecoder
+{
+private:
+    ///
+    /// what parser expects next
+    ///
+    enum class State
+    {
+        Value,          ///< any value
+        ValueOrEnd,     ///< value or ']' right after '['
+        KeyOrEnd,       ///< key or '}' right after '{'
+        Key,            ///< key after ','
+        Colon,          ///< ':' after key
+        CommaOrEnd,     ///< ',' or end of container after value
+        Done            ///< root value is complete
+    };
+
+    static const size_t kMaxDepth = 512;    ///< nesting limit
+
+    TableBuilder m_builder;     ///< tables under construction
+    State        m_state;       ///< parser state
+    DecodeStatus m_status;      ///< decoding progress
+    std::string  m_pending;     ///< unfinished token of the previous feed
+    size_t       m_scanned;     ///< amount of pending bytes already searched for the end of the token
+    bool         m_isEscaped;   ///< pending string ends inside an escape sequence
+    std::string  m_scratch;     ///< buffer for unescaped strings
+    std::string  m_error;       ///< error description
+    size_t       m_offset;      ///< amount of consumed bytes, used in error messages
+public:
+    ///
+    /// Constructor
+    ///
+    JsonDecoder();
+    ///
+    /// forget everything and start new document
+    ///
+    void reset();
+    ///
+    /// decode next chunk of the document
+    ///
+    DecodeStatus feed(const char * data, const size_t size);
+    ///
+    /// decode next chunk of the document
+    ///
+    inline DecodeStatus feed(const std::string & data) { return feed(data.data(), data.size()); }
+    ///
+    /// signal end of input, completes trailing number
+    ///
+    DecodeStatus finish();
+    ///
+    /// get decoding progress
+    ///
+    inline DecodeStatus getStatus() const { return m_status; }
+    ///
+    /// get error description
+    ///
+    inline const std::string & getError() const { return m_error; }
+    ///
+    /// move decoded table out, returns false if document is not complete or root is not an object or array
+    ///
+    bool getResult(Table & table);
+    ///
+    /// move decoded value out
+    ///
+    Value getResult();
+    ///
+    /// decode whole document at once
+    ///
+    static bool decode(const char * data, const size_t size, Table & table, std::string * error = nullptr);
+private:
+    ///
+    /// find where pending token ends in data, returns amount of bytes up to and including its terminator
+    /// or std::string::npos if the token goes on past data
+    ///
+    size_t findTokenEnd(const char * data, const size_t size);
+    ///
+    /// parse as much of data as possible, returns amount of consumed bytes
+    ///
+    size_t parse(const char * data, const size_t size, const bool isFinal);
+    ///
+    /// parse value starting at data[pos], returns false if it is not complete
+    ///
+    bool parseValue(const char * data, const size_t size, size_t & pos, const bool isFinal);
+    ///
+    /// parse string starting at data[pos] and push it, returns false if it is not complete
+    ///
+    bool parseString(const char * data, const size_t size, size_t & pos, const bool isFinal);
+    ///
+    /// parse number starting at data[pos] and push it, returns false if it is not complete
+    ///
+    bool parseNumber(const char * data, const size_t size, size_t & pos, const bool isFinal);
+    ///
+    /// parse true, false or null starting at data[pos] and push it, returns false if it is not complete
+    ///
+    bool parseLiteral(const char * data, const size_t size, size_t & pos, const bool isFinal);
+    ///
+    /// value is pushed
+    ///
+    void completeValue();
+    ///
+    /// container is closed
+    ///
+    void completeContainer();
+    ///
+    /// stop decoding with error
+    ///
+    void fail(const char * message, const size_t pos);
+};
+///
+/// class JsonEncoder
+///
+/// Streams lua table as JSON through a fixed buffer, sink receives every filled chunk.
+/// Tables with keys 1..n are written as arrays, others as objects; number keys become strings,
+/// functions and userdata become null. Cycles are reported as errors once nesting limit is hit.
+///
+class JsonEncoder
+{
+public:
+    typedef std::function<void(const char * data, size_t size)> Sink;
+private:
+    static const int kMaxDepth = 512;   ///< nesting limit
+
+    Sink        m_sink;         ///< output
+    std::string m_buffer;       ///< pending output
+    size_t      m_bufferSize;   ///< flush threshold
+public:
+    ///
+    /// Constructor
+    ///
+    JsonEncoder(const Sink & sink, const size_t bufferSize = 4096);
+    ///
+    /// write table, returns false if table is too deep or cyclic
+    ///
+    bool encode(const Table & table);
+    ///
+    /// encode table to string
+    ///
+    static bool encode(const Table & table, std::string & out);
+private:
+    ///
+    /// write value at index
+    ///
+    bool write(lua_State * state, const int index, const int depth);
+    ///
+    /// write table at index
+    ///
+    bool writeTable(lua_State * state, const int index, const int depth);
+    ///
+    /// write number
+    ///
+    void writeNumber(const double number);
+    ///
+    /// write quoted and escaped string
+    ///
+    void writeString(const char * str, const size_t length);
+    ///
+    /// append raw bytes
+    ///
+    void append(const char * data, const size_t size);
+    ///
+    /// pass buffered output to sink
+    ///
+    void flush();
+};
+} // lua
+
+#endif // STREN_LUA_JSON_H
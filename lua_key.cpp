@@ -0,0 +1,74 @@
+#include "lua_key.h"
+#include "lua_stack.h"
+#include "lua_release_queue.h"
+
+namespace lua
+{
+Key::Key(const char * name)
+    : m_name(name)
+{
+    Stack stack;
+    m_reference = stack.createStringReference(m_name);
+}
+
+Key::Key(const std::string & name)
+    : m_name(name)
+{
+    Stack stack;
+    m_reference = stack.createStringReference(m_name);
+}
+
+Key::Key(const Key & key)
+    : m_name(key.m_name)
+{
+    Stack stack;
+    m_reference = stack.copyReference(key.m_reference);
+}
+
+Key::Key(Key && key)
+    : m_reference(key.m_reference)
+    , m_name(std::move(key.m_name))
+{
+    key.m_reference = LUA_NOREF;
+}
+
+Key & Key::operator=(const Key & key)
+{
+    if (this != &key)
+    {
+        Stack stack;
+        if (!ReleaseQueue::defer(m_reference))
+        {
+            stack.deleteReference(m_reference);
+        }
+        m_reference = stack.copyReference(key.m_reference);
+        m_name = key.m_name;
+    }
+    return *this;
+}
+
+Key & Key::operator=(Key && key)
+{
+    if (this != &key)
+    {
+        if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+        {
+            Stack stack;
+            stack.deleteReference(m_reference);
+        }
+        m_reference = key.m_reference;
+        m_name = std::move(key.m_name);
+        key.m_reference = LUA_NOREF;
+    }
+    return *this;
+}
+
+Key::~Key()
+{
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
+}
+} // lua
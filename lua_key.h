@@ -0,0 +1,59 @@
+#ifndef STREN_LUA_KEY_H
+#define STREN_LUA_KEY_H
+
+#include <string>
+
+namespace lua
+{
+///
+/// class Key
+///
+/// String key interned in lua once and anchored in the registry. Pushing a key is a single lua_rawgeti,
+/// so repeated table lookups skip strlen, hashing and the string table probe of lua_pushstring.
+///
+class Key
+{
+private:
+    int         m_reference;    ///< reference to the interned lua string
+    std::string m_name;         ///< key string
+public:
+    ///
+    /// Constructor
+    ///
+    explicit Key(const char * name);
+    ///
+    /// Constructor
+    ///
+    explicit Key(const std::string & name);
+    ///
+    /// Copy Constructor
+    ///
+    Key(const Key & key);
+    ///
+    /// Move Constructor
+    ///
+    Key(Key && key);
+    ///
+    /// copy one key into another
+    ///
+    Key & operator=(const Key & key);
+    ///
+    /// move one key into another
+    ///
+    Key & operator=(Key && key);
+    ///
+    /// Destructor
+    ///
+    ~Key();
+    ///
+    /// get reference to the interned lua string
+    ///
+    inline int getRef() const { return m_reference; }
+    ///
+    /// get key string
+    ///
+    inline const std::string & getName() const { return m_name; }
+};
+} // lua
+
+#endif // STREN_LUA_KEY_H
@@ -0,0 +1,137 @@
+#include "lua_memoized_function.h"
+
+#include <atomic>
+#include <cstring>
+
+namespace lua
+{
+namespace
+{
+std::atomic<uint64_t> scriptGeneration(0);   ///< bumped on every script reload
+
+template <typename T>
+inline void append(std::string & key, const T value)
+{
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline bool isCacheable(const Value & value)
+{
+    return value.isNil() || value.isBool() || value.isNumber() || value.isString();
+}
+} // anonymous
+
+MemoizedFunction::MemoizedFunction(const Function & function, const size_t capacity)
+    : m_function(function)
+    , m_capacity(capacity > 0 ? capacity : 1)
+    , m_generation(scriptGeneration.load(std::memory_order_relaxed))
+    , m_counters()
+{
+    m_index.reserve(m_capacity);
+}
+
+bool MemoizedFunction::call(const ValueVector & params, ValueVector & results)
+{
+    const uint64_t generation = scriptGeneration.load(std::memory_order_relaxed);
+    if (generation != m_generation)
+    {
+        flush();
+        m_generation = generation;
+    }
+
+    if (!makeKey(params, results.size()))
+    {
+        ++m_counters.uncacheable;
+        return m_function.call(params, results);
+    }
+
+    auto found = m_index.find(m_key);
+    if (found != m_index.end())
+    {
+        ++m_counters.hits;
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        results = found->second->results;
+        return true;
+    }
+
+    if (!m_function.call(params, results)) return false;
+
+    for (const Value & result : results)
+    {
+        if (!isCacheable(result))
+        {
+            ++m_counters.uncacheable;
+            return true;
+        }
+    }
+
+    ++m_counters.misses;
+    if (m_entries.size() >= m_capacity)
+    {
+        // reuse the least recently used node
+        m_index.erase(m_entries.back().key);
+        m_entries.splice(m_entries.begin(), m_entries, std::prev(m_entries.end()));
+        ++m_counters.evictions;
+    }
+    else
+    {
+        m_entries.emplace_front();
+    }
+    Entry & entry = m_entries.front();
+    entry.key.swap(m_key);
+    entry.results = results;
+    m_index.emplace(entry.key, m_entries.begin());
+    return true;
+}
+
+void MemoizedFunction::flush()
+{
+    m_index.clear();
+    m_entries.clear();
+}
+
+void MemoizedFunction::resetCounters()
+{
+    m_counters = Counters();
+}
+
+void MemoizedFunction::invalidateAll()
+{
+    scriptGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool MemoizedFunction::makeKey(const ValueVector & params, const size_t resultsCount)
+{
+    m_key.clear();
+    append(m_key, (uint32_t)resultsCount);
+    for (const Value & param : params)
+    {
+        if (param.isNil())
+        {
+            m_key.push_back('n');
+        }
+        else if (param.isBool())
+        {
+            m_key.push_back(param.getBool() ? 't' : 'f');
+        }
+        else if (param.isNumber())
+        {
+            // 1 and 1.0 are the same lua number
+            m_key.push_back('d');
+            append(m_key, param.isInt() ? (double)param.getInt() : param.getDouble());
+        }
+        else if (param.isString())
+        {
+            const std::string_view str = param.getStringView();
+            m_key.push_back('s');
+            append(m_key, (uint32_t)str.size());
+            m_key.append(str.data(), str.size());
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // lua
@@ -0,0 +1,99 @@
+#ifndef STREN_LUA_MEMOIZED_FUNCTION_H
+#define STREN_LUA_MEMOIZED_FUNCTION_H
+
+#include "lua_function.h"
+#include "lua_value.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace lua
+{
+///
+/// class MemoizedFunction
+///
+/// Calls a pure lua function through a bounded LRU cache of results keyed by the arguments. Only calls
+/// with nil, boolean, number and string arguments are cached, and only results of the same kinds are
+/// stored, so cached values can't be changed behind the cache's back. Failed calls are not cached.
+/// Every cache is dropped when scripts are loaded again (Stack::loadScript, Stack::loadBuffer,
+/// ScriptPack::load, ScriptCompiler::run, modules loaded by ModuleLoader) or on invalidateAll(), single
+/// cache is dropped by flush().
+///
+class MemoizedFunction
+{
+public:
+    ///
+    /// struct Counters
+    ///
+    struct Counters
+    {
+        size_t hits;            ///< calls answered from the cache
+        size_t misses;          ///< calls which went to lua and could be cached
+        size_t uncacheable;     ///< calls with arguments or results which can't be cached
+        size_t evictions;       ///< entries dropped to stay within capacity
+    };
+private:
+    ///
+    /// struct Entry
+    ///
+    struct Entry
+    {
+        std::string key;        ///< encoded arguments
+        ValueVector results;    ///< cached results
+    };
+    typedef std::list<Entry> Entries;
+
+    Function                                                m_function;   ///< wrapped function
+    size_t                                                  m_capacity;   ///< maximum amount of entries
+    Entries                                                 m_entries;    ///< most recently used first
+    std::unordered_map<std::string_view, Entries::iterator> m_index;      ///< entries by key, keys point into entries
+    std::string                                             m_key;        ///< key of the current call, reused
+    uint64_t                                                m_generation; ///< script generation the entries belong to
+    Counters                                                m_counters;   ///< statistics
+public:
+    ///
+    /// Constructor
+    ///
+    MemoizedFunction(const Function & function, const size_t capacity = 1024);
+    ///
+    /// call function or take results from the cache, results size is the amount of expected results
+    ///
+    bool call(const ValueVector & params, ValueVector & results);
+    ///
+    /// drop cached results
+    ///
+    void flush();
+    ///
+    /// get amount of cached calls
+    ///
+    inline size_t getSize() const { return m_entries.size(); }
+    ///
+    /// get maximum amount of cached calls
+    ///
+    inline size_t getCapacity() const { return m_capacity; }
+    ///
+    /// get statistics
+    ///
+    inline const Counters & getCounters() const { return m_counters; }
+    ///
+    /// zero statistics
+    ///
+    void resetCounters();
+    ///
+    /// drop results of every memoized function, called when scripts are reloaded
+    ///
+    static void invalidateAll();
+private:
+    ///
+    /// encode arguments and amount of results into m_key, returns false if arguments can't be cached
+    ///
+    bool makeKey(const ValueVector & params, const size_t resultsCount);
+};
+} // lua
+
+#endif // STREN_LUA_MEMOIZED_FUNCTION_H
@@ -0,0 +1,346 @@
+#include "lua_memory_profiler.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace lua
+{
+namespace
+{
+// rough sizes of lua 5.1 objects on 64 bit platforms
+const size_t kTableSize = 64;
+const size_t kValueSize = 16;
+const size_t kNodeSize = 40;
+const size_t kStringSize = 25;
+const size_t kUserDataSize = 40;
+const size_t kClosureSize = 40;
+const size_t kUpValueSize = 40;
+const size_t kThreadSize = 184;
+
+const size_t kNoSite = static_cast<size_t>(-1);
+const char * kLuaSite = "lua";
+
+///
+/// struct SiteKey
+///
+struct SiteKey
+{
+    const char * cppSite;       ///< C++ call site
+    const void * source;        ///< lua chunk source
+    int          line;          ///< line in the lua chunk
+
+    bool operator==(const SiteKey & other) const
+    {
+        return cppSite == other.cppSite && source == other.source && line == other.line;
+    }
+};
+
+///
+/// struct SiteKeyHash
+///
+struct SiteKeyHash
+{
+    size_t operator()(const SiteKey & key) const
+    {
+        const size_t hash = std::hash<const void *>()(key.cppSite) ^ (std::hash<const void *>()(key.source) << 1);
+        return hash ^ (std::hash<int>()(key.line) << 2);
+    }
+};
+
+///
+/// struct Block
+///
+struct Block
+{
+    size_t size;                ///< size of allocated block
+    size_t site;                ///< index of the site which allocated the block
+};
+
+///
+/// struct ProfilerState
+///
+struct ProfilerState
+{
+    lua_Alloc                                        allocator = nullptr;     ///< wrapped allocator
+    void *                                           allocatorData = nullptr; ///< wrapped allocator user data
+    bool                                             isRunning = false;       ///< true if wrapper is installed
+    const char *                                     cppSite = kLuaSite;      ///< current C++ call site
+    const void *                                     source = nullptr;        ///< current lua chunk
+    int                                              line = 0;                ///< current lua line
+    std::string                                      sourceName;              ///< short name of the current lua chunk
+    size_t                                           site = kNoSite;          ///< index of current site, kNoSite - needs lookup
+    size_t                                           liveBytes = 0;           ///< tracked live bytes
+    std::vector<MemoryProfiler::Site>                sites;                   ///< all known sites
+    std::vector<size_t>                              sampledBytes;            ///< site total bytes at the previous sample
+    std::unordered_map<SiteKey, size_t, SiteKeyHash> siteIndices;             ///< site key to index in sites
+    std::unordered_map<void *, Block>                blocks;                  ///< tracked live blocks
+    std::chrono::steady_clock::time_point            sampleTime;              ///< time of the previous sample
+};
+
+ProfilerState g_state;
+
+size_t getCurrentSite()
+{
+    if (kNoSite == g_state.site)
+    {
+        const SiteKey key = { g_state.cppSite, g_state.source, g_state.line };
+        auto it = g_state.siteIndices.find(key);
+        if (it != g_state.siteIndices.end())
+        {
+            g_state.site = it->second;
+        }
+        else
+        {
+            MemoryProfiler::Site site = {};
+            site.name = g_state.cppSite;
+            if (g_state.source)
+            {
+                site.name += " | " + g_state.sourceName + ":" + std::to_string(g_state.line);
+            }
+            g_state.site = g_state.sites.size();
+            g_state.sites.push_back(site);
+            g_state.sampledBytes.push_back(0);
+            g_state.siteIndices[key] = g_state.site;
+        }
+    }
+    return g_state.site;
+}
+
+void * profilerAlloc(void *, void * ptr, size_t osize, size_t nsize)
+{
+    void * result = g_state.allocator(g_state.allocatorData, ptr, osize, nsize);
+    // failed reallocation keeps the old block
+    if (!result && nsize > 0) return result;
+
+    if (ptr)
+    {
+        auto it = g_state.blocks.find(ptr);
+        if (it != g_state.blocks.end())
+        {
+            MemoryProfiler::Site & site = g_state.sites[it->second.site];
+            site.liveBytes -= it->second.size;
+            --site.liveBlocks;
+            g_state.liveBytes -= it->second.size;
+            g_state.blocks.erase(it);
+        }
+    }
+
+    if (result)
+    {
+        const size_t index = getCurrentSite();
+        MemoryProfiler::Site & site = g_state.sites[index];
+        site.liveBytes += nsize;
+        ++site.liveBlocks;
+        site.totalBytes += nsize;
+        ++site.allocations;
+        g_state.liveBytes += nsize;
+        g_state.blocks[result] = { nsize, index };
+    }
+    return result;
+}
+
+void profilerHook(lua_State * state, lua_Debug * ar)
+{
+    if (!g_state.isRunning) return;
+
+    lua_Debug info;
+    lua_Debug * current = ar;
+    if (LUA_HOOKLINE != ar->event)
+    {
+        // on call and return the line of the active function is reported by its frame
+        if (0 == lua_getstack(state, LUA_HOOKRET == ar->event ? 1 : 0, &info)) return;
+        current = &info;
+    }
+    lua_getinfo(state, "Sl", current);
+
+    if (current->source != g_state.source)
+    {
+        g_state.source = current->source;
+        g_state.sourceName = current->short_src;
+    }
+    g_state.line = current->currentline;
+    g_state.site = kNoSite;
+}
+
+// every level takes a few stack slots, a graph deeper than the lua stack allows is counted without its deepest parts
+size_t estimateSize(lua_State * state, const int index, std::unordered_set<const void *> & visited)
+{
+    const int type = lua_type(state, index);
+    switch (type)
+    {
+    case LUA_TSTRING:
+    {
+        size_t length = 0;
+        const char * str = lua_tolstring(state, index, &length);
+        return visited.insert(str).second ? kStringSize + length : 0;
+    }
+    case LUA_TUSERDATA:
+    {
+        if (!visited.insert(lua_topointer(state, index)).second) return 0;
+
+        size_t size = kUserDataSize + lua_objlen(state, index);
+        if (lua_checkstack(state, 1) && lua_getmetatable(state, index))
+        {
+            size += estimateSize(state, -1, visited);
+            lua_pop(state, 1);
+        }
+        return size;
+    }
+    case LUA_TFUNCTION:
+    {
+        if (!visited.insert(lua_topointer(state, index)).second) return 0;
+
+        size_t size = kClosureSize;
+        if (!lua_checkstack(state, 2)) return size;
+
+        lua_pushvalue(state, index);
+        for (int i = 1; nullptr != lua_getupvalue(state, -1, i); ++i)
+        {
+            size += kUpValueSize + estimateSize(state, -1, visited);
+            lua_pop(state, 1);
+        }
+        lua_pop(state, 1);
+        return size;
+    }
+    case LUA_TTHREAD:
+        return visited.insert(lua_topointer(state, index)).second ? kThreadSize : 0;
+    case LUA_TTABLE:
+    {
+        if (!visited.insert(lua_topointer(state, index)).second) return 0;
+
+        if (!lua_checkstack(state, 4)) return kTableSize;
+
+        lua_pushvalue(state, index);
+
+        const size_t arraySize = lua_objlen(state, -1);
+        size_t entries = 0;
+        size_t size = 0;
+        lua_pushnil(state);
+        while (0 != lua_next(state, -2))
+        {
+            ++entries;
+            size += estimateSize(state, -2, visited);
+            size += estimateSize(state, -1, visited);
+            lua_pop(state, 1);
+        }
+
+        // hash part is allocated by powers of two
+        const size_t hashEntries = entries > arraySize ? entries - arraySize : 0;
+        size_t nodes = hashEntries > 0 ? 1 : 0;
+        while (nodes < hashEntries)
+        {
+            nodes <<= 1;
+        }
+        size += kTableSize + arraySize * kValueSize + nodes * kNodeSize;
+
+        if (lua_getmetatable(state, -1))
+        {
+            size += estimateSize(state, -1, visited);
+            lua_pop(state, 1);
+        }
+        lua_pop(state, 1);
+        return size;
+    }
+    default:
+        return 0;
+    }
+}
+} // namespace
+
+// class MemoryProfiler::Scope
+MemoryProfiler::Scope::Scope(const char * site)
+    : m_previous(g_state.cppSite)
+{
+    g_state.cppSite = site;
+    g_state.source = nullptr;
+    g_state.site = kNoSite;
+}
+
+MemoryProfiler::Scope::~Scope()
+{
+    g_state.cppSite = m_previous;
+    g_state.source = nullptr;
+    g_state.site = kNoSite;
+}
+
+// class MemoryProfiler
+void MemoryProfiler::start()
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state || g_state.isRunning) return;
+
+    reset();
+    g_state.allocator = lua_getallocf(state, &g_state.allocatorData);
+    g_state.isRunning = true;
+    lua_setallocf(state, profilerAlloc, nullptr);
+    lua_sethook(state, profilerHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKLINE, 0);
+}
+
+void MemoryProfiler::stop()
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state || !g_state.isRunning) return;
+
+    lua_sethook(state, nullptr, 0, 0);
+    lua_setallocf(state, g_state.allocator, g_state.allocatorData);
+    g_state.isRunning = false;
+}
+
+bool MemoryProfiler::isRunning()
+{
+    return g_state.isRunning;
+}
+
+void MemoryProfiler::reset()
+{
+    g_state.sites.clear();
+    g_state.sampledBytes.clear();
+    g_state.siteIndices.clear();
+    g_state.blocks.clear();
+    g_state.liveBytes = 0;
+    g_state.site = kNoSite;
+    g_state.sampleTime = std::chrono::steady_clock::now();
+}
+
+void MemoryProfiler::getSites(std::vector<Site> & sites)
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - g_state.sampleTime).count();
+    g_state.sampleTime = now;
+
+    for (size_t i = 0, iEnd = g_state.sites.size(); i < iEnd; ++i)
+    {
+        Site & site = g_state.sites[i];
+        const size_t allocated = site.totalBytes - g_state.sampledBytes[i];
+        site.allocationRate = elapsed > 0.0 ? allocated / elapsed : 0.0;
+        g_state.sampledBytes[i] = site.totalBytes;
+    }
+
+    sites = g_state.sites;
+    std::sort(sites.begin(), sites.end(), [](const Site & a, const Site & b) { return a.liveBytes > b.liveBytes; });
+}
+
+size_t MemoryProfiler::getLiveBytes()
+{
+    return g_state.liveBytes;
+}
+
+size_t MemoryProfiler::getRetainedSize(const Table & table)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return 0;
+
+    std::unordered_set<const void *> visited;
+    lua_getref(state, table.getRef());
+    const size_t size = lua_istable(state, -1) ? estimateSize(state, -1, visited) : 0;
+    stack.pop(1);
+    return size;
+}
+} // lua
@@ -0,0 +1,84 @@
+#ifndef STREN_LUA_MEMORY_PROFILER_H
+#define STREN_LUA_MEMORY_PROFILER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+class Table;
+///
+/// class MemoryProfiler
+///
+/// Wraps the allocator of the lua virtual machine and attributes every live block to the lua line
+/// and the C++ call site which allocated it. Lua lines are tracked with a line hook, so profiling
+/// should be turned on only while investigating.
+///
+class MemoryProfiler
+{
+public:
+    ///
+    /// struct Site
+    ///
+    struct Site
+    {
+        std::string name;               ///< "cpp site | source:line"
+        size_t      liveBytes;          ///< bytes allocated at the site and not freed yet
+        size_t      liveBlocks;         ///< blocks allocated at the site and not freed yet
+        size_t      totalBytes;         ///< bytes allocated at the site since start
+        size_t      allocations;        ///< blocks allocated at the site since start
+        double      allocationRate;     ///< bytes per second allocated since the previous getSites call
+    };
+    ///
+    /// class Scope
+    ///
+    /// Marks allocations made while the scope is alive with the given C++ call site.
+    ///
+    class Scope
+    {
+    private:
+        const char * m_previous;        ///< call site of the outer scope
+    public:
+        ///
+        /// Constructor, site should be a string literal
+        ///
+        Scope(const char * site);
+        ///
+        /// Destructor
+        ///
+        ~Scope();
+    };
+public:
+    ///
+    /// install allocator wrapper and line hook into the lua virtual machine, drops previously collected data
+    ///
+    static void start();
+    ///
+    /// restore original allocator and remove the hook, collected data is kept until the next start
+    ///
+    static void stop();
+    ///
+    /// check if profiler is installed
+    ///
+    static bool isRunning();
+    ///
+    /// drop collected data
+    ///
+    static void reset();
+    ///
+    /// get sites sorted by live bytes, allocation rate is measured since the previous call
+    ///
+    static void getSites(std::vector<Site> & sites);
+    ///
+    /// get live bytes tracked by profiler
+    ///
+    static size_t getLiveBytes();
+    ///
+    /// estimate memory retained by the table and everything reachable from it
+    ///
+    static size_t getRetainedSize(const Table & table);
+};
+} // lua
+
+#endif // STREN_LUA_MEMORY_PROFILER_H
@@ -0,0 +1,334 @@
+#include "lua_module_loader.h"
+#include "lua_script_pack.h"
+#include "lua_stack.h"
+#include "lua_memory_profiler.h"
+#include "lua_memoized_function.h"
+#include "utils.h"
+
+#include <cstdio>
+
+namespace lua
+{
+namespace
+{
+bool readFile(const std::string & path, std::string & content)
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+
+    content.clear();
+    char buffer[16384];
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.append(buffer, size);
+    }
+    const bool isRead = 0 == ferror(file);
+    fclose(file);
+    return isRead;
+}
+
+int writeChunk(lua_State *, const void * data, size_t size, void * userdata)
+{
+    static_cast<std::string *>(userdata)->append(static_cast<const char *>(data), size);
+    return 0;
+}
+} // anonymous
+
+ModuleLoader::ModuleLoader()
+    : m_isStopping(false)
+    , m_loadedCount(0)
+    , m_prewarmedCount(0)
+{
+}
+
+ModuleLoader::~ModuleLoader()
+{
+    m_isStopping = true;
+    waitPrewarm();
+    uninstall();
+}
+
+void ModuleLoader::addFile(const std::string & name, const std::string & path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Source & source = m_modules[name];
+    source.type = SourceType::File;
+    source.path = path;
+    source.data = nullptr;
+    source.size = 0;
+}
+
+void ModuleLoader::addBuffer(const std::string & name, const char * data, const size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Source & source = m_modules[name];
+    source.type = SourceType::Buffer;
+    source.path.clear();
+    source.data = data;
+    source.size = size;
+}
+
+void ModuleLoader::addPack(ScriptPack & pack)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_packs.push_back(&pack);
+}
+
+void ModuleLoader::addPath(const std::string & pattern)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_paths.push_back(pattern);
+}
+
+void ModuleLoader::install()
+{
+    uninstall();
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    lua_getglobal(state, "package");
+    lua_getfield(state, -1, "loaders");
+    if (!lua_istable(state, -1))
+    {
+        lua_pop(state, 2);
+        stren::assertMessage(false, "[lua] package.loaders not found");
+        return;
+    }
+
+    // package.preload keeps priority, the searcher goes before the standard file searchers
+    const int count = (int)lua_objlen(state, -1);
+    const int position = count < 2 ? count + 1 : 2;
+    for (int i = count; i >= position; --i)
+    {
+        lua_rawgeti(state, -1, i);
+        lua_rawseti(state, -2, i + 1);
+    }
+    lua_pushlightuserdata(state, this);
+    lua_pushcclosure(state, luaSearch, 1);
+    lua_rawseti(state, -2, position);
+    lua_pop(state, 2);
+}
+
+void ModuleLoader::uninstall()
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    lua_getglobal(state, "package");
+    if (lua_istable(state, -1))
+    {
+        lua_getfield(state, -1, "loaders");
+        if (lua_istable(state, -1))
+        {
+            const int count = (int)lua_objlen(state, -1);
+            for (int i = 1; i <= count; ++i)
+            {
+                bool isOwn = false;
+                lua_rawgeti(state, -1, i);
+                if (luaSearch == lua_tocfunction(state, -1) && lua_getupvalue(state, -1, 1))
+                {
+                    isOwn = this == lua_touserdata(state, -1);
+                    lua_pop(state, 1);
+                }
+                lua_pop(state, 1);
+                if (!isOwn) continue;
+
+                for (int j = i; j < count; ++j)
+                {
+                    lua_rawgeti(state, -1, j + 1);
+                    lua_rawseti(state, -2, j);
+                }
+                lua_pushnil(state);
+                lua_rawseti(state, -2, count);
+                break;
+            }
+        }
+        lua_pop(state, 1);
+    }
+    lua_pop(state, 1);
+}
+
+void ModuleLoader::prewarm(const std::vector<std::string> & names)
+{
+    waitPrewarm();
+    m_isStopping = false;
+    m_prewarmThread = std::thread(&ModuleLoader::compile, this, names);
+}
+
+void ModuleLoader::waitPrewarm()
+{
+    if (m_prewarmThread.joinable())
+    {
+        m_prewarmThread.join();
+    }
+}
+
+bool ModuleLoader::read(const std::string & name, std::string & content, std::string & chunkName, std::string & error) const
+{
+    std::string path;
+    std::vector<std::string> patterns;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_modules.find(name);
+        if (it != m_modules.end())
+        {
+            const Source & source = it->second;
+            if (SourceType::Buffer == source.type)
+            {
+                content.assign(source.data, source.size);
+                chunkName = "=" + name;
+                return true;
+            }
+            path = source.path;
+        }
+        else
+        {
+            std::string buffer;
+            for (ScriptPack * pack : m_packs)
+            {
+                const char * data = nullptr;
+                size_t size = 0;
+                if (pack->contains(name))
+                {
+                    if (!pack->read(name, data, size, buffer, &error)) return false;
+                    content.assign(data, size);
+                    chunkName = "@" + name;
+                    return true;
+                }
+            }
+            patterns = m_paths;
+        }
+    }
+
+    // file system is accessed without the lock, so prewarm does not stall require
+    if (!path.empty())
+    {
+        if (!readFile(path, content))
+        {
+            error = "can not read " + path;
+            return false;
+        }
+        chunkName = "@" + path;
+        return true;
+    }
+
+    std::string modulePath = name;
+    for (char & c : modulePath)
+    {
+        if ('.' == c) c = '/';
+    }
+    for (const std::string & pattern : patterns)
+    {
+        std::string candidate;
+        for (const char c : pattern)
+        {
+            if ('?' == c) candidate += modulePath;
+            else candidate += c;
+        }
+        if (readFile(candidate, content))
+        {
+            chunkName = "@" + candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+int ModuleLoader::search(lua_State * state, const std::string & name)
+{
+    MemoryProfiler::Scope scope("ModuleLoader::load");
+
+    std::string bytecode;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_bytecode.find(name);
+        if (it != m_bytecode.end())
+        {
+            bytecode.swap(it->second);
+            m_bytecode.erase(it);
+        }
+    }
+    if (!bytecode.empty())
+    {
+        if (0 == luaL_loadbuffer(state, bytecode.data(), bytecode.size(), name.c_str()))
+        {
+            ++m_loadedCount;
+            ++m_prewarmedCount;
+            MemoizedFunction::invalidateAll();
+            return 1;
+        }
+        lua_pop(state, 1);
+    }
+
+    std::string content;
+    std::string chunkName;
+    std::string error;
+    if (!read(name, content, chunkName, error))
+    {
+        if (error.empty())
+        {
+            lua_pushfstring(state, "\n\tno module '%s' in module loader", name.c_str());
+            return 1;
+        }
+        lua_pushfstring(state, "error loading module '%s':\n\t%s", name.c_str(), error.c_str());
+        return -1;
+    }
+
+    if (0 != luaL_loadbuffer(state, content.data(), content.size(), chunkName.c_str()))
+    {
+        lua_pushfstring(state, "error loading module '%s':\n\t%s", name.c_str(), lua_tostring(state, -1));
+        lua_remove(state, -2);
+        return -1;
+    }
+    ++m_loadedCount;
+    MemoizedFunction::invalidateAll();
+    return 1;
+}
+
+void ModuleLoader::compile(const std::vector<std::string> & names)
+{
+    // scratch state is private to this thread, the shared virtual machine is never touched
+    lua_State * state = lua_open();
+    if (!state) return;
+
+    std::string content;
+    std::string chunkName;
+    std::string error;
+    for (const std::string & name : names)
+    {
+        if (m_isStopping) break;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_bytecode.count(name)) continue;
+        }
+
+        // modules which fail here are reported by require
+        if (!read(name, content, chunkName, error)) continue;
+        if (0 != luaL_loadbuffer(state, content.data(), content.size(), chunkName.c_str()))
+        {
+            lua_settop(state, 0);
+            continue;
+        }
+
+        std::string bytecode;
+        lua_dump(state, writeChunk, &bytecode);
+        lua_settop(state, 0);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bytecode.emplace(name, std::move(bytecode));
+    }
+    lua_close(state);
+}
+
+int ModuleLoader::luaSearch(lua_State * state)
+{
+    ModuleLoader * loader = static_cast<ModuleLoader *>(lua_touserdata(state, lua_upvalueindex(1)));
+    const int result = loader->search(state, luaL_checkstring(state, 1));
+    // raised after search returned, so no C++ object is skipped by longjmp
+    return result < 0 ? lua_error(state) : result;
+}
+} // lua
@@ -0,0 +1,132 @@
+#ifndef STREN_LUA_MODULE_LOADER_H
+#define STREN_LUA_MODULE_LOADER_H
+
+#include "lua_ext.h"
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace lua
+{
+class ScriptPack;
+///
+/// class ModuleLoader
+///
+/// Searcher for require installed into package.loaders. Module names are resolved against registered
+/// buffers, packs, files and search paths in that order, and a module is read and compiled only when it is
+/// required for the first time. Modules expected soon can be prewarmed: a background thread reads and
+/// compiles them to bytecode in its own scratch state, so require only has to load ready bytecode.
+///     ModuleLoader loader;
+///     loader.addPath("scripts/?.lua");
+///     loader.install();
+///     loader.prewarm({ "net.http", "net.json" });
+///
+class ModuleLoader
+{
+private:
+    ///
+    /// where module comes from
+    ///
+    enum class SourceType
+    {
+        File,
+        Buffer
+    };
+    ///
+    /// struct Source
+    ///
+    struct Source
+    {
+        SourceType   type;      ///< source type
+        std::string  path;      ///< file path
+        const char * data;      ///< buffer data
+        size_t       size;      ///< buffer size
+    };
+
+    std::map<std::string, Source>                m_modules;         ///< explicitly registered modules
+    std::vector<ScriptPack *>                    m_packs;           ///< packs searched by module name
+    std::vector<std::string>                     m_paths;           ///< search patterns, '?' is replaced with module path
+    std::unordered_map<std::string, std::string> m_bytecode;        ///< prewarmed modules
+    mutable std::mutex                           m_mutex;           ///< guards index, packs and prewarmed bytecode
+    std::thread                                  m_prewarmThread;   ///< background prewarm
+    std::atomic<bool>                            m_isStopping;      ///< asks prewarm to stop
+    std::atomic<size_t>                          m_loadedCount;     ///< amount of loaded modules
+    std::atomic<size_t>                          m_prewarmedCount;  ///< amount of modules loaded from prewarmed bytecode
+public:
+    ///
+    /// Constructor
+    ///
+    ModuleLoader();
+    ///
+    /// Destructor, stops prewarm and uninstalls searcher
+    ///
+    ~ModuleLoader();
+    ///
+    /// register module file
+    ///
+    void addFile(const std::string & name, const std::string & path);
+    ///
+    /// register module placed in memory, data has to outlive the loader
+    ///
+    void addBuffer(const std::string & name, const char * data, const size_t size);
+    ///
+    /// search modules by name in pack, pack has to outlive the loader
+    ///
+    void addPack(ScriptPack & pack);
+    ///
+    /// search modules by pattern, '?' is replaced with module name where dots become directory separators
+    ///
+    void addPath(const std::string & pattern);
+    ///
+    /// insert searcher into package.loaders right after package.preload
+    ///
+    void install();
+    ///
+    /// remove searcher from package.loaders
+    ///
+    void uninstall();
+    ///
+    /// read and compile modules in background
+    ///
+    void prewarm(const std::vector<std::string> & names);
+    ///
+    /// wait for background prewarm to finish
+    ///
+    void waitPrewarm();
+    ///
+    /// get amount of modules loaded through the searcher
+    ///
+    inline size_t getLoadedCount() const { return m_loadedCount; }
+    ///
+    /// get amount of modules loaded from prewarmed bytecode
+    ///
+    inline size_t getPrewarmedCount() const { return m_prewarmedCount; }
+private:
+    ModuleLoader(const ModuleLoader &) = delete;
+    ModuleLoader & operator=(const ModuleLoader &) = delete;
+    ///
+    /// read module content, returns false if module is unknown
+    ///
+    bool read(const std::string & name, std::string & content, std::string & chunkName, std::string & error) const;
+    ///
+    /// look for module, pushes loader function or "not found" message, returns -1 after pushing error message
+    ///
+    int search(lua_State * state, const std::string & name);
+    ///
+    /// compile modules to bytecode
+    ///
+    void compile(const std::vector<std::string> & names);
+    ///
+    /// lua: searcher(name)
+    ///
+    static int luaSearch(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_MODULE_LOADER_H
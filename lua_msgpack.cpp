@@ -0,0 +1,505 @@
+#include "lua_msgpack.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+#include "lua_value.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace lua
+{
+namespace
+{
+inline uint64_t load(const uint8_t * data, const size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+inline double loadFloat(const uint8_t * data)
+{
+    const uint32_t bits = (uint32_t)load(data, 4);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline double loadDouble(const uint8_t * data)
+{
+    const uint64_t bits = load(data, 8);
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline double loadSigned(const uint8_t * data, const size_t size)
+{
+    const uint64_t bits = load(data, size) << (64 - size * 8);
+    return (double)((int64_t)bits >> (64 - size * 8));
+}
+
+// sizes of the fixed part following the type byte
+const uint8_t kHeaderSizes[0x20] =
+{
+    0, 0, 0, 0,     // nil, never used, false, true
+    1, 2, 4,        // bin 8/16/32
+    2, 3, 5,        // ext 8/16/32 with type
+    4, 8,           // float 32/64
+    1, 2, 4, 8,     // uint 8/16/32/64
+    1, 2, 4, 8,     // int 8/16/32/64
+    2, 3, 5, 9, 17, // fixext 1/2/4/8/16 with type
+    1, 2, 4,        // str 8/16/32
+    2, 4,           // array 16/32
+    2, 4            // map 16/32
+};
+
+inline size_t getHeaderSize(const uint8_t type)
+{
+    return type < 0xc0 || type >= 0xe0 ? 1 : 1 + kHeaderSizes[type - 0xc0];
+}
+
+// bytes taken by the item, containers take only their header; header size while header is incomplete
+size_t getItemSize(const uint8_t * data, const size_t size)
+{
+    const uint8_t type = data[0];
+    const size_t header = getHeaderSize(type);
+    if (size < header) return header;
+
+    if (type >= 0xa0 && type <= 0xbf) return 1 + (type & 0x1f);
+    switch (type)
+    {
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        return header + (size_t)load(data + 1, header - 1);
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+        return header + (size_t)load(data + 1, header - 2);
+    default:
+        return header;
+    }
+}
+} // anonymous
+
+MsgPackDecoder::MsgPackDecoder()
+    : m_status(DecodeStatus::NeedMore)
+    , m_offset(0)
+{
+}
+
+void MsgPackDecoder::reset()
+{
+    m_builder.reset();
+    m_status = DecodeStatus::NeedMore;
+    m_pending.clear();
+    m_error.clear();
+    m_offset = 0;
+}
+
+DecodeStatus MsgPackDecoder::feed(const char * data, const size_t size)
+{
+    if (DecodeStatus::NeedMore != m_status) return m_status;
+
+    size_t taken = 0;
+    if (!m_pending.empty())
+    {
+        // complete only the unfinished item, the rest of the chunk is parsed in place
+        size_t needed = getItemSize((const uint8_t *)m_pending.data(), m_pending.size());
+        while (m_pending.size() < needed && taken < size)
+        {
+            const size_t count = std::min(needed - m_pending.size(), size - taken);
+            m_pending.append(data + taken, count);
+            taken += count;
+            needed = getItemSize((const uint8_t *)m_pending.data(), m_pending.size());
+        }
+        if (m_pending.size() < needed) return m_status;
+
+        parse((const uint8_t *)m_pending.data(), m_pending.size());
+        m_pending.clear();
+    }
+
+    const size_t used = taken + parse((const uint8_t *)data + taken, size - taken);
+    if (DecodeStatus::NeedMore == m_status)
+    {
+        m_pending.assign(data + used, size - used);
+    }
+    return m_status;
+}
+
+bool MsgPackDecoder::getResult(Table & table)
+{
+    return DecodeStatus::Done == m_status && m_builder.getResult(table);
+}
+
+Value MsgPackDecoder::getResult()
+{
+    return DecodeStatus::Done == m_status ? m_builder.getResult() : Value();
+}
+
+bool MsgPackDecoder::decode(const char * data, const size_t size, Table & table, std::string * error)
+{
+    MsgPackDecoder decoder;
+    decoder.feed(data, size);
+    if (decoder.getResult(table)) return true;
+
+    if (error)
+    {
+        switch (decoder.getStatus())
+        {
+        case DecodeStatus::NeedMore: *error = "[msgpack] unexpected end of document"; break;
+        case DecodeStatus::Done: *error = "[msgpack] root is not a map or array"; break;
+        case DecodeStatus::Error: *error = decoder.getError(); break;
+        }
+    }
+    return false;
+}
+
+size_t MsgPackDecoder::parse(const uint8_t * data, const size_t size)
+{
+    size_t pos = 0;
+    while (DecodeStatus::NeedMore == m_status && pos < size)
+    {
+        const size_t used = parseItem(data + pos, size - pos);
+        if (0 == used) break;
+
+        pos += used;
+        m_offset += used;
+        if (m_builder.isDone())
+        {
+            m_status = DecodeStatus::Done;
+        }
+    }
+    return pos;
+}
+
+size_t MsgPackDecoder::parseItem(const uint8_t * data, const size_t size)
+{
+    lua_State * state = m_builder.getState();
+    const uint8_t type = data[0];
+
+    if (type <= 0x7f)
+    {
+        lua_pushnumber(state, type);
+        m_builder.addValue();
+        return 1;
+    }
+    if (type >= 0xe0)
+    {
+        lua_pushnumber(state, (int8_t)type);
+        m_builder.addValue();
+        return 1;
+    }
+    if (type <= 0x8f) return beginContainer(true, type & 0x0f, 1, size);
+    if (type <= 0x9f) return beginContainer(false, type & 0x0f, 1, size);
+    if (type <= 0xbf) return pushString(data, size, 1, type & 0x1f);
+
+    const size_t header = getHeaderSize(type);
+    if (size < header) return 0;
+
+    switch (type)
+    {
+    case 0xc0:
+        lua_pushnil(state);
+        break;
+    case 0xc1:
+        fail("invalid type 0xc1");
+        return 0;
+    case 0xc2:
+    case 0xc3:
+        lua_pushboolean(state, 0xc3 == type);
+        break;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+        return pushString(data, size, header, (uint32_t)load(data + 1, header - 1));
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+        // ext payload without its type byte
+        return pushString(data, size, header, (uint32_t)load(data + 1, header - 2));
+    case 0xca:
+        lua_pushnumber(state, loadFloat(data + 1));
+        break;
+    case 0xcb:
+        lua_pushnumber(state, loadDouble(data + 1));
+        break;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        lua_pushnumber(state, (double)load(data + 1, header - 1));
+        break;
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+        lua_pushnumber(state, loadSigned(data + 1, header - 1));
+        break;
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+        lua_pushlstring(state, (const char *)data + 2, header - 2);
+        break;
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        return pushString(data, size, header, (uint32_t)load(data + 1, header - 1));
+    case 0xdc:
+    case 0xdd:
+        return beginContainer(false, (uint32_t)load(data + 1, header - 1), header, size);
+    case 0xde:
+    case 0xdf:
+        return beginContainer(true, (uint32_t)load(data + 1, header - 1), header, size);
+    }
+
+    m_builder.addValue();
+    return header;
+}
+
+size_t MsgPackDecoder::beginContainer(const bool isMap, const uint32_t count, const size_t header, const size_t size)
+{
+    if (size < header) return 0;
+    if (m_builder.getDepth() >= kMaxDepth)
+    {
+        fail("document is too deep");
+        return 0;
+    }
+
+    // every item takes at least one byte, so size hint can not exceed received data and hostile counts are harmless
+    const size_t available = size - header;
+    const int sizeHint = (int)(count < available ? count : available);
+    if (isMap)
+    {
+        m_builder.beginMap(sizeHint, count);
+    }
+    else
+    {
+        m_builder.beginArray(sizeHint, count);
+    }
+    return header;
+}
+
+size_t MsgPackDecoder::pushString(const uint8_t * data, const size_t size, const size_t header, const uint32_t length)
+{
+    if (size < header || size - header < length) return 0;
+
+    lua_pushlstring(m_builder.getState(), (const char *)data + header, length);
+    m_builder.addValue();
+    return header + length;
+}
+
+void MsgPackDecoder::fail(const char * message)
+{
+    m_status = DecodeStatus::Error;
+    m_error = std::string("[msgpack] ") + message + " at byte " + std::to_string(m_offset);
+    m_builder.reset();
+}
+
+MsgPackEncoder::MsgPackEncoder(const Sink & sink, const size_t bufferSize)
+    : m_sink(sink)
+    , m_bufferSize(bufferSize)
+{
+    m_buffer.reserve(bufferSize);
+}
+
+bool MsgPackEncoder::encode(const Table & table)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    lua_getref(state, table.getRef());
+    const bool isEncoded = write(state, lua_gettop(state), 0);
+    lua_pop(state, 1);
+    flush();
+    return isEncoded;
+}
+
+bool MsgPackEncoder::encode(const Value & value)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    stack.push(value);
+    const bool isEncoded = write(state, lua_gettop(state), 0);
+    lua_pop(state, 1);
+    flush();
+    return isEncoded;
+}
+
+bool MsgPackEncoder::encode(lua_State * state, const int index)
+{
+    const int absoluteIndex = (index > 0 || index <= LUA_REGISTRYINDEX) ? index : lua_gettop(state) + index + 1;
+    const bool isEncoded = write(state, absoluteIndex, 0);
+    flush();
+    return isEncoded;
+}
+
+bool MsgPackEncoder::encode(const Table & table, std::string & out)
+{
+    MsgPackEncoder encoder([&out](const char * data, size_t size) { out.append(data, size); });
+    return encoder.encode(table);
+}
+
+bool MsgPackEncoder::write(lua_State * state, const int index, const int depth)
+{
+    switch (lua_type(state, index))
+    {
+    case LUA_TBOOLEAN:
+        writeHeader(lua_toboolean(state, index) ? 0xc3 : 0xc2, 0, 0);
+        break;
+    case LUA_TNUMBER:
+        writeNumber(lua_tonumber(state, index));
+        break;
+    case LUA_TSTRING:
+    {
+        size_t length = 0;
+        const char * str = lua_tolstring(state, index, &length);
+        writeString(str, length);
+        break;
+    }
+    case LUA_TTABLE:
+        return writeTable(state, index, depth + 1);
+    default:
+        writeHeader(0xc0, 0, 0);
+        break;
+    }
+    return true;
+}
+
+bool MsgPackEncoder::writeTable(lua_State * state, const int index, const int depth)
+{
+    if (depth > kMaxDepth || !lua_checkstack(state, 3)) return false;
+
+    const size_t length = getSequenceLength(state, index);
+    if (length > 0)
+    {
+        if (length < 16) writeHeader((uint8_t)(0x90 | length), 0, 0);
+        else if (length <= 0xffff) writeHeader(0xdc, length, 2);
+        else writeHeader(0xdd, length, 4);
+
+        for (size_t i = 1; i <= length; ++i)
+        {
+            lua_rawgeti(state, index, (int)i);
+            const bool isWritten = write(state, lua_gettop(state), depth);
+            lua_pop(state, 1);
+            if (!isWritten) return false;
+        }
+        return true;
+    }
+
+    // map header needs the amount of pairs, so keys which can not be written are counted out first
+    size_t count = 0;
+    lua_pushnil(state);
+    while (lua_next(state, index))
+    {
+        const int keyType = lua_type(state, -2);
+        count += LUA_TBOOLEAN == keyType || LUA_TNUMBER == keyType || LUA_TSTRING == keyType || LUA_TTABLE == keyType;
+        lua_pop(state, 1);
+    }
+
+    if (count < 16) writeHeader((uint8_t)(0x80 | count), 0, 0);
+    else if (count <= 0xffff) writeHeader(0xde, count, 2);
+    else writeHeader(0xdf, count, 4);
+
+    lua_pushnil(state);
+    while (lua_next(state, index))
+    {
+        const int keyType = lua_type(state, -2);
+        if (LUA_TBOOLEAN != keyType && LUA_TNUMBER != keyType && LUA_TSTRING != keyType && LUA_TTABLE != keyType)
+        {
+            lua_pop(state, 1);
+            continue;
+        }
+
+        const int top = lua_gettop(state);
+        if (!write(state, top - 1, depth) || !write(state, top, depth))
+        {
+            lua_pop(state, 2);
+            return false;
+        }
+        lua_pop(state, 1);
+    }
+    return true;
+}
+
+void MsgPackEncoder::writeNumber(const double number)
+{
+    if (number != std::floor(number) || number < -9223372036854775808.0 || number >= 18446744073709551616.0)
+    {
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        writeHeader(0xcb, bits, 8);
+        return;
+    }
+
+    if (number >= 0)
+    {
+        const uint64_t value = (uint64_t)number;
+        if (value < 0x80) writeHeader((uint8_t)value, 0, 0);
+        else if (value <= 0xff) writeHeader(0xcc, value, 1);
+        else if (value <= 0xffff) writeHeader(0xcd, value, 2);
+        else if (value <= 0xffffffff) writeHeader(0xce, value, 4);
+        else writeHeader(0xcf, value, 8);
+    }
+    else
+    {
+        const int64_t value = (int64_t)number;
+        if (value >= -32) writeHeader((uint8_t)value, 0, 0);
+        else if (value >= -0x80) writeHeader(0xd0, (uint64_t)value, 1);
+        else if (value >= -0x8000) writeHeader(0xd1, (uint64_t)value, 2);
+        else if (value >= -0x80000000LL) writeHeader(0xd2, (uint64_t)value, 4);
+        else writeHeader(0xd3, (uint64_t)value, 8);
+    }
+}
+
+void MsgPackEncoder::writeString(const char * str, const size_t length)
+{
+    if (length < 32) writeHeader((uint8_t)(0xa0 | length), 0, 0);
+    else if (length <= 0xff) writeHeader(0xd9, length, 1);
+    else if (length <= 0xffff) writeHeader(0xda, length, 2);
+    else writeHeader(0xdb, length, 4);
+    append(str, length);
+}
+
+void MsgPackEncoder::writeHeader(const uint8_t type, const uint64_t value, const size_t size)
+{
+    char header[9];
+    header[0] = (char)type;
+    for (size_t i = 0; i < size; ++i)
+    {
+        header[1 + i] = (char)(value >> ((size - 1 - i) * 8));
+    }
+    append(header, 1 + size);
+}
+
+void MsgPackEncoder::append(const char * data, const size_t size)
+{
+    m_buffer.append(data, size);
+    if (m_buffer.size() >= m_bufferSize)
+    {
+        flush();
+    }
+}
+
+void MsgPackEncoder::flush()
+{
+    if (!m_buffer.empty())
+    {
+        m_sink(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+    }
+}
+} // lua
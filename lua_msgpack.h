@@ -0,0 +1,164 @@
+#ifndef STREN_LUA_MSGPACK_H
+#define STREN_LUA_MSGPACK_H
+
+#include "lua_table_builder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace lua
+{
+class Table;
+class Value;
+///
+/// class MsgPackDecoder
+///
+/// Incremental MessagePack decoder which builds lua tables directly. Container sizes are known upfront,
+/// so tables are created with their final size. Input may be split at any byte:
+///     MsgPackDecoder decoder;
+///     while (decoder.feed(chunk, size) == DecodeStatus::NeedMore) { ... read next chunk ... }
+///     decoder.getResult(table);
+/// bin and ext payloads become lua strings, integers out of double precision lose low bits.
+///
+class MsgPackDecoder
+{
+private:
+    static const size_t kMaxDepth = 512;    ///< nesting limit
+
+    TableBuilder m_builder;     ///< tables under construction
+    DecodeStatus m_status;      ///< decoding progress
+    std::string  m_pending;     ///< unfinished item of the previous feed
+    std::string  m_error;       ///< error description
+    size_t       m_offset;      ///< amount of consumed bytes, used in error messages
+public:
+    ///
+    /// Constructor
+    ///
+    MsgPackDecoder();
+    ///
+    /// forget everything and start new document
+    ///
+    void reset();
+    ///
+    /// decode next chunk of the document
+    ///
+    DecodeStatus feed(const char * data, const size_t size);
+    ///
+    /// decode next chunk of the document
+    ///
+    inline DecodeStatus feed(const std::string & data) { return feed(data.data(), data.size()); }
+    ///
+    /// get decoding progress
+    ///
+    inline DecodeStatus getStatus() const { return m_status; }
+    ///
+    /// get error description
+    ///
+    inline const std::string & getError() const { return m_error; }
+    ///
+    /// move decoded table out, returns false if document is not complete or root is not a map or array
+    ///
+    bool getResult(Table & table);
+    ///
+    /// move decoded value out
+    ///
+    Value getResult();
+    ///
+    /// decode whole document at once
+    ///
+    static bool decode(const char * data, const size_t size, Table & table, std::string * error = nullptr);
+private:
+    ///
+    /// parse as much of data as possible, returns amount of consumed bytes
+    ///
+    size_t parse(const uint8_t * data, const size_t size);
+    ///
+    /// parse one item, returns amount of consumed bytes or 0 if item is not complete
+    ///
+    size_t parseItem(const uint8_t * data, const size_t size);
+    ///
+    /// start container of count items if nesting allows, returns header size or 0 on error
+    ///
+    size_t beginContainer(const bool isMap, const uint32_t count, const size_t header, const size_t size);
+    ///
+    /// push string of length after header, returns consumed bytes or 0 if it is not complete
+    ///
+    size_t pushString(const uint8_t * data, const size_t size, const size_t header, const uint32_t length);
+    ///
+    /// stop decoding with error
+    ///
+    void fail(const char * message);
+};
+///
+/// class MsgPackEncoder
+///
+/// Streams lua values as MessagePack through a fixed buffer, sink receives every filled chunk.
+/// Tables with keys 1..n are written as arrays, others as maps; integral numbers use the shortest integer
+/// format. Functions, userdata and threads are written as nil values and skipped as keys.
+///
+class MsgPackEncoder
+{
+public:
+    typedef std::function<void(const char * data, size_t size)> Sink;
+private:
+    static const int kMaxDepth = 512;   ///< nesting limit
+
+    Sink        m_sink;         ///< output
+    std::string m_buffer;       ///< pending output
+    size_t      m_bufferSize;   ///< flush threshold
+public:
+    ///
+    /// Constructor
+    ///
+    MsgPackEncoder(const Sink & sink, const size_t bufferSize = 4096);
+    ///
+    /// write table, returns false if table is too deep or cyclic
+    ///
+    bool encode(const Table & table);
+    ///
+    /// write value, returns false if value is too deep or cyclic
+    ///
+    bool encode(const Value & value);
+    ///
+    /// write value at index of any lua state
+    ///
+    bool encode(lua_State * state, const int index);
+    ///
+    /// encode table to string
+    ///
+    static bool encode(const Table & table, std::string & out);
+private:
+    ///
+    /// write value at absolute index
+    ///
+    bool write(lua_State * state, const int index, const int depth);
+    ///
+    /// write table at absolute index
+    ///
+    bool writeTable(lua_State * state, const int index, const int depth);
+    ///
+    /// write number in the shortest format
+    ///
+    void writeNumber(const double number);
+    ///
+    /// write string header and data
+    ///
+    void writeString(const char * str, const size_t length);
+    ///
+    /// write type byte followed by big endian value of size bytes
+    ///
+    void writeHeader(const uint8_t type, const uint64_t value, const size_t size);
+    ///
+    /// append raw bytes
+    ///
+    void append(const char * data, const size_t size);
+    ///
+    /// pass buffered output to sink
+    ///
+    void flush();
+};
+} // lua
+
+#endif // STREN_LUA_MSGPACK_H
@@ -0,0 +1,934 @@
+#include "lua_num_buffer.h"
+#include "lua_stack.h"
+#include "lua_release_queue.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STREN_LUA_SSE2 1
+#endif
+
+namespace lua
+{
+namespace
+{
+const char * kMetatableName = "lua.NumBuffer";
+const char * kTypeNames[] = { "f32", "f64", "i32", nullptr };
+const size_t kAlignment = 16;
+
+///
+/// struct Simd
+///
+/// Vector operations for element type, kEnabled is false where kernels fall back to plain loops.
+///
+template <typename T>
+struct Simd
+{
+    static const bool kEnabled = false;
+};
+
+#if defined(STREN_LUA_SSE2)
+template <>
+struct Simd<float>
+{
+    typedef __m128 Vector;
+    static const bool   kEnabled = true;
+    static const size_t kWidth = 4;
+
+    static inline Vector load(const float * data) { return _mm_loadu_ps(data); }
+    static inline void store(float * data, const Vector value) { _mm_storeu_ps(data, value); }
+    static inline Vector set(const float value) { return _mm_set1_ps(value); }
+    static inline Vector add(const Vector a, const Vector b) { return _mm_add_ps(a, b); }
+    static inline Vector sub(const Vector a, const Vector b) { return _mm_sub_ps(a, b); }
+    static inline Vector mul(const Vector a, const Vector b) { return _mm_mul_ps(a, b); }
+    static inline Vector min(const Vector a, const Vector b) { return _mm_min_ps(a, b); }
+    static inline Vector max(const Vector a, const Vector b) { return _mm_max_ps(a, b); }
+    static inline Vector lt(const Vector a, const Vector b) { return _mm_cmplt_ps(a, b); }
+    static inline Vector le(const Vector a, const Vector b) { return _mm_cmple_ps(a, b); }
+    static inline Vector gt(const Vector a, const Vector b) { return _mm_cmpgt_ps(a, b); }
+    static inline Vector ge(const Vector a, const Vector b) { return _mm_cmpge_ps(a, b); }
+    static inline Vector eq(const Vector a, const Vector b) { return _mm_cmpeq_ps(a, b); }
+    static inline void storeMask(int32_t * out, const Vector mask)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_and_si128(_mm_castps_si128(mask), _mm_set1_epi32(1)));
+    }
+    static inline void getLanes(const Vector value, float * lanes) { _mm_storeu_ps(lanes, value); }
+};
+
+template <>
+struct Simd<double>
+{
+    typedef __m128d Vector;
+    static const bool   kEnabled = true;
+    static const size_t kWidth = 2;
+
+    static inline Vector load(const double * data) { return _mm_loadu_pd(data); }
+    static inline void store(double * data, const Vector value) { _mm_storeu_pd(data, value); }
+    static inline Vector set(const double value) { return _mm_set1_pd(value); }
+    static inline Vector add(const Vector a, const Vector b) { return _mm_add_pd(a, b); }
+    static inline Vector sub(const Vector a, const Vector b) { return _mm_sub_pd(a, b); }
+    static inline Vector mul(const Vector a, const Vector b) { return _mm_mul_pd(a, b); }
+    static inline Vector min(const Vector a, const Vector b) { return _mm_min_pd(a, b); }
+    static inline Vector max(const Vector a, const Vector b) { return _mm_max_pd(a, b); }
+    static inline Vector lt(const Vector a, const Vector b) { return _mm_cmplt_pd(a, b); }
+    static inline Vector le(const Vector a, const Vector b) { return _mm_cmple_pd(a, b); }
+    static inline Vector gt(const Vector a, const Vector b) { return _mm_cmpgt_pd(a, b); }
+    static inline Vector ge(const Vector a, const Vector b) { return _mm_cmpge_pd(a, b); }
+    static inline Vector eq(const Vector a, const Vector b) { return _mm_cmpeq_pd(a, b); }
+    static inline void storeMask(int32_t * out, const Vector mask)
+    {
+        // low halves of both 64 bit lanes
+        const __m128i packed = _mm_shuffle_epi32(_mm_castpd_si128(mask), _MM_SHUFFLE(2, 0, 2, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm_and_si128(packed, _mm_set1_epi32(1)));
+    }
+    static inline void getLanes(const Vector value, double * lanes) { _mm_storeu_pd(lanes, value); }
+};
+#endif
+
+// int32 arithmetic wraps like the hardware does instead of overflowing
+template <typename T>
+inline T addValues(const T a, const T b)
+{
+    if constexpr (std::is_integral<T>::value) return (T)((uint32_t)a + (uint32_t)b);
+    else return a + b;
+}
+
+template <typename T>
+inline T subValues(const T a, const T b)
+{
+    if constexpr (std::is_integral<T>::value) return (T)((uint32_t)a - (uint32_t)b);
+    else return a - b;
+}
+
+template <typename T>
+inline T mulValues(const T a, const T b)
+{
+    if constexpr (std::is_integral<T>::value) return (T)((uint32_t)a * (uint32_t)b);
+    else return a * b;
+}
+
+struct AddOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::add(a, b); }
+    template <typename T> static inline T scalar(const T a, const T b) { return addValues(a, b); }
+};
+
+struct SubOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::sub(a, b); }
+    template <typename T> static inline T scalar(const T a, const T b) { return subValues(a, b); }
+};
+
+struct MulOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::mul(a, b); }
+    template <typename T> static inline T scalar(const T a, const T b) { return mulValues(a, b); }
+};
+
+struct LtOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::lt(a, b); }
+    template <typename T> static inline bool scalar(const T a, const T b) { return a < b; }
+};
+
+struct LeOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::le(a, b); }
+    template <typename T> static inline bool scalar(const T a, const T b) { return a <= b; }
+};
+
+struct GtOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::gt(a, b); }
+    template <typename T> static inline bool scalar(const T a, const T b) { return a > b; }
+};
+
+struct GeOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::ge(a, b); }
+    template <typename T> static inline bool scalar(const T a, const T b) { return a >= b; }
+};
+
+struct EqOp
+{
+    template <typename S, typename V> static inline V vector(const V a, const V b) { return S::eq(a, b); }
+    template <typename T> static inline bool scalar(const T a, const T b) { return a == b; }
+};
+
+///
+/// struct Operand
+///
+/// Right hand side of an operation, either elements of another buffer or a number.
+///
+template <typename T>
+struct Operand
+{
+    const T * data;         ///< buffer elements, nullptr for a number
+    T         scalar;       ///< number
+
+    inline T get(const size_t index) const { return data ? data[index] : scalar; }
+};
+
+template <typename Op, typename T>
+void binaryKernel(T * out, const Operand<T> & operand, const size_t count)
+{
+    size_t i = 0;
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        if (operand.data)
+        {
+            for (; i + S::kWidth <= count; i += S::kWidth)
+            {
+                S::store(out + i, Op::template vector<S>(S::load(out + i), S::load(operand.data + i)));
+            }
+        }
+        else
+        {
+            const typename S::Vector value = S::set(operand.scalar);
+            for (; i + S::kWidth <= count; i += S::kWidth)
+            {
+                S::store(out + i, Op::template vector<S>(S::load(out + i), value));
+            }
+        }
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = Op::scalar(out[i], operand.get(i));
+    }
+}
+
+template <typename T>
+void fmaKernel(T * out, const Operand<T> & factor, const Operand<T> & addend, const size_t count)
+{
+    size_t i = 0;
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        const typename S::Vector factorValue = S::set(factor.scalar);
+        const typename S::Vector addendValue = S::set(addend.scalar);
+        for (; i + S::kWidth <= count; i += S::kWidth)
+        {
+            const typename S::Vector a = factor.data ? S::load(factor.data + i) : factorValue;
+            const typename S::Vector b = addend.data ? S::load(addend.data + i) : addendValue;
+            S::store(out + i, S::add(S::mul(S::load(out + i), a), b));
+        }
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = addValues(mulValues(out[i], factor.get(i)), addend.get(i));
+    }
+}
+
+template <typename Op, typename T>
+void compareKernel(int32_t * out, const T * data, const Operand<T> & operand, const size_t count)
+{
+    size_t i = 0;
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        const typename S::Vector value = S::set(operand.scalar);
+        for (; i + S::kWidth <= count; i += S::kWidth)
+        {
+            S::storeMask(out + i, Op::template vector<S>(S::load(data + i), operand.data ? S::load(operand.data + i) : value));
+        }
+    }
+    for (; i < count; ++i)
+    {
+        out[i] = Op::scalar(data[i], operand.get(i)) ? 1 : 0;
+    }
+}
+
+// two accumulators hide add latency, lanes are summed at the end
+template <typename T>
+double dotKernel(const T * a, const T * b, const size_t count)
+{
+    size_t i = 0;
+    double total = 0.0;
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        typename S::Vector first = S::set(0);
+        typename S::Vector second = S::set(0);
+        for (; i + 2 * S::kWidth <= count; i += 2 * S::kWidth)
+        {
+            first = S::add(first, S::mul(S::load(a + i), S::load(b + i)));
+            second = S::add(second, S::mul(S::load(a + i + S::kWidth), S::load(b + i + S::kWidth)));
+        }
+        T lanes[S::kWidth];
+        S::getLanes(S::add(first, second), lanes);
+        for (size_t lane = 0; lane < S::kWidth; ++lane)
+        {
+            total += lanes[lane];
+        }
+        for (; i < count; ++i)
+        {
+            total += (double)a[i] * b[i];
+        }
+    }
+    else
+    {
+        int64_t integral = 0;
+        for (; i < count; ++i)
+        {
+            integral += (int64_t)a[i] * b[i];
+        }
+        total = (double)integral;
+    }
+    return total;
+}
+
+template <typename T>
+double sumKernel(const T * data, const size_t count)
+{
+    size_t i = 0;
+    double total = 0.0;
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        typename S::Vector first = S::set(0);
+        typename S::Vector second = S::set(0);
+        for (; i + 2 * S::kWidth <= count; i += 2 * S::kWidth)
+        {
+            first = S::add(first, S::load(data + i));
+            second = S::add(second, S::load(data + i + S::kWidth));
+        }
+        T lanes[S::kWidth];
+        S::getLanes(S::add(first, second), lanes);
+        for (size_t lane = 0; lane < S::kWidth; ++lane)
+        {
+            total += lanes[lane];
+        }
+        for (; i < count; ++i)
+        {
+            total += data[i];
+        }
+    }
+    else
+    {
+        int64_t integral = 0;
+        for (; i < count; ++i)
+        {
+            integral += data[i];
+        }
+        total = (double)integral;
+    }
+    return total;
+}
+
+template <typename T>
+T extremeKernel(const T * data, const size_t count, const bool isMax)
+{
+    size_t i = 0;
+    T result = data[0];
+    if constexpr (Simd<T>::kEnabled)
+    {
+        typedef Simd<T> S;
+        if (count >= S::kWidth)
+        {
+            typename S::Vector value = S::load(data);
+            for (i = S::kWidth; i + S::kWidth <= count; i += S::kWidth)
+            {
+                value = isMax ? S::max(value, S::load(data + i)) : S::min(value, S::load(data + i));
+            }
+            T lanes[S::kWidth];
+            S::getLanes(value, lanes);
+            for (size_t lane = 0; lane < S::kWidth; ++lane)
+            {
+                result = isMax ? std::max(result, lanes[lane]) : std::min(result, lanes[lane]);
+            }
+        }
+    }
+    for (; i < count; ++i)
+    {
+        result = isMax ? std::max(result, data[i]) : std::min(result, data[i]);
+    }
+    return result;
+}
+
+///
+/// call function with a value of the element type
+///
+template <typename Function>
+inline auto visit(const NumBuffer::Type type, Function && function)
+{
+    switch (type)
+    {
+    case NumBuffer::Type::Float32: return function(float());
+    case NumBuffer::Type::Float64: return function(double());
+    default: return function(int32_t());
+    }
+}
+
+inline size_t getElementSize(const NumBuffer::Type type)
+{
+    return visit(type, [](auto value) { return sizeof(value); });
+}
+
+inline NumBuffer::Header * checkBuffer(lua_State * state, const int index)
+{
+    return static_cast<NumBuffer::Header *>(luaL_checkudata(state, index, kMetatableName));
+}
+
+template <typename T>
+inline T * getElements(NumBuffer::Header * buffer)
+{
+    return static_cast<T *>(buffer->data);
+}
+
+template <typename T>
+inline T toElement(const lua_Number number)
+{
+    if constexpr (std::is_integral<T>::value)
+    {
+        // out of range numbers are clamped instead of being undefined behaviour
+        if (!(number >= (lua_Number)std::numeric_limits<int32_t>::min())) return std::numeric_limits<int32_t>::min();
+        if (number >= (lua_Number)std::numeric_limits<int32_t>::max()) return std::numeric_limits<int32_t>::max();
+    }
+    return (T)number;
+}
+
+///
+/// read operand at index: number or buffer of the same type and size
+///
+template <typename T>
+Operand<T> checkOperand(lua_State * state, const int index, const NumBuffer::Header * buffer)
+{
+    Operand<T> operand = { nullptr, T() };
+    if (LUA_TNUMBER == lua_type(state, index))
+    {
+        operand.scalar = toElement<T>(lua_tonumber(state, index));
+        return operand;
+    }
+
+    NumBuffer::Header * other = checkBuffer(state, index);
+    if (other->type != buffer->type || other->count != buffer->count)
+    {
+        luaL_argerror(state, index, "buffer of the same type and size expected");
+    }
+    operand.data = getElements<T>(other);
+    return operand;
+}
+
+template <typename Op>
+int binary(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    visit(buffer->type, [state, buffer](auto value)
+    {
+        typedef decltype(value) T;
+        binaryKernel<Op>(getElements<T>(buffer), checkOperand<T>(state, 2, buffer), buffer->count);
+    });
+    lua_settop(state, 1);
+    return 1;
+}
+
+template <typename Op>
+int compare(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    NumBuffer::Header * mask = nullptr;
+    if (lua_isnoneornil(state, 3))
+    {
+        mask = NumBuffer::push(state, NumBuffer::Type::Int32, buffer->count);
+    }
+    else
+    {
+        mask = checkBuffer(state, 3);
+        if (NumBuffer::Type::Int32 != mask->type || mask->count != buffer->count)
+        {
+            luaL_argerror(state, 3, "i32 buffer of the same size expected");
+        }
+        lua_pushvalue(state, 3);
+    }
+    visit(buffer->type, [state, buffer, mask](auto value)
+    {
+        typedef decltype(value) T;
+        compareKernel<Op>(getElements<int32_t>(mask), getElements<T>(buffer), checkOperand<T>(state, 2, buffer), buffer->count);
+    });
+    return 1;
+}
+
+int luaNew(lua_State * state)
+{
+    const NumBuffer::Type type = (NumBuffer::Type)luaL_checkoption(state, 1, nullptr, kTypeNames);
+    const lua_Number count = luaL_checknumber(state, 2);
+    luaL_argcheck(state, count >= 0 && count <= (lua_Number)(std::numeric_limits<int32_t>::max()), 2, "invalid size");
+    NumBuffer::Header * buffer = NumBuffer::push(state, type, (size_t)count);
+    if (!lua_isnoneornil(state, 3))
+    {
+        const lua_Number fill = luaL_checknumber(state, 3);
+        visit(type, [buffer, fill](auto value)
+        {
+            typedef decltype(value) T;
+            std::fill_n(getElements<T>(buffer), buffer->count, toElement<T>(fill));
+        });
+    }
+    return 1;
+}
+
+int luaFrom(lua_State * state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+    const NumBuffer::Type type = (NumBuffer::Type)luaL_checkoption(state, 2, "f64", kTypeNames);
+    const size_t count = lua_objlen(state, 1);
+    NumBuffer::Header * buffer = NumBuffer::push(state, type, count);
+    visit(type, [state, buffer, count](auto value)
+    {
+        typedef decltype(value) T;
+        T * data = getElements<T>(buffer);
+        for (size_t i = 0; i < count; ++i)
+        {
+            lua_rawgeti(state, 1, (int)i + 1);
+            data[i] = toElement<T>(lua_tonumber(state, -1));
+            lua_pop(state, 1);
+        }
+    });
+    return 1;
+}
+
+int luaIndex(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    if (LUA_TNUMBER == lua_type(state, 2))
+    {
+        const lua_Number position = lua_tonumber(state, 2);
+        if (position >= 1 && position <= (lua_Number)buffer->count)
+        {
+            const size_t index = (size_t)position - 1;
+            visit(buffer->type, [state, buffer, index](auto value)
+            {
+                typedef decltype(value) T;
+                lua_pushnumber(state, (lua_Number)getElements<T>(buffer)[index]);
+            });
+        }
+        else
+        {
+            lua_pushnil(state);
+        }
+        return 1;
+    }
+
+    // methods table is the upvalue
+    lua_pushvalue(state, 2);
+    lua_rawget(state, lua_upvalueindex(1));
+    return 1;
+}
+
+int luaNewIndex(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    const lua_Number position = luaL_checknumber(state, 2);
+    const lua_Number number = luaL_checknumber(state, 3);
+    if (!(position >= 1 && position <= (lua_Number)buffer->count))
+    {
+        return luaL_error(state, "index %f is out of buffer of %d elements", position, (int)buffer->count);
+    }
+
+    const size_t index = (size_t)position - 1;
+    visit(buffer->type, [buffer, index, number](auto value)
+    {
+        typedef decltype(value) T;
+        getElements<T>(buffer)[index] = toElement<T>(number);
+    });
+    return 0;
+}
+
+int luaLen(lua_State * state)
+{
+    lua_pushinteger(state, (lua_Integer)checkBuffer(state, 1)->count);
+    return 1;
+}
+
+int luaType(lua_State * state)
+{
+    lua_pushstring(state, kTypeNames[(int)checkBuffer(state, 1)->type]);
+    return 1;
+}
+
+int luaFill(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    const lua_Number number = luaL_checknumber(state, 2);
+    visit(buffer->type, [buffer, number](auto value)
+    {
+        typedef decltype(value) T;
+        std::fill_n(getElements<T>(buffer), buffer->count, toElement<T>(number));
+    });
+    lua_settop(state, 1);
+    return 1;
+}
+
+int luaCopy(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    NumBuffer::Header * copy = NumBuffer::push(state, buffer->type, buffer->count);
+    memcpy(copy->data, buffer->data, buffer->count * getElementSize(buffer->type));
+    return 1;
+}
+
+int luaToTable(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    lua_createtable(state, (int)buffer->count, 0);
+    visit(buffer->type, [state, buffer](auto value)
+    {
+        typedef decltype(value) T;
+        const T * data = getElements<T>(buffer);
+        for (size_t i = 0; i < buffer->count; ++i)
+        {
+            lua_pushnumber(state, (lua_Number)data[i]);
+            lua_rawseti(state, -2, (int)i + 1);
+        }
+    });
+    return 1;
+}
+
+int luaAdd(lua_State * state)
+{
+    return binary<AddOp>(state);
+}
+
+int luaSub(lua_State * state)
+{
+    return binary<SubOp>(state);
+}
+
+int luaMul(lua_State * state)
+{
+    return binary<MulOp>(state);
+}
+
+int luaFma(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    visit(buffer->type, [state, buffer](auto value)
+    {
+        typedef decltype(value) T;
+        fmaKernel(getElements<T>(buffer), checkOperand<T>(state, 2, buffer), checkOperand<T>(state, 3, buffer), buffer->count);
+    });
+    lua_settop(state, 1);
+    return 1;
+}
+
+int luaDot(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    NumBuffer::Header * other = checkBuffer(state, 2);
+    luaL_argcheck(state, other->type == buffer->type && other->count == buffer->count, 2, "buffer of the same type and size expected");
+    lua_pushnumber(state, visit(buffer->type, [buffer, other](auto value)
+    {
+        typedef decltype(value) T;
+        return dotKernel(getElements<T>(buffer), getElements<T>(other), buffer->count);
+    }));
+    return 1;
+}
+
+int luaSum(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    lua_pushnumber(state, visit(buffer->type, [buffer](auto value)
+    {
+        typedef decltype(value) T;
+        return sumKernel(getElements<T>(buffer), buffer->count);
+    }));
+    return 1;
+}
+
+int pushExtreme(lua_State * state, const bool isMax)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    if (0 == buffer->count)
+    {
+        lua_pushnil(state);
+        return 1;
+    }
+    lua_pushnumber(state, visit(buffer->type, [buffer, isMax](auto value)
+    {
+        typedef decltype(value) T;
+        return (lua_Number)extremeKernel(getElements<T>(buffer), buffer->count, isMax);
+    }));
+    return 1;
+}
+
+int luaMin(lua_State * state)
+{
+    return pushExtreme(state, false);
+}
+
+int luaMax(lua_State * state)
+{
+    return pushExtreme(state, true);
+}
+
+int luaLt(lua_State * state)
+{
+    return compare<LtOp>(state);
+}
+
+int luaLe(lua_State * state)
+{
+    return compare<LeOp>(state);
+}
+
+int luaGt(lua_State * state)
+{
+    return compare<GtOp>(state);
+}
+
+int luaGe(lua_State * state)
+{
+    return compare<GeOp>(state);
+}
+
+int luaEq(lua_State * state)
+{
+    return compare<EqOp>(state);
+}
+
+///
+/// check that indices buffer matches the buffer and every index fits into other
+///
+const int32_t * checkIndices(lua_State * state, const int index, const NumBuffer::Header * buffer, const NumBuffer::Header * other)
+{
+    NumBuffer::Header * indices = checkBuffer(state, index);
+    luaL_argcheck(state, NumBuffer::Type::Int32 == indices->type && indices->count == buffer->count, index, "i32 buffer of the same size expected");
+    const int32_t * data = getElements<int32_t>(indices);
+    for (size_t i = 0; i < indices->count; ++i)
+    {
+        if (data[i] < 1 || (size_t)data[i] > other->count)
+        {
+            luaL_error(state, "index %d at position %d is out of buffer of %d elements", (int)data[i], (int)i + 1, (int)other->count);
+        }
+    }
+    return data;
+}
+
+int luaGather(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    NumBuffer::Header * source = checkBuffer(state, 2);
+    luaL_argcheck(state, source->type == buffer->type, 2, "buffer of the same type expected");
+    const int32_t * indices = checkIndices(state, 3, buffer, source);
+    visit(buffer->type, [buffer, source, indices](auto value)
+    {
+        typedef decltype(value) T;
+        T * out = getElements<T>(buffer);
+        const T * data = getElements<T>(source);
+        for (size_t i = 0; i < buffer->count; ++i)
+        {
+            out[i] = data[indices[i] - 1];
+        }
+    });
+    lua_settop(state, 1);
+    return 1;
+}
+
+int luaScatter(lua_State * state)
+{
+    NumBuffer::Header * buffer = checkBuffer(state, 1);
+    NumBuffer::Header * target = checkBuffer(state, 2);
+    luaL_argcheck(state, target->type == buffer->type, 2, "buffer of the same type expected");
+    const int32_t * indices = checkIndices(state, 3, buffer, target);
+    visit(buffer->type, [buffer, target, indices](auto value)
+    {
+        typedef decltype(value) T;
+        const T * data = getElements<T>(buffer);
+        T * out = getElements<T>(target);
+        for (size_t i = 0; i < buffer->count; ++i)
+        {
+            out[indices[i] - 1] = data[i];
+        }
+    });
+    lua_settop(state, 2);
+    return 1;
+}
+
+void pushMetatable(lua_State * state)
+{
+    if (0 != luaL_newmetatable(state, kMetatableName))
+    {
+        static const luaL_reg methods[] =
+        {
+            { "type", luaType },
+            { "fill", luaFill },
+            { "copy", luaCopy },
+            { "totable", luaToTable },
+            { "add", luaAdd },
+            { "sub", luaSub },
+            { "mul", luaMul },
+            { "fma", luaFma },
+            { "dot", luaDot },
+            { "sum", luaSum },
+            { "min", luaMin },
+            { "max", luaMax },
+            { "lt", luaLt },
+            { "le", luaLe },
+            { "gt", luaGt },
+            { "ge", luaGe },
+            { "eq", luaEq },
+            { "gather", luaGather },
+            { "scatter", luaScatter },
+            { nullptr, nullptr }
+        };
+        lua_newtable(state);
+        for (const luaL_reg * reg = methods; reg->name; ++reg)
+        {
+            lua_pushcfunction(state, reg->func);
+            lua_setfield(state, -2, reg->name);
+        }
+        lua_pushcclosure(state, luaIndex, 1);
+        lua_setfield(state, -2, "__index");
+        lua_pushcfunction(state, luaNewIndex);
+        lua_setfield(state, -2, "__newindex");
+        lua_pushcfunction(state, luaLen);
+        lua_setfield(state, -2, "__len");
+        lua_pushboolean(state, 0);
+        lua_setfield(state, -2, "__metatable");
+    }
+}
+} // anonymous
+
+NumBuffer::NumBuffer()
+    : m_reference(LUA_NOREF)
+    , m_header(nullptr)
+{
+}
+
+NumBuffer::NumBuffer(const Type type, const size_t count)
+    : m_reference(LUA_NOREF)
+    , m_header(nullptr)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    m_header = push(state, type, count);
+    m_reference = stack.popReference("NumBuffer");
+}
+
+NumBuffer::NumBuffer(lua_State * state, const int index)
+    : m_reference(LUA_NOREF)
+    , m_header(toBuffer(state, index))
+{
+    if (!m_header) return;
+
+    // value may sit on a coroutine, references are made on the main state
+    Stack stack;
+    lua_pushvalue(state, index);
+    lua_xmove(state, stack.getState(), 1);
+    m_reference = stack.popReference("NumBuffer");
+}
+
+NumBuffer::NumBuffer(const NumBuffer & buffer)
+    : m_reference(LUA_NOREF)
+    , m_header(buffer.m_header)
+{
+    if (m_header)
+    {
+        Stack stack;
+        m_reference = stack.copyReference(buffer.m_reference);
+    }
+}
+
+NumBuffer::NumBuffer(NumBuffer && buffer)
+    : m_reference(buffer.m_reference)
+    , m_header(buffer.m_header)
+{
+    buffer.m_reference = LUA_NOREF;
+    buffer.m_header = nullptr;
+}
+
+NumBuffer::~NumBuffer()
+{
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
+}
+
+NumBuffer & NumBuffer::operator=(const NumBuffer & buffer)
+{
+    if (this == &buffer) return *this;
+
+    Stack stack;
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        stack.deleteReference(m_reference);
+    }
+    m_header = buffer.m_header;
+    m_reference = m_header ? stack.copyReference(buffer.m_reference) : LUA_NOREF;
+    return *this;
+}
+
+NumBuffer & NumBuffer::operator=(NumBuffer && buffer)
+{
+    if (this == &buffer) return *this;
+
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
+    m_reference = buffer.m_reference;
+    m_header = buffer.m_header;
+    buffer.m_reference = LUA_NOREF;
+    buffer.m_header = nullptr;
+    return *this;
+}
+
+void NumBuffer::makeGlobal(const char * name) const
+{
+    if (!m_header) return;
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    lua_getref(state, m_reference);
+    lua_setglobal(state, name);
+}
+
+void NumBuffer::loadLibs(const char * id)
+{
+    static const luaL_reg regs[] =
+    {
+        { "new", luaNew },
+        { "from", luaFrom },
+        { nullptr, nullptr }
+    };
+
+    Stack stack;
+    stack.loadLibs(id, regs);
+}
+
+NumBuffer::Header * NumBuffer::push(lua_State * state, const Type type, const size_t count)
+{
+    const size_t bytes = count * getElementSize(type);
+    char * memory = static_cast<char *>(lua_newuserdata(state, sizeof(Header) + kAlignment + bytes));
+    Header * header = reinterpret_cast<Header *>(memory);
+    const uintptr_t data = ((uintptr_t)(memory + sizeof(Header)) + kAlignment - 1) & ~(uintptr_t)(kAlignment - 1);
+    header->type = type;
+    header->count = count;
+    header->data = reinterpret_cast<void *>(data);
+    memset(header->data, 0, bytes);
+
+    pushMetatable(state);
+    lua_setmetatable(state, -2);
+    return header;
+}
+
+NumBuffer::Header * NumBuffer::toBuffer(lua_State * state, const int index)
+{
+    void * memory = lua_touserdata(state, index);
+    if (!memory || !lua_getmetatable(state, index)) return nullptr;
+
+    luaL_getmetatable(state, kMetatableName);
+    const bool isBuffer = 0 != lua_rawequal(state, -1, -2);
+    lua_pop(state, 2);
+    return isBuffer ? static_cast<Header *>(memory) : nullptr;
+}
+} // lua
@@ -0,0 +1,152 @@
+#ifndef STREN_LUA_NUM_BUFFER_H
+#define STREN_LUA_NUM_BUFFER_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+namespace lua
+{
+///
+/// class NumBuffer
+///
+/// Typed numeric array living in a lua userdata. C++ reads and writes elements in place through
+/// getData or spans, scripts index it 1-based like a table and run bulk operations in native loops
+/// vectorized with SSE2 where available:
+///     local a = numbuffer.new("f32", 1024)        -- "f32", "f64" or "i32", optional fill value
+///     local b = numbuffer.from({ 1, 2, 3 }, "f64")
+///     a:add(b) a:mul(2) a:fma(b, 1)               -- in place: a = a * b + 1, operands are buffers or numbers
+///     a:sum() a:dot(b) a:min() a:max()
+///     local mask = a:lt(0.5)                      -- i32 buffer of 0 and 1, also le, gt, ge, eq
+///     a:gather(source, indices) a:scatter(target, indices)  -- indices is an i32 buffer of 1-based positions
+/// Other methods: fill, copy, totable, type. Data pointer stays valid while the handle is alive.
+///
+class NumBuffer
+{
+public:
+    ///
+    /// element types
+    ///
+    enum class Type : uint8_t
+    {
+        Float32,
+        Float64,
+        Int32
+    };
+    ///
+    /// struct Header
+    ///
+    /// Start of the userdata block, elements follow aligned to 16 bytes.
+    ///
+    struct Header
+    {
+        Type   type;        ///< element type
+        size_t count;       ///< amount of elements
+        void * data;        ///< first element
+    };
+private:
+    int      m_reference;   ///< reference anchoring the userdata
+    Header * m_header;      ///< userdata block, lua 5.1 never moves it
+public:
+    ///
+    /// Constructor, invalid buffer
+    ///
+    NumBuffer();
+    ///
+    /// Constructor, new zeroed buffer
+    ///
+    NumBuffer(const Type type, const size_t count);
+    ///
+    /// Constructor, buffer from stack index of any lua state, invalid if value is not a buffer
+    ///
+    NumBuffer(lua_State * state, const int index);
+    ///
+    /// Copy constructor, shares the userdata
+    ///
+    NumBuffer(const NumBuffer & buffer);
+    ///
+    /// Move constructor
+    ///
+    NumBuffer(NumBuffer && buffer);
+    ///
+    /// Destructor
+    ///
+    ~NumBuffer();
+    ///
+    /// share another buffer
+    ///
+    NumBuffer & operator=(const NumBuffer & buffer);
+    ///
+    /// take another buffer
+    ///
+    NumBuffer & operator=(NumBuffer && buffer);
+    ///
+    /// check if buffer exists
+    ///
+    inline bool isValid() const { return nullptr != m_header; }
+    ///
+    /// get element type
+    ///
+    inline Type getType() const { return m_header ? m_header->type : Type::Float64; }
+    ///
+    /// get amount of elements
+    ///
+    inline size_t getSize() const { return m_header ? m_header->count : 0; }
+    ///
+    /// get reference to the userdata
+    ///
+    inline int getRef() const { return m_reference; }
+    ///
+    /// get elements, nullptr if T does not match element type
+    ///
+    template <typename T>
+    T * getData() const
+    {
+        return m_header && getTypeOf<std::remove_const_t<T>>() == m_header->type ? static_cast<T *>(m_header->data) : nullptr;
+    }
+#if defined(__cpp_lib_span)
+    ///
+    /// get elements, empty if T does not match element type
+    ///
+    template <typename T>
+    std::span<T> getSpan() const
+    {
+        T * data = getData<T>();
+        return data ? std::span<T>(data, m_header->count) : std::span<T>();
+    }
+#endif
+    ///
+    /// make buffer global
+    ///
+    void makeGlobal(const char * name) const;
+    ///
+    /// register lua api in the global table with the given name
+    ///
+    static void loadLibs(const char * id = "numbuffer");
+    ///
+    /// create buffer on top of the stack of any lua state and return its header
+    ///
+    static Header * push(lua_State * state, const Type type, const size_t count);
+    ///
+    /// get header of the buffer at index, nullptr if value is not a buffer
+    ///
+    static Header * toBuffer(lua_State * state, const int index);
+    ///
+    /// get element type of T
+    ///
+    template <typename T>
+    static constexpr Type getTypeOf()
+    {
+        static_assert(std::is_same<T, float>::value || std::is_same<T, double>::value || std::is_same<T, int32_t>::value,
+            "NumBuffer holds float, double or int32_t");
+        return std::is_same<T, float>::value ? Type::Float32 : (std::is_same<T, double>::value ? Type::Float64 : Type::Int32);
+    }
+};
+} // lua
+
+#endif // STREN_LUA_NUM_BUFFER_H
@@ -0,0 +1,209 @@
+#include "lua_reference_tracker.h"
+#include "lua_stack.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+namespace lua
+{
+namespace
+{
+///
+/// struct LiveReference
+///
+struct LiveReference
+{
+    size_t   site;                  ///< index of the site which created the reference
+    uint64_t sequence;              ///< creation order
+};
+
+///
+/// struct TrackerState
+///
+struct TrackerState
+{
+    bool                                                     isRunning = false;         ///< true if tracking
+    bool                                                     assertOnImbalance = false; ///< assert on scope exit with changed stack
+    const char *                                             scopeSite = nullptr;       ///< innermost scope call site
+    uint64_t                                                 sequence = 0;              ///< amount of created references
+    ReferenceTracker::Counters                               counters = {};             ///< totals
+    std::vector<ReferenceTracker::Site>                      sites;                     ///< all known sites
+    std::map<std::pair<const char *, const char *>, size_t>  siteIndices;               ///< scope and call site to index in sites
+    std::unordered_map<int, LiveReference>                   live;                      ///< tracked live references
+};
+
+TrackerState & getState()
+{
+    static TrackerState state;
+    return state;
+}
+
+size_t getSite(TrackerState & state, const char * scopeSite, const char * site)
+{
+    const auto key = std::make_pair(scopeSite, site);
+    auto it = state.siteIndices.find(key);
+    if (it != state.siteIndices.end()) return it->second;
+
+    ReferenceTracker::Site info = {};
+    if (scopeSite && site)
+    {
+        info.name = std::string(scopeSite) + " | " + site;
+    }
+    else
+    {
+        info.name = scopeSite ? scopeSite : site;
+    }
+    state.sites.push_back(info);
+    state.siteIndices.emplace(key, state.sites.size() - 1);
+    return state.sites.size() - 1;
+}
+
+void sortByLive(std::vector<ReferenceTracker::Site> & sites)
+{
+    std::sort(sites.begin(), sites.end(),
+        [](const ReferenceTracker::Site & a, const ReferenceTracker::Site & b) { return a.live > b.live; });
+}
+} // anonymous
+
+// class ReferenceTracker::Scope
+ReferenceTracker::Scope::Scope(const char * site)
+    : m_previous(getState().scopeSite)
+    , m_site(site)
+    , m_top(-1)
+{
+    TrackerState & state = getState();
+    state.scopeSite = site;
+    if (state.isRunning)
+    {
+        Stack stack;
+        m_top = stack.getSize();
+    }
+}
+
+ReferenceTracker::Scope::~Scope()
+{
+    TrackerState & state = getState();
+    state.scopeSite = m_previous;
+    if (m_top < 0 || !state.isRunning) return;
+
+    Stack stack;
+    if (stack.getSize() != m_top)
+    {
+        ++state.counters.imbalances;
+        ++state.sites[getSite(state, m_site, nullptr)].imbalances;
+        if (state.assertOnImbalance)
+        {
+            const std::string message = std::string("[lua] stack is not balanced at exit of ") + m_site;
+            stren::assertMessage(false, message.c_str());
+        }
+    }
+}
+
+// class ReferenceTracker
+void ReferenceTracker::start(const bool assertOnImbalance)
+{
+    reset();
+    TrackerState & state = getState();
+    state.isRunning = true;
+    state.assertOnImbalance = assertOnImbalance;
+}
+
+void ReferenceTracker::stop()
+{
+    getState().isRunning = false;
+}
+
+bool ReferenceTracker::isRunning()
+{
+    return getState().isRunning;
+}
+
+void ReferenceTracker::reset()
+{
+    TrackerState & state = getState();
+    state.sequence = 0;
+    state.counters = Counters();
+    state.sites.clear();
+    state.siteIndices.clear();
+    state.live.clear();
+}
+
+ReferenceTracker::Counters ReferenceTracker::getCounters()
+{
+    TrackerState & state = getState();
+    Counters counters = state.counters;
+    counters.live = state.live.size();
+    return counters;
+}
+
+void ReferenceTracker::getSites(std::vector<Site> & sites)
+{
+    sites = getState().sites;
+    sortByLive(sites);
+}
+
+uint64_t ReferenceTracker::mark()
+{
+    return getState().sequence;
+}
+
+void ReferenceTracker::getLeaks(const uint64_t mark, std::vector<Site> & sites)
+{
+    TrackerState & state = getState();
+    std::map<size_t, size_t> counts;
+    for (const auto & reference : state.live)
+    {
+        if (reference.second.sequence > mark)
+        {
+            ++counts[reference.second.site];
+        }
+    }
+
+    sites.clear();
+    sites.reserve(counts.size());
+    for (const auto & count : counts)
+    {
+        sites.push_back(state.sites[count.first]);
+        sites.back().live = count.second;
+    }
+    sortByLive(sites);
+}
+
+void ReferenceTracker::onCreate(const int reference, const char * site)
+{
+    TrackerState & state = getState();
+    if (!state.isRunning || reference < 0) return;
+
+    const size_t index = getSite(state, state.scopeSite, site);
+    ++state.sites[index].live;
+    ++state.sites[index].created;
+    ++state.counters.created;
+
+    // registry reuses slots, an entry still here belongs to a reference released behind the tracker's back
+    const LiveReference live = { index, ++state.sequence };
+    auto result = state.live.emplace(reference, live);
+    if (!result.second)
+    {
+        --state.sites[result.first->second.site].live;
+        result.first->second = live;
+    }
+}
+
+void ReferenceTracker::onRelease(const int reference)
+{
+    TrackerState & state = getState();
+    if (!state.isRunning) return;
+
+    auto it = state.live.find(reference);
+    if (it == state.live.end()) return;
+
+    Site & site = state.sites[it->second.site];
+    --site.live;
+    ++site.released;
+    ++state.counters.released;
+    state.live.erase(it);
+}
+} // lua
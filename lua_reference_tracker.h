@@ -0,0 +1,113 @@
+#ifndef STREN_LUA_REFERENCE_TRACKER_H
+#define STREN_LUA_REFERENCE_TRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+///
+/// class ReferenceTracker
+///
+/// Counts live registry references per creation site to find leaked tables, functions and strings,
+/// and checks that instrumented scopes leave the lua stack as they found it. A site is the wrapper call
+/// which created the reference, prefixed with the innermost Scope if there is one:
+///     ReferenceTracker::start();
+///     const uint64_t mark = ReferenceTracker::mark();
+///     { ReferenceTracker::Scope scope("Inventory::update"); ... }
+///     ReferenceTracker::getLeaks(mark, sites);  // "Inventory::update | Stack::get" - 3 live
+/// When tracker is stopped every hook costs a single check.
+///
+class ReferenceTracker
+{
+public:
+    ///
+    /// struct Site
+    ///
+    struct Site
+    {
+        std::string name;           ///< "scope | wrapper call"
+        size_t      live;           ///< references created at the site and not released yet
+        size_t      created;        ///< references created at the site since start
+        size_t      released;       ///< references created at the site and released since start
+        size_t      imbalances;     ///< scope exits with changed stack size
+    };
+    ///
+    /// struct Counters
+    ///
+    struct Counters
+    {
+        size_t created;             ///< references created since start
+        size_t released;            ///< tracked references released since start
+        size_t live;                ///< tracked references alive
+        size_t imbalances;          ///< scope exits with changed stack size
+    };
+    ///
+    /// class Scope
+    ///
+    /// Attributes references created while the scope is alive to the given call site
+    /// and checks stack size at exit.
+    ///
+    class Scope
+    {
+    private:
+        const char * m_previous;    ///< call site of the outer scope
+        const char * m_site;        ///< call site of the scope
+        int          m_top;         ///< stack size at entry, -1 if tracker is stopped
+    public:
+        ///
+        /// Constructor, site should be a string literal
+        ///
+        Scope(const char * site);
+        ///
+        /// Destructor
+        ///
+        ~Scope();
+    };
+public:
+    ///
+    /// start tracking, drops previously collected data; with assertOnImbalance scope exit with changed stack asserts
+    ///
+    static void start(const bool assertOnImbalance = false);
+    ///
+    /// stop tracking, collected data is kept until the next start
+    ///
+    static void stop();
+    ///
+    /// check if tracker is running
+    ///
+    static bool isRunning();
+    ///
+    /// drop collected data
+    ///
+    static void reset();
+    ///
+    /// get totals
+    ///
+    static Counters getCounters();
+    ///
+    /// get sites sorted by live references
+    ///
+    static void getSites(std::vector<Site> & sites);
+    ///
+    /// get current position in the sequence of created references
+    ///
+    static uint64_t mark();
+    ///
+    /// get sites of references created after mark and still alive, live is the amount of such references
+    ///
+    static void getLeaks(const uint64_t mark, std::vector<Site> & sites);
+    ///
+    /// register reference created by call site, site should be a string literal
+    ///
+    static void onCreate(const int reference, const char * site);
+    ///
+    /// register reference release
+    ///
+    static void onRelease(const int reference);
+};
+} // lua
+
+#endif // STREN_LUA_REFERENCE_TRACKER_H
@@ -0,0 +1,106 @@
+#include "lua_release_queue.h"
+#include "lua_reference_tracker.h"
+
+#include <atomic>
+
+namespace lua
+{
+namespace
+{
+///
+/// struct Node
+///
+struct Node
+{
+    int    reference;       ///< released reference
+    Node * next;            ///< previously queued node
+};
+
+std::atomic<Node *>          head(nullptr);         ///< last queued node
+std::atomic<size_t>          pendingCount(0);       ///< amount of queued nodes
+std::atomic<std::thread::id> ownerThread;           ///< thread owning the VM
+
+// takes whole list at once, so pushes never race with partial pops
+Node * takeAll()
+{
+    Node * node = head.exchange(nullptr, std::memory_order_acquire);
+    size_t count = 0;
+    for (Node * it = node; it; it = it->next)
+    {
+        ++count;
+    }
+    pendingCount.fetch_sub(count, std::memory_order_relaxed);
+    return node;
+}
+} // anonymous
+
+void ReleaseQueue::setOwner(const std::thread::id owner)
+{
+    ownerThread.store(owner, std::memory_order_relaxed);
+}
+
+bool ReleaseQueue::isOwner()
+{
+    return ownerThread.load(std::memory_order_relaxed) == std::this_thread::get_id();
+}
+
+void ReleaseQueue::push(const int reference)
+{
+    if (LUA_NOREF == reference || LUA_REFNIL == reference) return;
+    // references of a destroyed VM must not be released in the next one
+    if (std::thread::id() == ownerThread.load(std::memory_order_relaxed)) return;
+
+    Node * node = new Node{ reference, head.load(std::memory_order_relaxed) };
+    while (!head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    pendingCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool ReleaseQueue::defer(const int reference)
+{
+    if (isOwner()) return false;
+
+    push(reference);
+    return true;
+}
+
+bool ReleaseQueue::hasPending()
+{
+    return nullptr != head.load(std::memory_order_relaxed);
+}
+
+size_t ReleaseQueue::getPendingCount()
+{
+    return pendingCount.load(std::memory_order_relaxed);
+}
+
+size_t ReleaseQueue::drain(lua_State * state)
+{
+    if (!state || !hasPending()) return 0;
+
+    size_t count = 0;
+    Node * node = takeAll();
+    while (node)
+    {
+        Node * next = node->next;
+        ReferenceTracker::onRelease(node->reference);
+        lua_unref(state, node->reference);
+        delete node;
+        node = next;
+        ++count;
+    }
+    return count;
+}
+
+void ReleaseQueue::clear()
+{
+    Node * node = takeAll();
+    while (node)
+    {
+        Node * next = node->next;
+        delete node;
+        node = next;
+    }
+}
+} // lua
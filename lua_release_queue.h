@@ -0,0 +1,60 @@
+#ifndef STREN_LUA_RELEASE_QUEUE_H
+#define STREN_LUA_RELEASE_QUEUE_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <thread>
+
+namespace lua
+{
+///
+/// class ReleaseQueue
+///
+/// Registry references released off the thread owning the lua virtual machine. Stack::deleteReference
+/// called on another thread pushes the reference onto a lock-free list instead of touching the VM.
+/// Table, Function, Key and NumBuffer handles check the owner with defer before building a Stack, so
+/// they may be destroyed and move-assigned anywhere; creating and copying them needs the owner thread.
+/// The owning thread releases queued references in one batch at safe points: construction of the next
+/// Stack and garbage collection. The owner is the thread which created the VM, call setOwner when the
+/// VM moves to another thread. References released while there is no VM are dropped.
+///
+class ReleaseQueue
+{
+public:
+    ///
+    /// make thread the owner of the VM
+    ///
+    static void setOwner(const std::thread::id owner = std::this_thread::get_id());
+    ///
+    /// check if calling thread owns the VM
+    ///
+    static bool isOwner();
+    ///
+    /// queue reference, safe on any thread
+    ///
+    static void push(const int reference);
+    ///
+    /// queue reference if calling thread does not own the VM, returns false if caller has to release it
+    ///
+    static bool defer(const int reference);
+    ///
+    /// check if anything is queued, safe on any thread
+    ///
+    static bool hasPending();
+    ///
+    /// get amount of queued references
+    ///
+    static size_t getPendingCount();
+    ///
+    /// release queued references, owner thread only; returns amount of released references
+    ///
+    static size_t drain(lua_State * state);
+    ///
+    /// forget queued references without releasing them, used when VM is destroyed
+    ///
+    static void clear();
+};
+} // lua
+
+#endif // STREN_LUA_RELEASE_QUEUE_H
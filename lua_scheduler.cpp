@@ -0,0 +1,400 @@
+#include "lua_scheduler.h"
+#include "lua_function.h"
+#include "lua_reference_tracker.h"
+
+#include "utils.h"
+
+namespace lua
+{
+namespace
+{
+const ValueVector kNoResults;
+const std::string kNoError;
+} // namespace
+
+Scheduler::Scheduler()
+    : m_lastTask(kInvalidTask)
+    , m_time(0.0)
+    , m_lastFuture(0)
+{
+}
+
+Scheduler::~Scheduler()
+{
+    for (auto & it : m_tasks)
+    {
+        releaseThread(it.second);
+    }
+}
+
+void Scheduler::loadLibs(const char * id)
+{
+    static const luaL_reg regs[] =
+    {
+        { "yield", luaYield },
+        { "sleep", luaSleep },
+        { "wait", luaWait },
+        { "spawn", luaSpawn },
+        { nullptr, nullptr }
+    };
+
+    Stack stack;
+    stack.loadLibs(id, regs, this);
+}
+
+Scheduler::TaskId Scheduler::start(const Function & function, const ValueVector & params, const bool keepResults)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return kInvalidTask;
+
+    lua_getref(state, function.getRef());
+    if (!lua_isfunction(state, -1))
+    {
+        stack.pop(1);
+        stren::assertMessage(false, "[lua] function not found");
+        return kInvalidTask;
+    }
+
+    const void * key = Budget::identify(state, -1);
+    lua_State * thread = lua_newthread(state);
+    const int reference = stack.popReference("Scheduler::start");
+    lua_xmove(state, thread, 1);
+
+    const TaskId id = ++m_lastTask;
+    Task & task = m_tasks[id];
+    task.thread = thread;
+    task.function = key;
+    task.reference = reference;
+    task.state = TaskState::Ready;
+    task.keepResults = keepResults;
+    task.argsCount = 0;
+    pushValues(task, params);
+
+    m_threads[thread] = id;
+    m_runQueue.push_back(id);
+    return id;
+}
+
+size_t Scheduler::update(const double dt, const size_t maxResumes)
+{
+    m_time += dt;
+
+    while (!m_sleepers.empty() && m_sleepers.top().time <= m_time)
+    {
+        const TaskId id = m_sleepers.top().task;
+        m_sleepers.pop();
+
+        auto it = m_tasks.find(id);
+        if (it != m_tasks.end() && TaskState::Sleeping == it->second.state)
+        {
+            it->second.state = TaskState::Ready;
+            m_runQueue.push_back(id);
+        }
+    }
+
+    for (size_t i = 0; i < m_futures.size();)
+    {
+        if (std::future_status::ready == m_futures[i].future.wait_for(std::chrono::seconds(0)))
+        {
+            const PendingFuture future = m_futures[i];
+            m_futures[i] = m_futures.back();
+            m_futures.pop_back();
+            signal(future.event, future.future.get());
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    // tasks yielded during this update are resumed on the next one
+    size_t count = m_runQueue.size();
+    if (maxResumes > 0 && count > maxResumes)
+    {
+        count = maxResumes;
+    }
+
+    size_t resumed = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const TaskId id = m_runQueue.front();
+        m_runQueue.pop_front();
+
+        auto it = m_tasks.find(id);
+        if (it != m_tasks.end() && TaskState::Ready == it->second.state)
+        {
+            resume(id);
+            ++resumed;
+        }
+    }
+    return resumed;
+}
+
+void Scheduler::signal(const std::string & event, const ValueVector & values)
+{
+    auto waiters = m_waiters.find(event);
+    if (waiters == m_waiters.end()) return;
+
+    std::vector<TaskId> tasks;
+    tasks.swap(waiters->second);
+    m_waiters.erase(waiters);
+
+    for (const TaskId id : tasks)
+    {
+        auto it = m_tasks.find(id);
+        if (it != m_tasks.end() && TaskState::Waiting == it->second.state)
+        {
+            pushValues(it->second, values);
+            it->second.state = TaskState::Ready;
+            m_runQueue.push_back(id);
+        }
+    }
+}
+
+std::string Scheduler::watch(const std::shared_future<ValueVector> & future)
+{
+    PendingFuture pending;
+    pending.event = "future:" + std::to_string(++m_lastFuture);
+    pending.future = future;
+    m_futures.push_back(pending);
+    return pending.event;
+}
+
+Scheduler::TaskState Scheduler::getState(const TaskId task) const
+{
+    auto it = m_tasks.find(task);
+    return it != m_tasks.end() ? it->second.state : TaskState::Unknown;
+}
+
+const ValueVector & Scheduler::getResults(const TaskId task) const
+{
+    auto it = m_tasks.find(task);
+    return it != m_tasks.end() ? it->second.results : kNoResults;
+}
+
+const std::string & Scheduler::getError(const TaskId task) const
+{
+    auto it = m_tasks.find(task);
+    return it != m_tasks.end() ? it->second.error : kNoError;
+}
+
+void Scheduler::release(const TaskId task)
+{
+    auto it = m_tasks.find(task);
+    if (it != m_tasks.end())
+    {
+        releaseThread(it->second);
+        m_tasks.erase(it);
+    }
+}
+
+bool Scheduler::isRunning(const TaskId task) const
+{
+    const TaskState state = getState(task);
+    return TaskState::Ready == state || TaskState::Sleeping == state || TaskState::Waiting == state;
+}
+
+void Scheduler::addContinuation(const TaskId task, void * handle)
+{
+    auto it = m_tasks.find(task);
+    if (it != m_tasks.end())
+    {
+        it->second.continuations.push_back(handle);
+    }
+}
+
+void Scheduler::pushValues(Task & task, const ValueVector & values)
+{
+    if (values.empty()) return;
+
+    Stack stack;
+    for (const Value & value : values)
+    {
+        stack.push(value);
+    }
+    lua_xmove(stack.getState(), task.thread, static_cast<int>(values.size()));
+    task.argsCount += static_cast<int>(values.size());
+}
+
+void Scheduler::resume(const TaskId id)
+{
+    lua_State * thread = nullptr;
+    const void * function = nullptr;
+    int argsCount = 0;
+    {
+        Task & task = m_tasks[id];
+        thread = task.thread;
+        function = task.function;
+        argsCount = task.argsCount;
+        task.argsCount = 0;
+    }
+
+    int status = 0;
+    bool isAborted = false;
+    {
+        Budget::Scope budgetScope(thread, m_budget, function);
+        status = lua_resume(thread, argsCount);
+        isAborted = budgetScope.isAborted();
+    }
+
+    // the task might be released while it was running
+    auto it = m_tasks.find(id);
+    if (it == m_tasks.end()) return;
+
+    Task & task = it->second;
+    if (LUA_YIELD == status)
+    {
+        // drop values passed to yield, only scheduler functions decide what the task waits for
+        lua_settop(thread, 0);
+        if (TaskState::Ready == task.state)
+        {
+            m_runQueue.push_back(id);
+        }
+    }
+    else if (0 == status)
+    {
+        Stack stack;
+        const int count = lua_gettop(thread);
+        lua_xmove(thread, stack.getState(), count);
+        task.results.reserve(count);
+        for (int i = count; i > 0; --i)
+        {
+            task.results.push_back(stack.get(-i));
+        }
+        stack.pop(count);
+        complete(id, TaskState::Finished);
+    }
+    else
+    {
+        if (1 == lua_isstring(thread, -1))
+        {
+            task.error = lua_tostring(thread, -1);
+        }
+        else
+        {
+            task.error = "Lua task crashed";
+        }
+        const std::string error = task.error;
+        complete(id, TaskState::Failed);
+        if (!isAborted)
+        {
+            stren::assertMessage(false, error.c_str());
+        }
+    }
+}
+
+void Scheduler::complete(const TaskId id, const TaskState state)
+{
+    std::vector<void *> continuations;
+    bool keepResults = false;
+    {
+        Task & task = m_tasks[id];
+        task.state = state;
+        releaseThread(task);
+        continuations.swap(task.continuations);
+        keepResults = task.keepResults;
+    }
+
+#if defined(__cpp_impl_coroutine)
+    for (void * handle : continuations)
+    {
+        std::coroutine_handle<>::from_address(handle).resume();
+    }
+#endif
+
+    if (!keepResults)
+    {
+        m_tasks.erase(id);
+    }
+}
+
+void Scheduler::releaseThread(Task & task)
+{
+    if (!task.thread) return;
+
+    m_threads.erase(task.thread);
+    task.thread = nullptr;
+
+    Stack stack;
+    stack.deleteReference(task.reference);
+    task.reference = LUA_NOREF;
+}
+
+Scheduler::Task * Scheduler::findTask(lua_State * thread, TaskId & id)
+{
+    auto it = m_threads.find(thread);
+    if (it == m_threads.end()) return nullptr;
+
+    id = it->second;
+    return &m_tasks[id];
+}
+
+Scheduler * Scheduler::getScheduler(lua_State * state)
+{
+    return static_cast<Scheduler *>(lua_touserdata(state, lua_upvalueindex(1)));
+}
+
+int Scheduler::luaYield(lua_State * state)
+{
+    return lua_yield(state, 0);
+}
+
+int Scheduler::luaSleep(lua_State * state)
+{
+    Scheduler * scheduler = getScheduler(state);
+    const double seconds = luaL_checknumber(state, 1);
+
+    TaskId id = kInvalidTask;
+    Task * task = scheduler->findTask(state, id);
+    if (!task) return luaL_error(state, "scheduler.sleep called outside of a task");
+
+    task->state = TaskState::Sleeping;
+    Sleeper sleeper = { scheduler->m_time + seconds, id };
+    scheduler->m_sleepers.push(sleeper);
+    return lua_yield(state, 0);
+}
+
+int Scheduler::luaWait(lua_State * state)
+{
+    Scheduler * scheduler = getScheduler(state);
+    const char * event = luaL_checkstring(state, 1);
+
+    TaskId id = kInvalidTask;
+    Task * task = scheduler->findTask(state, id);
+    if (!task) return luaL_error(state, "scheduler.wait called outside of a task");
+
+    task->state = TaskState::Waiting;
+    scheduler->m_waiters[event].push_back(id);
+    return lua_yield(state, 0);
+}
+
+int Scheduler::luaSpawn(lua_State * state)
+{
+    Scheduler * scheduler = getScheduler(state);
+    luaL_checktype(state, 1, LUA_TFUNCTION);
+    const int count = lua_gettop(state);
+    const void * key = Budget::identify(state, 1);
+
+    lua_State * thread = lua_newthread(state);
+    const int reference = lua_ref(state, LUA_REGISTRYINDEX);
+    ReferenceTracker::onCreate(reference, "Scheduler::spawn");
+    // function and its arguments are moved to the new coroutine as they are
+    lua_xmove(state, thread, count);
+
+    const TaskId id = ++scheduler->m_lastTask;
+    Task & task = scheduler->m_tasks[id];
+    task.thread = thread;
+    task.function = key;
+    task.reference = reference;
+    task.state = TaskState::Ready;
+    task.keepResults = false;
+    task.argsCount = count - 1;
+
+    scheduler->m_threads[thread] = id;
+    scheduler->m_runQueue.push_back(id);
+
+    lua_pushinteger(state, static_cast<lua_Integer>(id));
+    return 1;
+}
+} // lua
@@ -0,0 +1,231 @@
+#ifndef STREN_LUA_SCHEDULER_H
+#define STREN_LUA_SCHEDULER_H
+
+#include "lua_budget.h"
+#include "lua_stack.h"
+#include "lua_value.h"
+
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <map>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+namespace lua
+{
+class Function;
+///
+/// class Scheduler
+///
+/// Runs lua functions as coroutines. Tasks are resumed in batches by update() and may suspend themselves from lua with
+///     scheduler.yield()                   - resume on the next update
+///     scheduler.sleep(seconds)            - resume after the given time
+///     scheduler.wait(event)               - resume when C++ signals the event, returns signaled values
+///     scheduler.spawn(function, ...)      - start another task, returns its id
+///
+class Scheduler
+{
+public:
+    typedef size_t TaskId;
+    static const TaskId kInvalidTask = 0;   ///< id which is never given to a task
+    ///
+    /// task states
+    ///
+    enum class TaskState
+    {
+        Unknown,        ///< no such task or it was released
+        Ready,          ///< task is in the run queue
+        Sleeping,       ///< task waits for a timer
+        Waiting,        ///< task waits for an event
+        Finished,       ///< task returned, results are available
+        Failed          ///< task crashed, error is available
+    };
+private:
+    ///
+    /// struct Task
+    ///
+    struct Task
+    {
+        lua_State *  thread;        ///< lua coroutine
+        const void * function;      ///< key of the task function for budget usage
+        int          reference;     ///< reference anchoring the coroutine in the registry
+        TaskState    state;         ///< current state
+        bool         keepResults;   ///< if false, task is released as soon as nobody needs its results
+        int          argsCount;     ///< amount of values pushed to the coroutine for the next resume
+        ValueVector  results;       ///< values returned by the task
+        std::string  error;         ///< error message if task crashed
+        std::vector<void *> continuations; ///< C++ coroutines awaiting the task
+    };
+    ///
+    /// struct Sleeper
+    ///
+    struct Sleeper
+    {
+        double time;                ///< wake up time
+        TaskId task;                ///< sleeping task
+
+        bool operator>(const Sleeper & other) const { return time > other.time; }
+    };
+    ///
+    /// struct PendingFuture
+    ///
+    struct PendingFuture
+    {
+        std::string                           event;  ///< event signaled when future is ready
+        std::shared_future<ValueVector>       future; ///< watched future
+    };
+
+    typedef std::priority_queue<Sleeper, std::vector<Sleeper>, std::greater<Sleeper>> SleepQueue;
+
+    TaskId                                         m_lastTask;      ///< id of the last started task
+    double                                         m_time;          ///< time accumulated by update
+    std::unordered_map<TaskId, Task>               m_tasks;         ///< alive tasks
+    std::unordered_map<lua_State *, TaskId>        m_threads;       ///< coroutine to task
+    std::deque<TaskId>                             m_runQueue;      ///< tasks to resume
+    SleepQueue                                     m_sleepers;      ///< tasks waiting for timers
+    std::map<std::string, std::vector<TaskId>>     m_waiters;       ///< tasks waiting for events
+    std::vector<PendingFuture>                     m_futures;       ///< watched C++ futures
+    size_t                                         m_lastFuture;    ///< id of the last watched future
+    Budget                                         m_budget;        ///< budget of a single resume
+public:
+    ///
+    /// Constructor
+    ///
+    Scheduler();
+    ///
+    /// Destructor, releases all coroutines
+    ///
+    ~Scheduler();
+    ///
+    /// register lua api in the global table with the given name
+    ///
+    void loadLibs(const char * id = "scheduler");
+    ///
+    /// start function as a new task, it runs on the next update
+    ///
+    TaskId start(const Function & function, const ValueVector & params = ValueVector(), const bool keepResults = false);
+    ///
+    /// resume due tasks, maxResumes limits the batch size, 0 - no limit; returns amount of resumed tasks
+    ///
+    size_t update(const double dt, const size_t maxResumes = 0);
+    ///
+    /// wake tasks waiting for the event and pass them the values
+    ///
+    void signal(const std::string & event, const ValueVector & values = ValueVector());
+    ///
+    /// signal the returned event when the future becomes ready, pass the event to a script to wait for it
+    ///
+    std::string watch(const std::shared_future<ValueVector> & future);
+    ///
+    /// get task state
+    ///
+    TaskState getState(const TaskId task) const;
+    ///
+    /// get values returned by the finished task
+    ///
+    const ValueVector & getResults(const TaskId task) const;
+    ///
+    /// get error of the failed task
+    ///
+    const std::string & getError(const TaskId task) const;
+    ///
+    /// release task, running task is cancelled
+    ///
+    void release(const TaskId task);
+    ///
+    /// set budget of a single resume, Budget::Action::Yield preempts the task until the next update
+    ///
+    inline void setBudget(const Budget & budget) { m_budget = budget; }
+    ///
+    /// get amount of alive tasks
+    ///
+    inline size_t getTasksCount() const { return m_tasks.size(); }
+    ///
+    /// get current scheduler time
+    ///
+    inline double getTime() const { return m_time; }
+#if defined(__cpp_impl_coroutine)
+    ///
+    /// class Awaiter
+    ///
+    /// Allows C++20 coroutines to co_await results of a task.
+    ///
+    class Awaiter
+    {
+    private:
+        Scheduler & m_scheduler;    ///< scheduler which runs the task
+        TaskId      m_task;         ///< awaited task
+    public:
+        Awaiter(Scheduler & scheduler, const TaskId task) : m_scheduler(scheduler), m_task(task) {}
+
+        bool await_ready() const { return !m_scheduler.isRunning(m_task); }
+
+        void await_suspend(std::coroutine_handle<> handle) { m_scheduler.addContinuation(m_task, handle.address()); }
+
+        ValueVector await_resume() const { return m_scheduler.getResults(m_task); }
+    };
+    ///
+    /// get awaitable for the task results, await before the task completes or start it with keepResults
+    ///
+    inline Awaiter wait(const TaskId task) { return Awaiter(*this, task); }
+#endif
+private:
+    ///
+    /// check if task is neither finished nor failed
+    ///
+    bool isRunning(const TaskId task) const;
+    ///
+    /// register C++ coroutine resumed when task completes
+    ///
+    void addContinuation(const TaskId task, void * handle);
+    ///
+    /// push values to the coroutine of the task, they are passed to the task on the next resume
+    ///
+    void pushValues(Task & task, const ValueVector & values);
+    ///
+    /// resume task with its pending values
+    ///
+    void resume(const TaskId task);
+    ///
+    /// finish task, resume awaiting coroutines
+    ///
+    void complete(const TaskId task, const TaskState state);
+    ///
+    /// release lua coroutine of the task
+    ///
+    void releaseThread(Task & task);
+    ///
+    /// get task running on the lua coroutine
+    ///
+    Task * findTask(lua_State * thread, TaskId & id);
+    ///
+    /// get scheduler from the upvalue
+    ///
+    static Scheduler * getScheduler(lua_State * state);
+    ///
+    /// lua: scheduler.yield()
+    ///
+    static int luaYield(lua_State * state);
+    ///
+    /// lua: scheduler.sleep(seconds)
+    ///
+    static int luaSleep(lua_State * state);
+    ///
+    /// lua: scheduler.wait(event)
+    ///
+    static int luaWait(lua_State * state);
+    ///
+    /// lua: scheduler.spawn(function, ...)
+    ///
+    static int luaSpawn(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_SCHEDULER_H
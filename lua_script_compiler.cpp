@@ -0,0 +1,223 @@
+#include "lua_script_compiler.h"
+#include "lua_stack.h"
+#include "lua_memory_profiler.h"
+#include "lua_memoized_function.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace lua
+{
+namespace
+{
+int writeChunk(lua_State *, const void * data, size_t size, void * userdata)
+{
+    static_cast<std::string *>(userdata)->append(static_cast<const char *>(data), size);
+    return 0;
+}
+} // anonymous
+
+void ScriptCompiler::addFile(const std::string & name, const std::string & path, const std::vector<std::string> & dependencies)
+{
+    Script & script = add(name, dependencies);
+    script.path = path;
+}
+
+void ScriptCompiler::addBuffer(const std::string & name, const char * data, const size_t size, const std::vector<std::string> & dependencies)
+{
+    Script & script = add(name, dependencies);
+    script.data = data;
+    script.size = size;
+}
+
+ScriptCompiler::Script & ScriptCompiler::add(const std::string & name, const std::vector<std::string> & dependencies)
+{
+    auto found = m_index.find(name);
+    if (found == m_index.end())
+    {
+        found = m_index.emplace(name, m_scripts.size()).first;
+        m_scripts.emplace_back();
+    }
+
+    Script & script = m_scripts[found->second];
+    script.name = name;
+    script.path.clear();
+    script.data = nullptr;
+    script.size = 0;
+    script.dependencies = dependencies;
+    script.bytecode.clear();
+    script.error.clear();
+    script.mark = Mark::None;
+    return script;
+}
+
+bool ScriptCompiler::compile(size_t threadCount)
+{
+    MemoryProfiler::Scope scope("ScriptCompiler::compile");
+    m_errors.clear();
+    if (0 == threadCount)
+    {
+        threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    threadCount = std::min(threadCount, m_scripts.size());
+
+    // every script is taken by exactly one worker, so results need no locking
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount > 0 ? threadCount - 1 : 0);
+    for (size_t i = 1; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ScriptCompiler::compileRange, std::ref(m_scripts), std::ref(next));
+    }
+    if (threadCount > 0)
+    {
+        compileRange(m_scripts, next);
+    }
+    for (std::thread & worker : workers)
+    {
+        worker.join();
+    }
+
+    // reported in registration order regardless of which thread compiled what
+    for (Script & script : m_scripts)
+    {
+        script.mark = Mark::None;
+        if (!script.error.empty())
+        {
+            fail(script.name, script.error);
+        }
+    }
+    return m_errors.empty();
+}
+
+void ScriptCompiler::compileRange(std::vector<Script> & scripts, std::atomic<size_t> & next)
+{
+    // scratch state is private to this thread, the shared virtual machine is never touched
+    lua_State * state = lua_open();
+    for (size_t i = next++; i < scripts.size(); i = next++)
+    {
+        Script & script = scripts[i];
+        script.bytecode.clear();
+        script.error.clear();
+        if (!state)
+        {
+            script.error = "[compiler] not enough memory for scratch state";
+            continue;
+        }
+
+        const std::string chunkName = "=" + script.name;
+        const int status = script.path.empty()
+            ? luaL_loadbuffer(state, script.data, script.size, chunkName.c_str())
+            : luaL_loadfile(state, script.path.c_str());
+        if (0 != status)
+        {
+            script.error = 1 == lua_isstring(state, -1) ? lua_tostring(state, -1) : "[compiler] failed to load " + script.name;
+            lua_settop(state, 0);
+            continue;
+        }
+        lua_dump(state, writeChunk, &script.bytecode);
+        lua_settop(state, 0);
+    }
+    if (state)
+    {
+        lua_close(state);
+    }
+}
+
+bool ScriptCompiler::run()
+{
+    Stack stack;
+    if (!stack.getState()) return false;
+
+    MemoryProfiler::Scope scope("ScriptCompiler::run");
+    MemoizedFunction::invalidateAll();
+    for (Script & script : m_scripts)
+    {
+        script.mark = Mark::None;
+    }
+    // compile errors are reported by compile, so skipped scripts are counted here instead of new errors
+    bool isAllRun = true;
+    for (size_t i = 0; i < m_scripts.size(); ++i)
+    {
+        if (!execute(i))
+        {
+            isAllRun = false;
+        }
+    }
+    return isAllRun;
+}
+
+bool ScriptCompiler::execute(const size_t index)
+{
+    Script & script = m_scripts[index];
+    switch (script.mark)
+    {
+    case Mark::Done:
+        return true;
+    case Mark::Failed:
+        return false;
+    case Mark::Visiting:
+        fail(script.name, "[compiler] dependency cycle");
+        return false;
+    case Mark::None:
+        break;
+    }
+
+    script.mark = Mark::Visiting;
+    bool isReady = true;
+    for (const std::string & dependency : script.dependencies)
+    {
+        auto found = m_index.find(dependency);
+        if (found == m_index.end())
+        {
+            fail(script.name, "[compiler] missing dependency " + dependency);
+            isReady = false;
+        }
+        else if (!execute(found->second))
+        {
+            fail(script.name, "[compiler] dependency " + dependency + " failed");
+            isReady = false;
+        }
+    }
+    if (isReady && (!script.error.empty() || script.bytecode.empty()))
+    {
+        // compile error is already reported, a script which was never compiled is not
+        if (script.error.empty())
+        {
+            fail(script.name, "[compiler] script is not compiled");
+        }
+        isReady = false;
+    }
+    if (!isReady)
+    {
+        script.mark = Mark::Failed;
+        return false;
+    }
+
+    Stack stack;
+    std::string error;
+    const std::string chunkName = "=" + script.name;
+    if (!stack.compileBuffer(script.bytecode.data(), script.bytecode.size(), chunkName.c_str(), &error)
+        || !stack.call(0, 0, &error))
+    {
+        fail(script.name, error);
+        script.mark = Mark::Failed;
+        return false;
+    }
+    script.mark = Mark::Done;
+    return true;
+}
+
+void ScriptCompiler::fail(const std::string & name, const std::string & message)
+{
+    m_errors.push_back({ name, message });
+}
+
+void ScriptCompiler::clear()
+{
+    m_scripts.clear();
+    m_index.clear();
+    m_errors.clear();
+}
+} // lua
@@ -0,0 +1,117 @@
+#ifndef STREN_LUA_SCRIPT_COMPILER_H
+#define STREN_LUA_SCRIPT_COMPILER_H
+
+#include "lua_ext.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace lua
+{
+///
+/// class ScriptCompiler
+///
+/// Startup pipeline for large script sets. Scripts are compiled to bytecode in parallel, every worker
+/// thread owns a scratch state and the shared virtual machine is never touched. The main virtual machine
+/// then only loads ready bytecode and executes scripts so that every script runs after its dependencies.
+///     ScriptCompiler compiler;
+///     compiler.addFile("core", "scripts/core.lua");
+///     compiler.addFile("ui", "scripts/ui.lua", { "core" });
+///     if (!compiler.compile() || !compiler.run()) report(compiler.getErrors());
+/// Errors are collected for all scripts instead of stopping at the first one.
+///
+class ScriptCompiler
+{
+public:
+    ///
+    /// struct Error
+    ///
+    struct Error
+    {
+        std::string name;       ///< script name
+        std::string message;    ///< compile or runtime error
+    };
+private:
+    ///
+    /// execution state of the script
+    ///
+    enum class Mark
+    {
+        None,
+        Visiting,
+        Done,
+        Failed
+    };
+    ///
+    /// struct Script
+    ///
+    struct Script
+    {
+        std::string              name;          ///< unique name used by dependencies
+        std::string              path;          ///< file path, empty for buffers
+        const char *             data;          ///< buffer data, not owned
+        size_t                   size;          ///< buffer size
+        std::vector<std::string> dependencies;  ///< scripts executed before this one
+        std::string              bytecode;      ///< compiled chunk
+        std::string              error;         ///< compile error
+        Mark                     mark;          ///< execution state
+    };
+
+    std::vector<Script>                     m_scripts;  ///< scripts in registration order
+    std::unordered_map<std::string, size_t> m_index;    ///< script index by name
+    std::vector<Error>                      m_errors;   ///< errors of the last compile and run
+public:
+    ///
+    /// register script file, registering a name again replaces the script
+    ///
+    void addFile(const std::string & name, const std::string & path, const std::vector<std::string> & dependencies = {});
+    ///
+    /// register script buffer, data has to stay valid until compile returns
+    ///
+    void addBuffer(const std::string & name, const char * data, const size_t size, const std::vector<std::string> & dependencies = {});
+    ///
+    /// compile all scripts on threadCount threads, hardware concurrency if zero;
+    /// returns false if any script has errors
+    ///
+    bool compile(size_t threadCount = 0);
+    ///
+    /// execute compiled scripts on the main virtual machine in dependency order; scripts which failed,
+    /// depend on failed or missing scripts or form a cycle are skipped, returns false if any was skipped
+    ///
+    bool run();
+    ///
+    /// get errors of the last compile and run
+    ///
+    inline const std::vector<Error> & getErrors() const { return m_errors; }
+    ///
+    /// get amount of registered scripts
+    ///
+    inline size_t getCount() const { return m_scripts.size(); }
+    ///
+    /// forget all scripts, bytecode and errors
+    ///
+    void clear();
+private:
+    ///
+    /// register script
+    ///
+    Script & add(const std::string & name, const std::vector<std::string> & dependencies);
+    ///
+    /// compile scripts taken from the shared counter in a scratch state
+    ///
+    static void compileRange(std::vector<Script> & scripts, std::atomic<size_t> & next);
+    ///
+    /// execute dependencies and then the script itself, returns false if script was skipped
+    ///
+    bool execute(const size_t index);
+    ///
+    /// record error
+    ///
+    void fail(const std::string & name, const std::string & message);
+};
+} // lua
+
+#endif // STREN_LUA_SCRIPT_COMPILER_H
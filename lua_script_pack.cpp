@@ -0,0 +1,356 @@
+#include "lua_script_pack.h"
+#include "lua_stack.h"
+#include "lua_memory_profiler.h"
+#include "lua_memoized_function.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace lua
+{
+namespace
+{
+const char   kMagic[4]   = { 'L', 'P', 'K', '1' };
+const size_t kHeaderSize = 8;
+const size_t kEntrySize  = 32;
+
+inline uint64_t loadNumber(const char * data, const size_t size)
+{
+    uint64_t value = 0;
+    for (size_t i = size; i > 0; --i)
+    {
+        value = (value << 8) | (uint8_t)data[i - 1];
+    }
+    return value;
+}
+
+inline void storeNumber(std::string & out, const uint64_t value, const size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        out += (char)(value >> (i * 8));
+    }
+}
+
+inline void setError(std::string * error, const std::string & message)
+{
+    if (error)
+    {
+        *error = "[lua] " + message;
+    }
+}
+} // anonymous
+
+// class ScriptPack
+ScriptPack::ScriptPack()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_file(nullptr)
+    , m_mapping(nullptr)
+    , m_isMapped(false)
+{
+}
+
+ScriptPack::~ScriptPack()
+{
+    close();
+}
+
+bool ScriptPack::open(const char * path, std::string * error)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        setError(error, std::string("can not open script pack ") + path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0
+        ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr)
+        : nullptr;
+    const void * data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data)
+    {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        setError(error, std::string("can not map script pack ") + path);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_size = (size_t)size.QuadPart;
+#else
+    const int file = ::open(path, O_RDONLY);
+    if (file < 0)
+    {
+        setError(error, std::string("can not open script pack ") + path);
+        return false;
+    }
+    struct stat info;
+    void * data = (0 == fstat(file, &info) && info.st_size > 0)
+        ? mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0)
+        : MAP_FAILED;
+    // mapping stays valid after the descriptor is closed
+    ::close(file);
+    if (MAP_FAILED == data)
+    {
+        setError(error, std::string("can not map script pack ") + path);
+        return false;
+    }
+    m_size = (size_t)info.st_size;
+#endif
+
+    m_data = (const char *)data;
+    m_isMapped = true;
+    if (!parse(error))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool ScriptPack::open(const char * data, const size_t size, std::string * error)
+{
+    close();
+
+    m_data = data;
+    m_size = size;
+    if (!parse(error))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ScriptPack::close()
+{
+    if (m_isMapped)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mapping);
+        CloseHandle((HANDLE)m_file);
+#else
+        munmap((void *)m_data, m_size);
+#endif
+    }
+    m_data = nullptr;
+    m_size = 0;
+    m_file = nullptr;
+    m_mapping = nullptr;
+    m_isMapped = false;
+    m_entries.clear();
+    m_scratch.clear();
+}
+
+bool ScriptPack::parse(std::string * error)
+{
+    if (m_size < kHeaderSize || 0 != memcmp(m_data, kMagic, sizeof(kMagic)))
+    {
+        setError(error, "not a script pack");
+        return false;
+    }
+
+    const uint64_t count = loadNumber(m_data + 4, 4);
+    if (count > (m_size - kHeaderSize) / kEntrySize)
+    {
+        setError(error, "script pack index is truncated");
+        return false;
+    }
+
+    m_entries.reserve((size_t)count);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        const char * record = m_data + kHeaderSize + i * kEntrySize;
+        const uint64_t nameOffset = loadNumber(record, 4);
+        const uint64_t nameLength = loadNumber(record + 4, 4);
+
+        Entry entry;
+        entry.offset = loadNumber(record + 8, 8);
+        entry.storedSize = (uint32_t)loadNumber(record + 16, 4);
+        entry.size = (uint32_t)loadNumber(record + 20, 4);
+        entry.flags = (uint32_t)loadNumber(record + 24, 4);
+        if (nameOffset + nameLength > m_size || entry.offset > m_size || entry.storedSize > m_size - entry.offset)
+        {
+            setError(error, "script pack entry is out of bounds");
+            return false;
+        }
+
+        entry.name = std::string_view(m_data + nameOffset, (size_t)nameLength);
+        if (!m_entries.empty() && !(m_entries.back().name < entry.name))
+        {
+            setError(error, "script pack index is not sorted");
+            return false;
+        }
+        m_entries.push_back(entry);
+    }
+    return true;
+}
+
+const ScriptPack::Entry * ScriptPack::find(std::string_view name) const
+{
+    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), name,
+        [](const Entry & entry, std::string_view value) { return entry.name < value; });
+    return (it != m_entries.end() && it->name == name) ? &*it : nullptr;
+}
+
+bool ScriptPack::read(std::string_view name, const char *& data, size_t & size, std::string * error)
+{
+    return read(name, data, size, m_scratch, error);
+}
+
+bool ScriptPack::read(std::string_view name, const char *& data, size_t & size, std::string & buffer, std::string * error) const
+{
+    const Entry * entry = find(name);
+    if (!entry)
+    {
+        setError(error, "script not found in pack: " + std::string(name));
+        return false;
+    }
+
+    data = m_data + entry->offset;
+    size = entry->storedSize;
+    if (0 == (entry->flags & kCompressed)) return true;
+
+    if (!m_decompressor)
+    {
+        setError(error, "no decompressor for script " + std::string(name));
+        return false;
+    }
+    buffer.resize(entry->size);
+    if (!m_decompressor(data, size, &buffer[0], buffer.size()))
+    {
+        setError(error, "can not decompress script " + std::string(name));
+        return false;
+    }
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+}
+
+bool ScriptPack::compile(std::string_view name, std::string * error)
+{
+    const char * data = nullptr;
+    size_t size = 0;
+    if (!read(name, data, size, error)) return false;
+
+    Stack stack;
+    const std::string chunkName = "@" + std::string(name);
+    return stack.compileBuffer(data, size, chunkName.c_str(), error);
+}
+
+void ScriptPack::load(std::string_view name)
+{
+    MemoryProfiler::Scope scope("ScriptPack::load");
+    MemoizedFunction::invalidateAll();
+    std::string error;
+    if (!compile(name, &error))
+    {
+        stren::assertMessage(false, error.c_str());
+        return;
+    }
+
+    Stack stack;
+    stack.call(0, 0);
+}
+
+// class ScriptPackWriter
+void ScriptPackWriter::add(const std::string & name, const std::string & data)
+{
+    m_chunks[name] = data;
+}
+
+bool ScriptPackWriter::addFile(const std::string & name, const char * path)
+{
+    FILE * file = fopen(path, "rb");
+    if (!file) return false;
+
+    std::string data;
+    char buffer[16384];
+    size_t size = 0;
+    while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.append(buffer, size);
+    }
+    const bool isRead = 0 == ferror(file);
+    fclose(file);
+
+    if (isRead)
+    {
+        m_chunks[name].swap(data);
+    }
+    return isRead;
+}
+
+bool ScriptPackWriter::write(const char * path, const Compressor & compressor, std::string * error) const
+{
+    // names follow the index, chunk data follows the names
+    size_t namesSize = 0;
+    for (const auto & chunk : m_chunks)
+    {
+        namesSize += chunk.first.size();
+    }
+
+    std::string index;
+    std::string names;
+    std::string data;
+    std::string compressed;
+    index.reserve(kHeaderSize + m_chunks.size() * kEntrySize);
+    names.reserve(namesSize);
+    index.append(kMagic, sizeof(kMagic));
+    storeNumber(index, m_chunks.size(), 4);
+
+    const uint64_t namesOffset = kHeaderSize + m_chunks.size() * kEntrySize;
+    const uint64_t dataOffset = namesOffset + namesSize;
+    for (const auto & chunk : m_chunks)
+    {
+        compressed.clear();
+        const bool isCompressed = compressor && compressor(chunk.second.data(), chunk.second.size(), compressed) &&
+            compressed.size() < chunk.second.size();
+        const std::string & stored = isCompressed ? compressed : chunk.second;
+
+        storeNumber(index, namesOffset + names.size(), 4);
+        storeNumber(index, chunk.first.size(), 4);
+        storeNumber(index, dataOffset + data.size(), 8);
+        storeNumber(index, stored.size(), 4);
+        storeNumber(index, chunk.second.size(), 4);
+        storeNumber(index, isCompressed ? ScriptPack::kCompressed : 0, 4);
+        storeNumber(index, 0, 4);
+        names += chunk.first;
+        data += stored;
+    }
+
+    FILE * file = fopen(path, "wb");
+    if (!file)
+    {
+        setError(error, std::string("can not create script pack ") + path);
+        return false;
+    }
+    const bool isWritten = fwrite(index.data(), 1, index.size(), file) == index.size() &&
+        fwrite(names.data(), 1, names.size(), file) == names.size() &&
+        fwrite(data.data(), 1, data.size(), file) == data.size();
+    const bool isClosed = 0 == fclose(file);
+    if (!isWritten || !isClosed)
+    {
+        setError(error, std::string("can not write script pack ") + path);
+        return false;
+    }
+    return true;
+}
+} // lua
@@ -0,0 +1,153 @@
+#ifndef STREN_LUA_SCRIPT_PACK_H
+#define STREN_LUA_SCRIPT_PACK_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace lua
+{
+///
+/// class ScriptPack
+///
+/// Read-only archive of lua chunks (source or bytecode) mapped into memory. Chunks are compiled straight
+/// from the mapping, compressed ones are inflated by the decompressor into a reused buffer first.
+/// Layout, all numbers little endian:
+///     header  "LPK1", uint32 count
+///     index   count entries sorted by name: uint32 nameOffset, uint32 nameLength, uint64 dataOffset,
+///             uint32 storedSize, uint32 size, uint32 flags, uint32 reserved
+///     names and chunk data
+///
+class ScriptPack
+{
+public:
+    ///
+    /// inflate src into dst of exactly size bytes, returns false on corrupted data
+    ///
+    typedef std::function<bool(const char * src, size_t srcSize, char * dst, size_t size)> Decompressor;
+
+    static const uint32_t kCompressed = 1;  ///< chunk is stored compressed
+private:
+    ///
+    /// struct Entry
+    ///
+    struct Entry
+    {
+        std::string_view name;      ///< chunk name in the mapping
+        uint64_t         offset;    ///< offset of stored data
+        uint32_t         storedSize;///< size of stored data
+        uint32_t         size;      ///< size of chunk
+        uint32_t         flags;     ///< kCompressed
+    };
+
+    const char *       m_data;          ///< pack content
+    size_t             m_size;          ///< pack size
+    void *             m_file;          ///< file handle, Win32 only
+    void *             m_mapping;       ///< mapping handle, Win32 only
+    bool               m_isMapped;      ///< true if pack is mapped from file
+    std::vector<Entry> m_entries;       ///< index sorted by name
+    Decompressor       m_decompressor;  ///< inflates compressed chunks
+    std::string        m_scratch;       ///< buffer for inflated chunks
+public:
+    ///
+    /// Constructor
+    ///
+    ScriptPack();
+    ///
+    /// Destructor
+    ///
+    ~ScriptPack();
+    ///
+    /// map pack file into memory
+    ///
+    bool open(const char * path, std::string * error = nullptr);
+    ///
+    /// use pack placed in memory, e.g. embedded into executable, data has to outlive the pack
+    ///
+    bool open(const char * data, const size_t size, std::string * error = nullptr);
+    ///
+    /// unmap pack
+    ///
+    void close();
+    ///
+    /// set decompressor for compressed chunks
+    ///
+    inline void setDecompressor(const Decompressor & decompressor) { m_decompressor = decompressor; }
+    ///
+    /// get amount of chunks
+    ///
+    inline size_t getCount() const { return m_entries.size(); }
+    ///
+    /// get name of chunk by index
+    ///
+    inline std::string_view getName(const size_t index) const { return m_entries[index].name; }
+    ///
+    /// check if pack contains chunk
+    ///
+    inline bool contains(std::string_view name) const { return nullptr != find(name); }
+    ///
+    /// get chunk content, compressed chunks are inflated into a buffer valid till the next call
+    ///
+    bool read(std::string_view name, const char *& data, size_t & size, std::string * error = nullptr);
+    ///
+    /// get chunk content, compressed chunks are inflated into buffer, safe to call from any thread
+    /// as long as the decompressor is
+    ///
+    bool read(std::string_view name, const char *& data, size_t & size, std::string & buffer, std::string * error = nullptr) const;
+    ///
+    /// compile chunk and push it to the stack, returns false if chunk is missing or has errors
+    ///
+    bool compile(std::string_view name, std::string * error = nullptr);
+    ///
+    /// compile and run chunk
+    ///
+    void load(std::string_view name);
+private:
+    ScriptPack(const ScriptPack &) = delete;
+    ScriptPack & operator=(const ScriptPack &) = delete;
+    ///
+    /// parse header and index
+    ///
+    bool parse(std::string * error);
+    ///
+    /// find chunk by name
+    ///
+    const Entry * find(std::string_view name) const;
+};
+///
+/// class ScriptPackWriter
+///
+/// Builds pack files for ScriptPack.
+///
+class ScriptPackWriter
+{
+public:
+    ///
+    /// compress data into out, returns false to store chunk uncompressed
+    ///
+    typedef std::function<bool(const char * data, size_t size, std::string & out)> Compressor;
+private:
+    std::map<std::string, std::string> m_chunks;    ///< chunks by name
+public:
+    ///
+    /// add chunk, replaces chunk with the same name
+    ///
+    void add(const std::string & name, const std::string & data);
+    ///
+    /// add chunk from file, returns false if file can not be read
+    ///
+    bool addFile(const std::string & name, const char * path);
+    ///
+    /// write pack file, chunks are compressed only if it makes them smaller
+    ///
+    bool write(const char * path, const Compressor & compressor = nullptr, std::string * error = nullptr) const;
+};
+} // lua
+
+#endif // STREN_LUA_SCRIPT_PACK_H
@@ -0,0 +1,168 @@
+#include "lua_snapshot.h"
+#include "lua_stack.h"
+
+namespace lua
+{
+namespace
+{
+///
+/// make table at index "target" equal to its shallow copy at index "copy"
+///
+void restoreTable(lua_State * state, const int target, const int copy)
+{
+    // existing fields may be changed or cleared during traversal
+    lua_pushnil(state);
+    while (0 != lua_next(state, target))
+    {
+        lua_pushvalue(state, -2);
+        lua_rawget(state, copy);
+        if (!lua_rawequal(state, -1, -2))
+        {
+            lua_pushvalue(state, -3);
+            lua_pushvalue(state, -2);
+            lua_rawset(state, target);
+        }
+        lua_pop(state, 2);
+    }
+
+    // put back fields removed since capture
+    lua_pushnil(state);
+    while (0 != lua_next(state, copy))
+    {
+        lua_pushvalue(state, -2);
+        lua_rawget(state, target);
+        const bool isMissing = lua_isnil(state, -1);
+        lua_pop(state, 1);
+        if (isMissing)
+        {
+            lua_pushvalue(state, -2);
+            lua_pushvalue(state, -2);
+            lua_rawset(state, target);
+        }
+        lua_pop(state, 1);
+    }
+}
+} // namespace
+
+Snapshot::Snapshot()
+    : m_reference(LUA_NOREF)
+    , m_metatables(LUA_NOREF)
+    , m_tablesCount(0)
+{
+}
+
+Snapshot::~Snapshot()
+{
+    release();
+}
+
+void Snapshot::capture(const int depth)
+{
+    release();
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    lua_newtable(state);
+    const int copies = lua_gettop(state);
+    lua_newtable(state);
+    const int metatables = lua_gettop(state);
+
+    lua_pushvalue(state, LUA_GLOBALSINDEX);
+    captureTable(state, copies, metatables, depth);
+    stack.pop(1);
+
+    m_metatables = stack.popReference("Snapshot::capture");
+    m_reference = stack.popReference("Snapshot::capture");
+}
+
+void Snapshot::restore()
+{
+    if (!isCaptured()) return;
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    lua_getref(state, m_reference);
+    const int copies = lua_gettop(state);
+    lua_getref(state, m_metatables);
+    const int metatables = lua_gettop(state);
+
+    lua_checkstack(state, 8);
+    lua_pushnil(state);
+    while (0 != lua_next(state, copies))
+    {
+        const int copy = lua_gettop(state);
+        const int target = copy - 1;
+        restoreTable(state, target, copy);
+
+        lua_pushvalue(state, target);
+        lua_rawget(state, metatables);
+        if (lua_isboolean(state, -1))
+        {
+            stack.pop(1);
+            lua_pushnil(state);
+        }
+        lua_setmetatable(state, target);
+        stack.pop(1);
+    }
+    stack.pop(2);
+}
+
+void Snapshot::release()
+{
+    if (!isCaptured()) return;
+
+    Stack stack;
+    stack.deleteReference(m_reference);
+    stack.deleteReference(m_metatables);
+    m_reference = LUA_NOREF;
+    m_metatables = LUA_NOREF;
+    m_tablesCount = 0;
+}
+
+void Snapshot::captureTable(lua_State * state, const int copies, const int metatables, const int depth)
+{
+    const int table = lua_gettop(state);
+
+    lua_pushvalue(state, table);
+    lua_rawget(state, copies);
+    const bool isCaptured = !lua_isnil(state, -1);
+    lua_pop(state, 1);
+    if (isCaptured) return;
+
+    lua_checkstack(state, 8);
+    lua_newtable(state);
+    const int copy = lua_gettop(state);
+    lua_pushvalue(state, table);
+    lua_pushvalue(state, copy);
+    lua_rawset(state, copies);
+
+    lua_pushvalue(state, table);
+    if (0 == lua_getmetatable(state, table))
+    {
+        lua_pushboolean(state, 0);
+    }
+    lua_rawset(state, metatables);
+    ++m_tablesCount;
+
+    lua_pushnil(state);
+    while (0 != lua_next(state, table))
+    {
+        lua_pushvalue(state, -2);
+        lua_pushvalue(state, -2);
+        lua_rawset(state, copy);
+
+        if (depth > 0 && lua_istable(state, -1))
+        {
+            lua_pushvalue(state, -1);
+            captureTable(state, copies, metatables, depth - 1);
+            lua_pop(state, 1);
+        }
+        lua_pop(state, 1);
+    }
+    lua_pop(state, 1);
+}
+} // lua
@@ -0,0 +1,64 @@
+#ifndef STREN_LUA_SNAPSHOT_H
+#define STREN_LUA_SNAPSHOT_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+
+namespace lua
+{
+///
+/// class Snapshot
+///
+/// Captures contents and metatables of the global table and of tables reachable from it up to the given depth.
+/// restore() puts captured fields back in place and removes fields added since the capture, so a request can
+/// run against the bootstrapped environment without recreating the virtual machine and reloading scripts.
+/// Cost of restore is proportional to the size of captured tables. Upvalues, userdata and tables which
+/// are not reachable from the globals within the depth are not restored.
+///
+class Snapshot
+{
+private:
+    int    m_reference;     ///< registry table: captured table -> its shallow copy
+    int    m_metatables;    ///< registry table: captured table -> its metatable or false
+    size_t m_tablesCount;   ///< amount of captured tables
+public:
+    ///
+    /// Constructor
+    ///
+    Snapshot();
+    ///
+    /// Destructor
+    ///
+    ~Snapshot();
+    ///
+    /// capture global table and tables reachable from it, depth 0 - globals only
+    ///
+    void capture(const int depth = 1);
+    ///
+    /// restore captured tables
+    ///
+    void restore();
+    ///
+    /// release captured data
+    ///
+    void release();
+    ///
+    /// check if snapshot holds captured data
+    ///
+    inline bool isCaptured() const { return m_reference != LUA_NOREF; }
+    ///
+    /// get amount of captured tables
+    ///
+    inline size_t getTablesCount() const { return m_tablesCount; }
+private:
+    Snapshot(const Snapshot &) = delete;
+    Snapshot & operator=(const Snapshot &) = delete;
+    ///
+    /// capture table on top of the stack, snapshot tables are at the given indices
+    ///
+    void captureTable(lua_State * state, const int copies, const int metatables, const int depth);
+};
+} // lua
+
+#endif // STREN_LUA_SNAPSHOT_H
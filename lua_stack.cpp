@@ -1,17 +1,45 @@
 #include "lua_stack.h"
 #include "lua_value.h"
+#include "lua_memory_profiler.h"
+#include "lua_budget.h"
+#include "lua_value_buffer.h"
+#include "lua_key.h"
+#include "lua_table.h"
+#include "lua_function.h"
+#include "lua_reference_tracker.h"
+#include "lua_release_queue.h"
+#include "lua_memoized_function.h"
 #include "utils.h"
 
 namespace lua
 {
 lua_State * L = nullptr;
 
+#if LUA_WRAPPER_CHECKED
+// class StackGuard
+StackGuard::StackGuard(lua_State * state, const int delta)
+    : m_state(state)
+    , m_top(state ? lua_gettop(state) + delta : 0)
+{
+}
+
+StackGuard::~StackGuard()
+{
+    stren::assertMessage(!m_state || m_top == lua_gettop(m_state), "[lua] stack is not balanced");
+}
+#endif
+
 // class Stack
-Stack::Stack(const int minStackSize)
+Stack::Stack([[maybe_unused]] const int minStackSize)
 {
     create();
     m_luaState = L;
-    stren::assertMessage(getSize() >= minStackSize, "Wrong stack size");
+    LUA_CHECK(getSize() >= minStackSize, "Wrong stack size");
+    // handles destroyed on other threads since the last scope
+    if (ReleaseQueue::hasPending() && ReleaseQueue::isOwner())
+    {
+        ReleaseQueue::drain(m_luaState);
+    }
 }
 
 void Stack::create()
@@ -21,6 +49,7 @@ void Stack::create()
         L = lua_open();
         stren::assertMessage(nullptr != L, "Failed to create lua virtual machine");
         luaL_openlibs(L);
+        ReleaseQueue::setOwner();
     }
 }
 
@@ -30,6 +59,8 @@ void Stack::destroy()
     {
         collectGarbage();
         lua_close(m_luaState);
+        ReleaseQueue::clear();
+        ReleaseQueue::setOwner(std::thread::id());
         m_luaState = nullptr;
         L = nullptr;
     }
@@ -37,30 +68,100 @@ void Stack::destroy()
 
 void Stack::loadLibs(const char * id, const luaL_reg * regs)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         luaL_register(m_luaState, id, regs);
         pop(1);
     }
 }
 
+void Stack::loadLibs(const char * id, const luaL_reg * regs, void * upvalue)
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        lua_getglobal(m_luaState, id);
+        if (!lua_istable(m_luaState, -1))
+        {
+            pop(1);
+            lua_newtable(m_luaState);
+            lua_pushvalue(m_luaState, -1);
+            lua_setglobal(m_luaState, id);
+        }
+        for (const luaL_reg * reg = regs; reg->name; ++reg)
+        {
+            lua_pushlightuserdata(m_luaState, upvalue);
+            lua_pushcclosure(m_luaState, reg->func, 1);
+            lua_setfield(m_luaState, -2, reg->name);
+        }
+        pop(1);
+    }
+}
+
 int Stack::getAllocatedMemory()
 {
-    return m_luaState ? lua_gc(m_luaState, LUA_GCCOUNT, 0) : 0;
+    return LUA_STATE_OK(m_luaState) ? lua_gc(m_luaState, LUA_GCCOUNT, 0) : 0;
+}
+
+size_t Stack::getAllocatedBytes()
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        const size_t kilobytes = lua_gc(m_luaState, LUA_GCCOUNT, 0);
+        const size_t bytes = lua_gc(m_luaState, LUA_GCCOUNTB, 0);
+        return kilobytes * 1024 + bytes;
+    }
+    return 0;
 }
 
 void Stack::collectGarbage()
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
+        ReleaseQueue::drain(m_luaState);
         lua_gc(m_luaState, LUA_GCCOLLECT, 0);
     }
 }
 
+bool Stack::stepGarbage(const int stepSize)
+{
+    if (!LUA_STATE_OK(m_luaState)) return false;
+
+    ReleaseQueue::drain(m_luaState);
+    return 1 == lua_gc(m_luaState, LUA_GCSTEP, stepSize);
+}
+
+void Stack::stopGarbageCollector()
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        lua_gc(m_luaState, LUA_GCSTOP, 0);
+    }
+}
+
+void Stack::restartGarbageCollector()
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        lua_gc(m_luaState, LUA_GCRESTART, 0);
+    }
+}
+
+int Stack::setGarbagePause(const int pause)
+{
+    return LUA_STATE_OK(m_luaState) ? lua_gc(m_luaState, LUA_GCSETPAUSE, pause) : 0;
+}
+
+int Stack::setGarbageStepMultiplier(const int stepMultiplier)
+{
+    return LUA_STATE_OK(m_luaState) ? lua_gc(m_luaState, LUA_GCSETSTEPMUL, stepMultiplier) : 0;
+}
+
 void Stack::loadScript(const char * name)
 {
-    if (!m_luaState) return;
+    if (!LUA_STATE_OK(m_luaState)) return;
 
+    MemoryProfiler::Scope scope("Stack::loadScript");
+    MemoizedFunction::invalidateAll();
     if (luaL_dofile(m_luaState, name))
     {
         std::string errorMsg;
@@ -77,55 +178,202 @@ void Stack::loadScript(const char * name)
     }
 }
 
-Value Stack::get(const int index)
+void Stack::loadBuffer(const char * data, const size_t size, const char * name)
 {
-    if (m_luaState)
+    if (!LUA_STATE_OK(m_luaState)) return;
+
+    MemoryProfiler::Scope scope("Stack::loadBuffer");
+    MemoizedFunction::invalidateAll();
+    if (compileBuffer(data, size, name))
     {
-        if (1 == lua_isnumber(m_luaState, index))
-        {
-            const double numberValue = lua_tonumber(m_luaState, index);
-            if (numberValue == (int)numberValue)
-            {
-                return Value(lua_tointeger(m_luaState, index));
-            }
-            else
-            {
-                return Value(numberValue);
-            }
-        }
-        else if (lua_isboolean(m_luaState, index))
-        {
-            return Value(1 == lua_toboolean(m_luaState, index));
-        }
-        else if (1 == lua_isstring(m_luaState, index))
-        {
-            return Value(lua_tostring(m_luaState, index));
-        }
-        else if (1 == lua_isuserdata(m_luaState, index))
+        call(0, 0);
+    }
+}
+
+bool Stack::compileBuffer(const char * data, const size_t size, const char * name, std::string * error)
+{
+    if (!LUA_STATE_OK(m_luaState)) return false;
+
+    // luaL_loadbuffer reader hands the whole buffer to the parser at once
+    if (0 != luaL_loadbuffer(m_luaState, data, size, name))
+    {
+        std::string errorMsg = 1 == lua_isstring(m_luaState, -1) ? lua_tostring(m_luaState, -1) : name;
+        pop(1);
+        if (error)
         {
-            return Value(lua_touserdata(m_luaState, index));
+            error->swap(errorMsg);
         }
-        else if (lua_istable(m_luaState, index))
+        else
         {
-            lua_pushvalue(m_luaState, index);
-            return Value(lua_ref(m_luaState, LUA_REGISTRYINDEX), true);
+            stren::assertMessage(false, errorMsg.c_str());
         }
-        else if (lua_isfunction(m_luaState, index))
+        return false;
+    }
+    return true;
+}
+
+int Stack::createStringReference(const std::string & value)
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        lua_pushlstring(m_luaState, value.c_str(), value.size());
+        return popReference("Stack::createStringReference");
+    }
+    return LUA_NOREF;
+}
+
+Value Stack::get(const int index)
+{
+    return get(index, std::pmr::get_default_resource());
+}
+
+Value Stack::get(const int index, std::pmr::memory_resource * resource)
+{
+    // constructed once in the resource, read assigns in place
+    Value value{ Value::allocator_type(resource) };
+    read(index, value);
+    return value;
+}
+
+bool Stack::read(const int index, bool & value)
+{
+    if (!m_luaState || LUA_TBOOLEAN != lua_type(m_luaState, index)) return false;
+
+    value = 0 != lua_toboolean(m_luaState, index);
+    return true;
+}
+
+bool Stack::read(const int index, int & value)
+{
+    if (!m_luaState || LUA_TNUMBER != lua_type(m_luaState, index)) return false;
+
+    value = static_cast<int>(lua_tonumber(m_luaState, index));
+    return true;
+}
+
+bool Stack::read(const int index, long & value)
+{
+    if (!m_luaState || LUA_TNUMBER != lua_type(m_luaState, index)) return false;
+
+    value = static_cast<long>(lua_tonumber(m_luaState, index));
+    return true;
+}
+
+bool Stack::read(const int index, long long & value)
+{
+    if (!m_luaState || LUA_TNUMBER != lua_type(m_luaState, index)) return false;
+
+    value = static_cast<long long>(lua_tonumber(m_luaState, index));
+    return true;
+}
+
+bool Stack::read(const int index, float & value)
+{
+    if (!m_luaState || LUA_TNUMBER != lua_type(m_luaState, index)) return false;
+
+    value = static_cast<float>(lua_tonumber(m_luaState, index));
+    return true;
+}
+
+bool Stack::read(const int index, double & value)
+{
+    if (!m_luaState || LUA_TNUMBER != lua_type(m_luaState, index)) return false;
+
+    value = lua_tonumber(m_luaState, index);
+    return true;
+}
+
+bool Stack::read(const int index, std::string & value)
+{
+    if (!m_luaState || LUA_TSTRING != lua_type(m_luaState, index)) return false;
+
+    size_t length = 0;
+    const char * str = lua_tolstring(m_luaState, index, &length);
+    value.assign(str, length);
+    return true;
+}
+
+bool Stack::read(const int index, std::string_view & value)
+{
+    if (!m_luaState || LUA_TSTRING != lua_type(m_luaState, index)) return false;
+
+    size_t length = 0;
+    const char * str = lua_tolstring(m_luaState, index, &length);
+    value = std::string_view(str, length);
+    return true;
+}
+
+bool Stack::read(const int index, Table & value)
+{
+    if (!m_luaState || LUA_TTABLE != lua_type(m_luaState, index)) return false;
+
+    lua_pushvalue(m_luaState, index);
+    value = Table(popReference("Stack::read"));
+    return true;
+}
+
+bool Stack::read(const int index, Function & value)
+{
+    if (!m_luaState || LUA_TFUNCTION != lua_type(m_luaState, index)) return false;
+
+    lua_pushvalue(m_luaState, index);
+    value = Function(popReference("Stack::read"));
+    return true;
+}
+
+bool Stack::read(const int index, Value & value)
+{
+    // assigned in place, so a reused value keeps its string storage
+    if (!LUA_STATE_OK(m_luaState))
+    {
+        value.setNil();
+    }
+    else if (1 == lua_isnumber(m_luaState, index))
+    {
+        const double numberValue = lua_tonumber(m_luaState, index);
+        if (numberValue == (int)numberValue)
         {
-            lua_pushvalue(m_luaState, index);
-            return Value(lua_ref(m_luaState, LUA_REGISTRYINDEX), false);
+            value.assign(static_cast<long>(lua_tointeger(m_luaState, index)));
         }
-        else if (lua_isnil(m_luaState, index))
+        else
         {
-            return Value();
+            value.assign(numberValue);
         }
     }
-    return Value();
+    else if (lua_isboolean(m_luaState, index))
+    {
+        value.assign(1 == lua_toboolean(m_luaState, index));
+    }
+    else if (1 == lua_isstring(m_luaState, index))
+    {
+        size_t length = 0;
+        const char * str = lua_tolstring(m_luaState, index, &length);
+        value.assign(str, length);
+    }
+    else if (1 == lua_isuserdata(m_luaState, index))
+    {
+        value.assign(lua_touserdata(m_luaState, index));
+    }
+    else if (lua_istable(m_luaState, index))
+    {
+        lua_pushvalue(m_luaState, index);
+        value.assign(popReference("Stack::read"), true);
+    }
+    else if (lua_isfunction(m_luaState, index))
+    {
+        lua_pushvalue(m_luaState, index);
+        value.assign(popReference("Stack::read"), false);
+    }
+    else
+    {
+        value.setNil();
+    }
+    return true;
 }
 
 int Stack::getSize() const
 {
-    return m_luaState ? lua_gettop(m_luaState) : 0;
+    return LUA_STATE_OK(m_luaState) ? lua_gettop(m_luaState) : 0;
 }
 
 bool Stack::isEmpty() const
@@ -145,34 +393,46 @@ void Stack::checkEmptyOrDie() const
 
 int Stack::createTable()
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_newtable(m_luaState);
-        return lua_ref(m_luaState, LUA_REGISTRYINDEX);
+        return popReference("Stack::createTable");
     }
     return LUA_NOREF;
 }
 
 void Stack::makeTableGlobal(const int reference, const char * name)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_getref(m_luaState, reference);
         lua_setglobal(m_luaState, name);
     }
 }
 
+int Stack::popReference(const char * site)
+{
+    const int reference = lua_ref(m_luaState, LUA_REGISTRYINDEX);
+    ReferenceTracker::onCreate(reference, site);
+    return reference;
+}
+
 void Stack::deleteReference(const int reference)
 {
-    if (m_luaState)
+    if (!LUA_STATE_OK(m_luaState)) return;
+
+    if (!ReleaseQueue::isOwner())
     {
-        lua_unref(m_luaState, reference);
+        ReleaseQueue::push(reference);
+        return;
     }
+    ReferenceTracker::onRelease(reference);
+    lua_unref(m_luaState, reference);
 }
 
 size_t Stack::getObjectSize(const int reference)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_getref(m_luaState, reference);
         const size_t len = lua_objlen(m_luaState, -1);
@@ -184,7 +444,7 @@ size_t Stack::getObjectSize(const int reference)
 
 void Stack::pop(const int n)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pop(m_luaState, n);
     }
@@ -192,7 +452,7 @@ void Stack::pop(const int n)
 
 void Stack::clear()
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pop(m_luaState, lua_gettop(m_luaState));
     }
@@ -200,7 +460,7 @@ void Stack::clear()
 
 void Stack::push()
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushnil(m_luaState);
     }
@@ -208,7 +468,7 @@ void Stack::push()
 
 void Stack::push(const bool value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushboolean(m_luaState, value);
     }
@@ -216,7 +476,7 @@ void Stack::push(const bool value)
 
 void Stack::push(void * value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         if (value)
         {
@@ -236,7 +496,7 @@ void Stack::push(const std::string & value)
 
 void Stack::push(const char * value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushstring(m_luaState, value);
     }
@@ -244,7 +504,7 @@ void Stack::push(const char * value)
 
 void Stack::push(const int value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushinteger(m_luaState, value);
     }
@@ -252,7 +512,7 @@ void Stack::push(const int value)
 
 void Stack::push(const size_t value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushinteger(m_luaState, (int)value);
     }
@@ -260,7 +520,7 @@ void Stack::push(const size_t value)
 
 void Stack::push(const long value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushinteger(m_luaState, (int)value);
     }
@@ -268,7 +528,7 @@ void Stack::push(const long value)
 
 void Stack::push(const float value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushnumber(m_luaState, (double)value);
     }
@@ -276,7 +536,7 @@ void Stack::push(const float value)
 
 void Stack::push(const double value)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
         lua_pushnumber(m_luaState, value);
     }
@@ -284,7 +544,7 @@ void Stack::push(const double value)
 
 void Stack::push(const Value & value)
 {
-    if (!m_luaState) return;
+    if (!LUA_STATE_OK(m_luaState)) return;
 
     if (value.isBool())
     {
@@ -292,7 +552,8 @@ void Stack::push(const Value & value)
     }
     else if (value.isString())
     {
-        push(value.getString());
+        const std::string_view str = value.getStringView();
+        lua_pushlstring(m_luaState, str.data(), str.size());
     }
     else if (value.isInt())
     {
@@ -306,25 +567,118 @@ void Stack::push(const Value & value)
     {
         push(value.getUserData());
     }
+    else if (value.isTable() || value.isFunction())
+    {
+        lua_getref(m_luaState, value.getReference());
+    }
     else if (value.isNil())
     {
         push();
     }
 }
 
+void Stack::push(const Key & key)
+{
+    if (LUA_STATE_OK(m_luaState))
+    {
+        lua_getref(m_luaState, key.getRef());
+    }
+}
+
 bool Stack::callFunction(const int reference, const std::vector<Value> & params, std::vector<Value> & results)
 {
+    return callFunction(reference, params, results, Budget::getDefault());
+}
+
+bool Stack::callFunction(const int reference, const std::vector<Value> & params, std::vector<Value> & results, const Budget & budget)
+{
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
-    stren::assertMessage(lua_isfunction(m_luaState, -1), "[lua] function not found");
+    LUA_CHECK(lua_isfunction(m_luaState, -1), "[lua] function not found");
 
     for (auto & param : params)
     {
         push(param);
     }
 
+    if (!protectedCall(params.size(), results.size(), budget))
+    {
+        return false;
+    }
+
+    for (Value & res : results)
+    {
+        read(-1, res);
+        pop(1);
+    }
+    return true;
+}
+
+bool Stack::callFunction(const int reference, const std::vector<Value> & params, ValueBuffer & results)
+{
+    results.clear();
+
+    StackGuard guard(m_luaState);
+    const int top = lua_gettop(m_luaState);
+    lua_getref(m_luaState, reference);
+    LUA_CHECK(lua_isfunction(m_luaState, -1), "[lua] function not found");
+
+    for (auto & param : params)
+    {
+        push(param);
+    }
+
+    if (!protectedCall(params.size(), LUA_MULTRET, Budget::getDefault()))
+    {
+        return false;
+    }
+
+    const int resultsTop = lua_gettop(m_luaState);
+    for (int i = top + 1; i <= resultsTop; ++i)
+    {
+        read(i, results.add());
+    }
+    lua_settop(m_luaState, top);
+    return true;
+}
+
+bool Stack::pushFunction(const int reference)
+{
+    lua_getref(m_luaState, reference);
+    if (!lua_isfunction(m_luaState, -1))
+    {
+        pop(1);
+        stren::assertMessage(false, "[lua] function not found");
+        return false;
+    }
+    return true;
+}
+
+void Stack::pushCopy(const int index)
+{
+    lua_pushvalue(m_luaState, index);
+}
+
+bool Stack::call(const int paramsCount, const int resultsCount, std::string * error)
+{
+    return protectedCall(paramsCount, resultsCount, Budget::getDefault(), error);
+}
+
+bool Stack::protectedCall(const int paramsCount, const int resultsCount, const Budget & budget, std::string * error)
+{
+    Budget::Scope budgetScope(m_luaState, budget, budget.isLimited() ? Budget::identify(m_luaState, -(paramsCount + 1)) : nullptr);
+    [[maybe_unused]] const int base = lua_gettop(m_luaState) - paramsCount - 1;
+
     // lua_pcall pops function and params from the stack
-    if (0 != lua_pcall(m_luaState, params.size(), results.size(), 0))
+    if (0 != lua_pcall(m_luaState, paramsCount, resultsCount, 0))
     {
+        if (budgetScope.isAborted() && !error)
+        {
+            pop(1);
+            LUA_CHECK(base == lua_gettop(m_luaState), "[lua] stack is not balanced");
+            return false;
+        }
+
         std::string errorMsg;
         if (1 == lua_isstring(m_luaState, -1))
         {
@@ -335,26 +689,30 @@ bool Stack::callFunction(const int reference, const std::vector<Value> & params,
             errorMsg = "Lua function crashed";
         }
         pop(1);
-        stren::assertMessage(false, errorMsg.c_str());
+        LUA_CHECK(base == lua_gettop(m_luaState), "[lua] stack is not balanced");
+        if (error)
+        {
+            error->swap(errorMsg);
+        }
+        else
+        {
+            stren::assertMessage(false, errorMsg.c_str());
+        }
         return false;
     }
-
-    for (Value & res : results)
-    {
-        res = get(-1);
-        pop(1);
-    }
+    LUA_CHECK(LUA_MULTRET == resultsCount || base + resultsCount == lua_gettop(m_luaState), "[lua] stack is not balanced");
     return true;
 }
 
 int Stack::copyTable(const int reference)
 {
-    if (m_luaState)
+    if (LUA_STATE_OK(m_luaState))
     {
+        StackGuard guard(m_luaState);
         lua_newtable(m_luaState);            // create new table on top of the stack
         lua_getref(m_luaState, reference);   // pushes onto the stack the table from reference
 
-        stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
+        LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
         // push first key
         push();
@@ -366,7 +724,7 @@ int Stack::copyTable(const int reference)
         }
         pop(1);
 
-        return lua_ref(m_luaState, LUA_REGISTRYINDEX);
+        return popReference("Stack::copyTable");
     }
 
     return LUA_NOREF;
@@ -374,13 +732,14 @@ int Stack::copyTable(const int reference)
 
 int Stack::copyReference(const int reference)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
-    return lua_ref(m_luaState, LUA_REGISTRYINDEX);
+    return popReference("Stack::copyReference");
 }
 
 int Stack::createReference(const char * path)
 {
-    if (!m_luaState) return 0;
+    if (!LUA_STATE_OK(m_luaState)) return 0;
 
     std::vector<std::string> tokens;
     stren::tokenize(path, tokens, ".");
@@ -414,35 +773,18 @@ int Stack::createReference(const char * path)
     }
 
     // create reference to the top object in the stack, pops object
-    const int reference = lua_ref(m_luaState, LUA_REGISTRYINDEX);
+    const int reference = popReference("Stack::createReference");
     // remove all objects from the stack, top object already popped
     lua_pop(m_luaState, stackIncrement - 1);
     return reference;
 }
 
-void Stack::getTableKeys(const int reference, ValueVector & keys)
-{
-    lua_getref(m_luaState, reference);
-
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
-
-    // push first key
-    push();
-    while (0 != lua_next(m_luaState, -2))
-    {
-        // get and store key value
-        keys.push_back(get(-2));
-        // removes 'value'; keeps 'key' for next iteration
-        pop(1);
-    }
-    pop(1);
-}
-
 void Stack::setTable(const int reference, const Value & key, const Value & value)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
 
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
+    LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
     push(key);
     push(value);
@@ -452,9 +794,10 @@ void Stack::setTable(const int reference, const Value & key, const Value & value
 
 Value Stack::getTable(const int reference, const Value & key)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
 
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
+    LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
     push(key);
     lua_rawget(m_luaState, -2);
@@ -463,48 +806,51 @@ Value Stack::getTable(const int reference, const Value & key)
     return value;
 }
 
-void Stack::tableToMap(const int reference, ValueMap & data)
+void Stack::setTable(const int reference, const Key & key, const Value & value)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
 
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
-
-    // first key
-    push();
-    while (0 != lua_next(m_luaState, -2))
-    {
-        // uses 'key' (at index -2) and 'value' (at index -1)
-        Value key = get(-2);
-        data[key] = get(-1);
+    LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
-        // removes 'value'; keeps 'key' for next iteration
-        pop(1);
-    }
+    push(key);
+    push(value);
+    lua_rawset(m_luaState, -3);
     pop(1);
 }
 
-void Stack::tableToVector(const int reference, ValueVector & data)
+Value Stack::getTable(const int reference, const Key & key)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
 
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
+    LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
-    const size_t size = lua_objlen(m_luaState, -1);
+    push(key);
+    lua_rawget(m_luaState, -2);
+    Value value = get(-1);
+    lua_pop(m_luaState, 2);
+    return value;
+}
 
-    for (int i = 1, i_end = size; i <= i_end; ++i)
+bool Stack::pushTable(const int reference)
+{
+    lua_getref(m_luaState, reference);
+    if (!lua_istable(m_luaState, -1))
     {
-        lua_rawgeti(m_luaState, -1, i);
-        data.push_back(get(-1));
         pop(1);
+        stren::assertMessage(false, "[lua] table not found");
+        return false;
     }
-    pop(1);
+    return true;
 }
 
 bool Stack::isTableEmpty(const int reference)
 {
+    StackGuard guard(m_luaState);
     lua_getref(m_luaState, reference);
 
-    stren::assertMessage(lua_istable(m_luaState, -1), "[lua] table not found");
+    LUA_CHECK(lua_istable(m_luaState, -1), "[lua] table not found");
 
     // first key
     push();
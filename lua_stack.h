@@ -4,12 +4,68 @@
 #include "lua_ext.h"
 #include <vector>
 #include <map>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
 
 namespace lua
 {
 class Value;
+class Budget;
+class ValueBuffer;
+class Key;
+class Table;
+class Function;
 typedef std::vector<Value> ValueVector;
 typedef std::map<Value, Value> ValueMap;
+namespace pmr
+{
+typedef std::pmr::vector<Value> ValueVector;
+typedef std::pmr::map<Value, Value> ValueMap;
+} // pmr
+///
+/// get memory resource of polymorphic allocator, default resource for other allocators
+///
+template <typename Allocator>
+inline std::pmr::memory_resource * getMemoryResource(const Allocator &)
+{
+    return std::pmr::get_default_resource();
+}
+
+template <typename T>
+inline std::pmr::memory_resource * getMemoryResource(const std::pmr::polymorphic_allocator<T> & allocator)
+{
+    return allocator.resource();
+}
+///
+/// keeps template parameter out of deduction, so it has to be given explicitly
+///
+template <typename T>
+struct NonDeduced
+{
+    typedef T type;
+};
+///
+/// class StackGuard
+///
+/// Asserts that the stack grew by delta since the guard was created, empty in unchecked builds.
+///
+class StackGuard
+{
+#if LUA_WRAPPER_CHECKED
+private:
+    lua_State * m_state;    ///< watched state
+    int         m_top;      ///< expected stack size
+public:
+    explicit StackGuard(lua_State * state, const int delta = 0);
+    ~StackGuard();
+#else
+public:
+    explicit StackGuard(lua_State *, const int = 0) {}
+#endif
+};
 ///
 /// class Stack
 ///
@@ -23,6 +79,10 @@ public:
     ///
     Stack(const int minStackSize = 0);
     ///
+    /// get lua virtual machine state
+    ///
+    inline lua_State * getState() const { return m_luaState; }
+    ///
     /// copy table from reference into a new table and return reference to the new table
     ///
     int copyTable(const int reference);
@@ -35,18 +95,54 @@ public:
     ///
     void loadLibs(const char * id, const luaL_reg * regs);
     ///
+    /// load libs, every function gets light user data as the first upvalue
+    ///
+    void loadLibs(const char * id, const luaL_reg * regs, void * upvalue);
+    ///
     /// get memory usage of lua virtual machine
     ///
     int getAllocatedMemory();
     ///
+    /// get memory usage of lua virtual machine in bytes
+    ///
+    size_t getAllocatedBytes();
+    ///
     /// collect garbage in lua
     ///
     void collectGarbage();
     ///
+    /// perform incremental garbage collection step, returns true if the step finished a cycle
+    ///
+    bool stepGarbage(const int stepSize);
+    ///
+    /// stop automatic garbage collection
+    ///
+    void stopGarbageCollector();
+    ///
+    /// restart automatic garbage collection
+    ///
+    void restartGarbageCollector();
+    ///
+    /// set garbage collector pause in percents, returns previous value
+    ///
+    int setGarbagePause(const int pause);
+    ///
+    /// set garbage collector step multiplier in percents, returns previous value
+    ///
+    int setGarbageStepMultiplier(const int stepMultiplier);
+    ///
     /// load lua script from file
     ///
     void loadScript(const char * name);
     ///
+    /// load lua script from memory, source or bytecode is read in place without copying
+    ///
+    void loadBuffer(const char * data, const size_t size, const char * name);
+    ///
+    /// compile lua chunk from memory and push it, returns false if chunk has errors
+    ///
+    bool compileBuffer(const char * data, const size_t size, const char * name, std::string * error = nullptr);
+    ///
     /// copy reference
     ///
     int copyReference(const int reference);
@@ -55,33 +151,116 @@ public:
     ///
     int createReference(const char * path);
     ///
+    /// create reference to interned lua string
+    ///
+    int createStringReference(const std::string & value);
+    ///
     /// get value from stack
     ///
     Value get(const int index);
     ///
-    /// get keys from table
+    /// get value from stack, string is allocated from resource
+    ///
+    Value get(const int index, std::pmr::memory_resource * resource);
+    ///
+    /// read boolean, returns false if the element has another type
+    ///
+    bool read(const int index, bool & value);
+    ///
+    /// read number as integer, returns false if the element has another type
+    ///
+    bool read(const int index, int & value);
+    ///
+    /// read number as integer, returns false if the element has another type
+    ///
+    bool read(const int index, long & value);
+    ///
+    /// read number as integer, returns false if the element has another type
+    ///
+    bool read(const int index, long long & value);
+    ///
+    /// read number, returns false if the element has another type
+    ///
+    bool read(const int index, float & value);
+    ///
+    /// read number, returns false if the element has another type
+    ///
+    bool read(const int index, double & value);
+    ///
+    /// read string, returns false if the element has another type
+    ///
+    bool read(const int index, std::string & value);
+    ///
+    /// read string without copy, the view is valid while lua keeps the string alive
+    ///
+    bool read(const int index, std::string_view & value);
+    ///
+    /// read table reference, returns false if the element has another type
     ///
-    void getTableKeys(const int reference, ValueVector & keys);
+    bool read(const int index, Table & value);
+    ///
+    /// read function reference, returns false if the element has another type
+    ///
+    bool read(const int index, Function & value);
+    ///
+    /// read any value
+    ///
+    bool read(const int index, Value & value);
+    ///
+    /// read number as enumeration, returns false if the element has another type
+    ///
+    template <typename T>
+    typename std::enable_if<std::is_enum<T>::value, bool>::type read(const int index, T & value);
+    ///
+    /// get typed value from stack, if the element has another type - use default value
+    ///
+    template <typename T>
+    T get(const int index, const typename NonDeduced<T>::type & defaultValue = T());
+    ///
+    /// get typed value from stack, if the element has another type - return nothing
+    ///
+    template <typename T>
+    std::optional<T> find(const int index);
+    ///
+    /// read typed value from the table, returns false if the value is missing or has another type
+    ///
+    template <typename K, typename T>
+    bool readTable(const int reference, const K & key, T & value);
+    ///
+    /// get keys from table, strings of pmr vector elements are allocated from its resource
+    ///
+    template <typename Allocator>
+    void getTableKeys(const int reference, std::vector<Value, Allocator> & keys);
     ///
     /// set value to the table
     ///
     void setTable(const int reference, const Value & key, const Value & value);
     ///
+    /// set value to the table using interned key
+    ///
+    void setTable(const int reference, const Key & key, const Value & value);
+    ///
     /// get value from the table
     ///
     Value getTable(const int reference, const Value & key);
     ///
+    /// get value from the table using interned key
+    ///
+    Value getTable(const int reference, const Key & key);
+    ///
     /// check if table is empty
     ///
     bool isTableEmpty(const int reference);
     ///
-    /// convert table to map
+    /// convert table to map, strings of pmr map elements are allocated from its resource
     ///
-    void tableToMap(const int reference, ValueMap & data);
+    template <typename Compare, typename Allocator>
+    void tableToMap(const int reference, std::map<Value, Value, Compare, Allocator> & data);
     ///
-    /// convert table to vector
+    /// convert table to vector, strings of pmr vector elements are allocated from its resource
     ///
-    void tableToVector(const int reference, ValueVector & data);
+    template <typename Allocator>
+    void tableToVector(const int reference, std::vector<Value, Allocator> & data);
     ///
     /// pop n elements from stack
     ///
@@ -135,6 +314,10 @@ public:
     ///
     void push(const Value & value);
     ///
+    /// push interned key
+    ///
+    void push(const Key & key);
+    ///
     /// get amount of elements in the stack
     ///
     int getSize() const;
@@ -159,7 +342,11 @@ public:
     ///
     void makeTableGlobal(const int reference, const char * name);
     ///
-    /// delete reference from registry
+    /// create reference to the top value and pop it, site names the creator for ReferenceTracker
+    ///
+    int popReference(const char * site);
+    ///
+    /// delete reference from registry, on threads not owning the VM it is queued for ReleaseQueue
     ///
     void deleteReference(const int reference);
     ///
@@ -170,12 +357,142 @@ public:
     /// call lua function
     ///
     bool callFunction(const int reference, const std::vector<Value> & params, std::vector<Value> & results);
+    ///
+    /// call lua function within the execution budget, returns false if budget aborted the call
+    ///
+    bool callFunction(const int reference, const std::vector<Value> & params, std::vector<Value> & results, const Budget & budget);
+    ///
+    /// call lua function and store all its results in order, the buffer is cleared first
+    ///
+    bool callFunction(const int reference, const std::vector<Value> & params, ValueBuffer & results);
+    ///
+    /// push function from reference, returns false and pushes nothing if reference is not a function
+    ///
+    bool pushFunction(const int reference);
+    ///
+    /// push copy of the element at index
+    ///
+    void pushCopy(const int index);
+    ///
+    /// call function with params on top of the stack, on failure stores error if it is given, otherwise reports it
+    ///
+    bool call(const int paramsCount, const int resultsCount, std::string * error = nullptr);
 private:
     ///
     /// create lua virtual machine
     ///
     void create();
+    ///
+    /// call function with params on top of the stack, pop error and store it if it is given, otherwise report it
+    ///
+    bool protectedCall(const int paramsCount, const int resultsCount, const Budget & budget, std::string * error = nullptr);
+    ///
+    /// push table from reference, returns false and pushes nothing if there is no table
+    ///
+    bool pushTable(const int reference);
 };
+
+template <typename T>
+typename std::enable_if<std::is_enum<T>::value, bool>::type Stack::read(const int index, T & value)
+{
+    long long number = 0;
+    if (!read(index, number)) return false;
+
+    value = static_cast<T>(number);
+    return true;
+}
+
+template <typename T>
+T Stack::get(const int index, const typename NonDeduced<T>::type & defaultValue)
+{
+    T value;
+    return read(index, value) ? value : defaultValue;
+}
+
+template <typename T>
+std::optional<T> Stack::find(const int index)
+{
+    T value;
+    if (read(index, value)) return value;
+    return std::nullopt;
+}
+
+template <typename K, typename T>
+bool Stack::readTable(const int reference, const K & key, T & value)
+{
+    if (!LUA_STATE_OK(m_luaState)) return false;
+
+    StackGuard guard(m_luaState);
+    lua_getref(m_luaState, reference);
+    if (!lua_istable(m_luaState, -1))
+    {
+        pop(1);
+        return false;
+    }
+
+    push(key);
+    lua_rawget(m_luaState, -2);
+    const bool isRead = read(-1, value);
+    pop(2);
+    return isRead;
+}
+
+template <typename Allocator>
+void Stack::getTableKeys(const int reference, std::vector<Value, Allocator> & keys)
+{
+    StackGuard guard(m_luaState);
+    if (!pushTable(reference)) return;
+
+    std::pmr::memory_resource * resource = getMemoryResource(keys.get_allocator());
+    // push first key
+    push();
+    while (0 != lua_next(m_luaState, -2))
+    {
+        // removes 'value'; keeps 'key' for next iteration
+        pop(1);
+        keys.push_back(get(-1, resource));
+    }
+    pop(1);
+}
+
+template <typename Compare, typename Allocator>
+void Stack::tableToMap(const int reference, std::map<Value, Value, Compare, Allocator> & data)
+{
+    StackGuard guard(m_luaState);
+    if (!pushTable(reference)) return;
+
+    std::pmr::memory_resource * resource = getMemoryResource(data.get_allocator());
+    // first key
+    push();
+    while (0 != lua_next(m_luaState, -2))
+    {
+        // uses 'key' (at index -2) and 'value' (at index -1)
+        Value key = get(-2, resource);
+        data[std::move(key)] = get(-1, resource);
+
+        // removes 'value'; keeps 'key' for next iteration
+        pop(1);
+    }
+    pop(1);
+}
+
+template <typename Allocator>
+void Stack::tableToVector(const int reference, std::vector<Value, Allocator> & data)
+{
+    StackGuard guard(m_luaState);
+    if (!pushTable(reference)) return;
+
+    std::pmr::memory_resource * resource = getMemoryResource(data.get_allocator());
+    const int size = (int)lua_objlen(m_luaState, -1);
+    data.reserve(data.size() + size);
+    for (int i = 1; i <= size; ++i)
+    {
+        lua_rawgeti(m_luaState, -1, i);
+        data.push_back(get(-1, resource));
+        pop(1);
+    }
+    pop(1);
+}
 } // lua
 
 #endif // STREN_LUA_VM_H
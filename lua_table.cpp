@@ -1,6 +1,8 @@
 #include "lua_table.h"
 #include "lua_stack.h"
 #include "lua_value.h"
+#include "lua_key.h"
+#include "lua_release_queue.h"
 
 #include "utils.h"
 
@@ -50,7 +52,7 @@ Table::Table(const Value & value)
 
 Table::~Table()
 {
-    if (m_reference != LUA_NOREF)
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
     {
         Stack stack;
         stack.deleteReference(m_reference);
@@ -73,7 +75,10 @@ void Table::create(const char * name)
 Table & Table::operator=(const Table & tbl)
 {
     Stack stack;
-    stack.deleteReference(m_reference);
+    if (!ReleaseQueue::defer(m_reference))
+    {
+        stack.deleteReference(m_reference);
+    }
     m_reference = stack.copyReference(tbl.m_reference);
     return *this;
 }
@@ -81,6 +86,13 @@ Table & Table::operator=(const Table & tbl)
 
 Table & Table ::operator=(Table && tbl)
 {
+    if (this == &tbl) return *this;
+
+    if (m_reference != LUA_NOREF && !ReleaseQueue::defer(m_reference))
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
     m_reference = tbl.m_reference;
     tbl.m_reference = LUA_NOREF;
     return *this;
@@ -119,41 +131,46 @@ Value Table::get(const Value & key, const Value & defaultValue) const
     return value;
 }
 
-bool Table::hasKey(const Value & key) const
+Value Table::get(const Key & key) const
 {
     Stack stack;
-    Value value = stack.getTable(m_reference, key);
-    return !value.isNil();
+    return stack.getTable(m_reference, key);
 }
 
-void Table::getKeys(std::vector<Value> & keys)
+Value Table::get(const Key & key, const Value & defaultValue) const
 {
-    keys.clear();
+    const Value value = get(key);
+    if (value.isNil())
+    {
+        return defaultValue;
+    }
+    return value;
+}
 
+bool Table::hasKey(const Value & key) const
+{
     Stack stack;
-    stack.getTableKeys(m_reference, keys);
+    Value value = stack.getTable(m_reference, key);
+    return !value.isNil();
 }
 
-void Table::set(const Value & key, const Value & value)
+bool Table::hasKey(const Key & key) const
 {
     Stack stack;
-    stack.setTable(m_reference, key, value);
+    Value value = stack.getTable(m_reference, key);
+    return !value.isNil();
 }
 
-void Table::fill(std::vector<Value> & data) const
+void Table::set(const Value & key, const Value & value)
 {
-    data.clear();
-
     Stack stack;
-    stack.tableToVector(m_reference, data);
+    stack.setTable(m_reference, key, value);
 }
 
-void Table::fill(std::map<Value, Value> & data) const
+void Table::set(const Key & key, const Value & value)
 {
-    data.clear();
-
     Stack stack;
-    stack.tableToMap(m_reference, data);
+    stack.setTable(m_reference, key, value);
 }
 
 Table Table::copy() const
@@ -9,6 +9,7 @@
 namespace lua
 {
 class Value;
+class Key;
 
 ///
 /// class Table
@@ -87,9 +88,10 @@ public:
     ///
     bool isValid() const;
     ///
-    /// get keys from table
+    /// get keys from table, pmr vector places key strings into its memory resource
     ///
-    void getKeys(std::vector<Value> & keys);
+    template <typename Allocator>
+    void getKeys(std::vector<Value, Allocator> & keys) const;
     ///
     /// get value from table using key
     ///
@@ -99,22 +101,94 @@ public:
     ///
     Value get(const Value & key, const Value & defaultValue) const;
     ///
+    /// get value from table using interned key
+    ///
+    Value get(const Key & key) const;
+    ///
+    /// get value from table using interned key, if the value does not exist - use default_value
+    ///
+    Value get(const Key & key, const Value & defaultValue) const;
+    ///
+    /// get typed value from table using key (Value, Key or string), if the value is missing or has another type - use default value
+    ///
+    template <typename T, typename K>
+    T get(const K & key, const typename NonDeduced<T>::type & defaultValue) const;
+    ///
+    /// get typed value from table using key (Value, Key or string), if the value is missing or has another type - return nothing
+    ///
+    template <typename T, typename K>
+    std::optional<T> find(const K & key) const;
+    ///
     /// check if table has key
     ///
     bool hasKey(const Value & key) const;
     ///
+    /// check if table has interned key
+    ///
+    bool hasKey(const Key & key) const;
+    ///
     /// set t[key] = value into the table
     ///
     void set(const Value & key, const Value & value);
     ///
-    /// fill vector with table values
+    /// set t[key] = value into the table using interned key
     ///
-    void fill(std::vector<Value> & data) const;
+    void set(const Key & key, const Value & value);
     ///
-    /// fill map with table keys and values
+    /// fill vector with table values, pmr vector places value strings into its memory resource
     ///
-    void fill(std::map<Value, Value> & data) const;
+    template <typename Allocator>
+    void fill(std::vector<Value, Allocator> & data) const;
+    ///
+    /// fill map with table keys and values, pmr map places key and value strings into its memory resource
+    ///
+    template <typename Compare, typename Allocator>
+    void fill(std::map<Value, Value, Compare, Allocator> & data) const;
 };
+
+template <typename T, typename K>
+T Table::get(const K & key, const typename NonDeduced<T>::type & defaultValue) const
+{
+    Stack stack;
+    T value;
+    return stack.readTable(m_reference, key, value) ? value : defaultValue;
+}
+
+template <typename T, typename K>
+std::optional<T> Table::find(const K & key) const
+{
+    Stack stack;
+    T value;
+    if (stack.readTable(m_reference, key, value)) return value;
+    return std::nullopt;
+}
+
+template <typename Allocator>
+void Table::getKeys(std::vector<Value, Allocator> & keys) const
+{
+    keys.clear();
+
+    Stack stack;
+    stack.getTableKeys(m_reference, keys);
+}
+
+template <typename Allocator>
+void Table::fill(std::vector<Value, Allocator> & data) const
+{
+    data.clear();
+
+    Stack stack;
+    stack.tableToVector(m_reference, data);
+}
+
+template <typename Compare, typename Allocator>
+void Table::fill(std::map<Value, Value, Compare, Allocator> & data) const
+{
+    data.clear();
+
+    Stack stack;
+    stack.tableToMap(m_reference, data);
+}
 } // lua
 
 #endif // STREN_LUA_TABLE_H
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "lua_table_builder.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+#include "lua_value.h"
+
+#include <cmath>
+
+namespace lua
+{
+TableBuilder::TableBuilder()
+    : m_thread(nullptr)
+    , m_reference(LUA_NOREF)
+    , m_isDone(false)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (state)
+    {
+        m_thread = lua_newthread(state);
+        m_reference = stack.popReference("TableBuilder");
+    }
+}
+
+TableBuilder::~TableBuilder()
+{
+    if (m_reference != LUA_NOREF)
+    {
+        Stack stack;
+        stack.deleteReference(m_reference);
+    }
+}
+
+void TableBuilder::reset()
+{
+    if (m_thread)
+    {
+        lua_settop(m_thread, 0);
+    }
+    m_frames.clear();
+    m_isDone = false;
+}
+
+void TableBuilder::beginArray(const int sizeHint, const long remaining)
+{
+    lua_checkstack(m_thread, 4);
+    lua_createtable(m_thread, sizeHint, 0);
+    begin(false, remaining);
+}
+
+void TableBuilder::beginMap(const int sizeHint, const long remaining)
+{
+    lua_checkstack(m_thread, 4);
+    lua_createtable(m_thread, 0, sizeHint);
+    begin(true, remaining < 0 ? remaining : remaining * 2);
+}
+
+void TableBuilder::begin(const bool isMap, const long remaining)
+{
+    Frame frame = { isMap, false, 0, remaining };
+    m_frames.push_back(frame);
+    if (0 == remaining)
+    {
+        endContainer();
+    }
+}
+
+void TableBuilder::endContainer()
+{
+    m_frames.pop_back();
+    addValue();
+}
+
+void TableBuilder::addValue()
+{
+    if (m_frames.empty())
+    {
+        m_isDone = true;
+        return;
+    }
+
+    Frame & frame = m_frames.back();
+    if (frame.isMap)
+    {
+        if (!frame.hasKey)
+        {
+            frame.hasKey = true;
+        }
+        else
+        {
+            frame.hasKey = false;
+            // nil and NaN can not be keys, such pairs are dropped
+            const bool isValidKey = !lua_isnil(m_thread, -2) &&
+                !(LUA_TNUMBER == lua_type(m_thread, -2) && lua_tonumber(m_thread, -2) != lua_tonumber(m_thread, -2));
+            if (isValidKey)
+            {
+                lua_rawset(m_thread, -3);
+            }
+            else
+            {
+                lua_pop(m_thread, 2);
+            }
+        }
+    }
+    else
+    {
+        lua_rawseti(m_thread, -2, ++frame.count);
+    }
+
+    if (frame.remaining > 0 && 0 == --frame.remaining)
+    {
+        endContainer();
+    }
+}
+
+bool TableBuilder::getResult(Table & table)
+{
+    if (!m_isDone || !lua_istable(m_thread, -1)) return false;
+
+    Stack stack;
+    lua_xmove(m_thread, stack.getState(), 1);
+    table = Table(stack.popReference("TableBuilder::getResult"));
+    reset();
+    return true;
+}
+
+Value TableBuilder::getResult()
+{
+    if (!m_isDone) return Value();
+
+    Stack stack;
+    lua_xmove(m_thread, stack.getState(), 1);
+    Value value = stack.get(-1);
+    stack.pop(1);
+    reset();
+    return value;
+}
+
+size_t getSequenceLength(lua_State * state, const int index)
+{
+    const size_t length = lua_objlen(state, index);
+    if (0 == length) return 0;
+
+    size_t count = 0;
+    lua_pushnil(state);
+    while (lua_next(state, index))
+    {
+        lua_pop(state, 1);
+        const double key = LUA_TNUMBER == lua_type(state, -1) ? lua_tonumber(state, -1) : 0;
+        if (++count > length || key < 1 || key > length || key != std::floor(key))
+        {
+            lua_pop(state, 1);
+            return 0;
+        }
+    }
+    return count == length ? length : 0;
+}
+} // lua
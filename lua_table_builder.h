@@ -0,0 +1,121 @@
+#ifndef STREN_LUA_TABLE_BUILDER_H
+#define STREN_LUA_TABLE_BUILDER_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace lua
+{
+class Table;
+class Value;
+///
+/// decoding progress
+///
+enum class DecodeStatus
+{
+    NeedMore,       ///< input ended inside of the document, feed more data
+    Done,           ///< document is decoded
+    Error           ///< input is malformed
+};
+///
+/// class TableBuilder
+///
+/// Assembles lua values produced by streaming decoders. Unfinished tables are kept on a private lua coroutine,
+/// so they survive between feeds regardless of what happens on the main stack.
+///
+class TableBuilder
+{
+private:
+    ///
+    /// struct Frame
+    ///
+    struct Frame
+    {
+        bool isMap;         ///< true if container is a map, false if it is an array
+        bool hasKey;        ///< true if map key waits for its value
+        int  count;         ///< amount of array elements
+        long remaining;     ///< amount of values left to complete the container, -1 - unknown
+    };
+
+    lua_State *        m_thread;        ///< coroutine holding unfinished tables
+    int                m_reference;     ///< reference anchoring the coroutine
+    std::vector<Frame> m_frames;        ///< unfinished containers
+    bool               m_isDone;        ///< true if root value is complete
+public:
+    ///
+    /// Constructor
+    ///
+    TableBuilder();
+    ///
+    /// Destructor
+    ///
+    ~TableBuilder();
+    ///
+    /// drop everything built so far
+    ///
+    void reset();
+    ///
+    /// get lua state to push scalar values to, call addValue after every push
+    ///
+    inline lua_State * getState() const { return m_thread; }
+    ///
+    /// start array, remaining - amount of elements or -1 if unknown
+    ///
+    void beginArray(const int sizeHint, const long remaining = -1);
+    ///
+    /// start map, remaining - amount of key-value pairs or -1 if unknown
+    ///
+    void beginMap(const int sizeHint, const long remaining = -1);
+    ///
+    /// finish the innermost container
+    ///
+    void endContainer();
+    ///
+    /// store value on top of the builder state into the innermost container
+    ///
+    void addValue();
+    ///
+    /// check if root value is complete
+    ///
+    inline bool isDone() const { return m_isDone; }
+    ///
+    /// get amount of unfinished containers
+    ///
+    inline size_t getDepth() const { return m_frames.size(); }
+    ///
+    /// check if innermost container is an array
+    ///
+    inline bool isInArray() const { return !m_frames.empty() && !m_frames.back().isMap; }
+    ///
+    /// check if innermost container is a map
+    ///
+    inline bool isInMap() const { return !m_frames.empty() && m_frames.back().isMap; }
+    ///
+    /// check if there is no unfinished container
+    ///
+    inline bool isEmpty() const { return m_frames.empty(); }
+    ///
+    /// move decoded table out, returns false if root is not a table
+    ///
+    bool getResult(Table & table);
+    ///
+    /// move decoded value out
+    ///
+    Value getResult();
+private:
+    TableBuilder(const TableBuilder &) = delete;
+    TableBuilder & operator=(const TableBuilder &) = delete;
+    ///
+    /// push container frame
+    ///
+    void begin(const bool isMap, const long remaining);
+};
+///
+/// get n if keys of the table at index are exactly 1..n, otherwise 0; used by encoders to tell arrays from maps
+///
+size_t getSequenceLength(lua_State * state, const int index);
+} // lua
+
+#endif // STREN_LUA_TABLE_BUILDER_H
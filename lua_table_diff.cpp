@@ -0,0 +1,237 @@
+#include "lua_table_diff.h"
+#include "lua_msgpack.h"
+#include "lua_stack.h"
+#include "lua_table.h"
+#include "utils.h"
+
+namespace lua
+{
+namespace
+{
+inline bool isComparableKey(lua_State * state, const int index)
+{
+    const int type = lua_type(state, index);
+    return LUA_TNUMBER == type || LUA_TSTRING == type || LUA_TBOOLEAN == type;
+}
+
+inline bool isSerializable(lua_State * state, const int index)
+{
+    const int type = lua_type(state, index);
+    return LUA_TFUNCTION != type && LUA_TUSERDATA != type && LUA_TLIGHTUSERDATA != type && LUA_TTHREAD != type;
+}
+
+inline void append(lua_State * state, const int operations, int & count, const int index)
+{
+    lua_pushvalue(state, index);
+    lua_rawseti(state, operations, ++count);
+}
+
+inline void appendCode(lua_State * state, const int operations, int & count, const int code)
+{
+    lua_pushinteger(state, code);
+    lua_rawseti(state, operations, ++count);
+}
+
+inline bool fail(std::string * error, const char * message)
+{
+    if (error)
+    {
+        *error = message;
+    }
+    return false;
+}
+} // anonymous
+
+bool TableDiff::diff(const Table & from, const Table & to, std::string & patch, size_t * changes)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    lua_getref(state, from.getRef());
+    lua_getref(state, to.getRef());
+    lua_newtable(state);
+    const int top = lua_gettop(state);
+    if (!lua_istable(state, top - 2) || !lua_istable(state, top - 1))
+    {
+        stack.pop(3);
+        stren::assertMessage(false, "[lua] table not found");
+        return false;
+    }
+
+    int count = 0;
+    size_t changeCount = 0;
+    bool isDone = compare(state, top - 2, top - 1, top, count, changeCount, 0);
+    if (isDone)
+    {
+        MsgPackEncoder encoder([&patch](const char * data, size_t size) { patch.append(data, size); });
+        isDone = encoder.encode(state, top);
+    }
+    if (changes)
+    {
+        *changes = changeCount;
+    }
+    stack.pop(3);
+    return isDone;
+}
+
+bool TableDiff::compare(lua_State * state, const int from, const int to, const int operations, int & count, size_t & changes, const int depth)
+{
+    if (depth >= kMaxDepth || !lua_checkstack(state, 4)) return false;
+
+    // new and changed keys
+    lua_pushnil(state);
+    while (lua_next(state, to))
+    {
+        const int value = lua_gettop(state);
+        const int key = value - 1;
+        if (!isComparableKey(state, key) || !isSerializable(state, value))
+        {
+            lua_pop(state, 1);
+            continue;
+        }
+
+        lua_pushvalue(state, key);
+        lua_rawget(state, from);
+        const int old = value + 1;
+        // same number, string or the very same table
+        if (!lua_rawequal(state, old, value))
+        {
+            if (lua_istable(state, old) && lua_istable(state, value))
+            {
+                const int mark = count;
+                appendCode(state, operations, count, OperationEnter);
+                append(state, operations, count, key);
+                if (!compare(state, old, value, operations, count, changes, depth + 1))
+                {
+                    lua_pop(state, 3);
+                    return false;
+                }
+                if (count == mark + 2)
+                {
+                    // nothing changed inside, drop enter
+                    lua_pushnil(state);
+                    lua_rawseti(state, operations, count--);
+                    lua_pushnil(state);
+                    lua_rawseti(state, operations, count--);
+                }
+                else
+                {
+                    appendCode(state, operations, count, OperationLeave);
+                }
+            }
+            else
+            {
+                appendCode(state, operations, count, OperationSet);
+                append(state, operations, count, key);
+                append(state, operations, count, value);
+                ++changes;
+            }
+        }
+        lua_pop(state, 2);
+    }
+
+    // removed keys
+    lua_pushnil(state);
+    while (lua_next(state, from))
+    {
+        const int key = lua_gettop(state) - 1;
+        if (isComparableKey(state, key) && isSerializable(state, key + 1))
+        {
+            lua_pushvalue(state, key);
+            lua_rawget(state, to);
+            if (lua_isnil(state, -1) || !isSerializable(state, -1))
+            {
+                appendCode(state, operations, count, OperationDelete);
+                append(state, operations, count, key);
+                ++changes;
+            }
+            lua_pop(state, 1);
+        }
+        lua_pop(state, 1);
+    }
+    return true;
+}
+
+bool TableDiff::applyPatch(const char * data, const size_t size, Table & target, std::string * error)
+{
+    Table operations;
+    if (!MsgPackDecoder::decode(data, size, operations, error)) return false;
+
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    lua_getref(state, operations.getRef());
+    const int list = lua_gettop(state);
+    lua_getref(state, target.getRef());
+    if (!lua_istable(state, -1))
+    {
+        stack.pop(2);
+        return fail(error, "[diff] target is not a table");
+    }
+
+    // current table is always on top, entered tables stay below it
+    const int count = (int)lua_objlen(state, list);
+    bool isApplied = true;
+    for (int i = 1; i <= count && isApplied; )
+    {
+        lua_rawgeti(state, list, i);
+        const int code = lua_isnumber(state, -1) ? (int)lua_tointeger(state, -1) : -1;
+        lua_pop(state, 1);
+        switch (code)
+        {
+        case OperationSet:
+            if (i + 2 > count)
+            {
+                isApplied = fail(error, "[diff] truncated set");
+                break;
+            }
+            lua_rawgeti(state, list, i + 1);
+            lua_rawgeti(state, list, i + 2);
+            lua_settable(state, -3);
+            i += 3;
+            break;
+        case OperationDelete:
+            if (i + 1 > count)
+            {
+                isApplied = fail(error, "[diff] truncated delete");
+                break;
+            }
+            lua_rawgeti(state, list, i + 1);
+            lua_pushnil(state);
+            lua_settable(state, -3);
+            i += 2;
+            break;
+        case OperationEnter:
+            if (i + 1 > count || !lua_checkstack(state, 2))
+            {
+                isApplied = fail(error, "[diff] truncated or too deep enter");
+                break;
+            }
+            lua_rawgeti(state, list, i + 1);
+            lua_gettable(state, -2);
+            if (!lua_istable(state, -1))
+            {
+                isApplied = fail(error, "[diff] patch does not match target, entered value is not a table");
+            }
+            i += 2;
+            break;
+        case OperationLeave:
+            if (lua_gettop(state) <= list + 1)
+            {
+                isApplied = fail(error, "[diff] leave without enter");
+                break;
+            }
+            lua_pop(state, 1);
+            ++i;
+            break;
+        default:
+            isApplied = fail(error, "[diff] unknown operation");
+            break;
+        }
+    }
+    stack.pop(lua_gettop(state) - list + 1);
+    return isApplied;
+}
+} // lua
@@ -0,0 +1,68 @@
+#ifndef STREN_LUA_TABLE_DIFF_H
+#define STREN_LUA_TABLE_DIFF_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <string>
+
+namespace lua
+{
+class Table;
+///
+/// class TableDiff
+///
+/// Structural diff of two lua tables for state replication. Tables are compared recursively on the lua
+/// stack, subtables shared by both sides are skipped by identity, so diffing against a snapshot only walks
+/// what was replaced. Patch is a MessagePack array of operations applied to the current table:
+///     0 key value     set t[key] = value, value may be a whole table
+///     1 key           delete t[key]
+///     2 key           enter subtable t[key], following operations apply to it
+///     3               leave subtable
+///     std::string patch;
+///     TableDiff::diff(sent, current, patch);    // server
+///     TableDiff::applyPatch(patch, mirror);      // client, mirror equals sent
+/// Only number, string and boolean keys are compared; functions, userdata and threads are ignored.
+///
+class TableDiff
+{
+public:
+    ///
+    /// operation codes
+    ///
+    enum Operation
+    {
+        OperationSet = 0,
+        OperationDelete = 1,
+        OperationEnter = 2,
+        OperationLeave = 3
+    };
+private:
+    static const int kMaxDepth = 512;   ///< nesting limit, also stops on cycles
+public:
+    ///
+    /// write patch turning from into to, returns false if tables are too deep or cyclic;
+    /// changes receives amount of set and delete operations
+    ///
+    static bool diff(const Table & from, const Table & to, std::string & patch, size_t * changes = nullptr);
+    ///
+    /// apply patch in place, target has to match the table the patch was made from;
+    /// assignments go through metatables, so tracked tables record them
+    ///
+    static bool applyPatch(const char * data, const size_t size, Table & target, std::string * error = nullptr);
+    ///
+    /// apply patch in place
+    ///
+    static bool applyPatch(const std::string & patch, Table & target, std::string * error = nullptr)
+    {
+        return applyPatch(patch.data(), patch.size(), target, error);
+    }
+private:
+    ///
+    /// append operations turning table at from into table at to, returns false if too deep
+    ///
+    static bool compare(lua_State * state, const int from, const int to, const int operations, int & count, size_t & changes, const int depth);
+};
+} // lua
+
+#endif // STREN_LUA_TABLE_DIFF_H
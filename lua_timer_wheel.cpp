@@ -0,0 +1,323 @@
+#include "lua_timer_wheel.h"
+#include "lua_function.h"
+#include "lua_stack.h"
+#include "utils.h"
+
+#include <cmath>
+
+namespace lua
+{
+namespace
+{
+// ids stay exact as lua numbers: 21 bits of generation above 32 bits of index
+const uint32_t kGenerationMask = 0x1fffff;
+
+inline TimerWheel::TimerId makeId(const uint32_t index, const uint32_t generation)
+{
+    return ((TimerWheel::TimerId)generation << 32) | index;
+}
+} // anonymous
+
+TimerWheel::TimerWheel(const double tickSeconds)
+    : m_slots(kLevels * kSlots, kNone)
+    , m_free(kNone)
+    , m_tick(0)
+    , m_tickSeconds(tickSeconds > 0.0 ? tickSeconds : 0.01)
+    , m_elapsed(0.0)
+    , m_count(0)
+    , m_isUpdating(false)
+{
+}
+
+TimerWheel::~TimerWheel()
+{
+    Stack stack;
+    for (const Timer & timer : m_timers)
+    {
+        if (TimerState::Free != timer.state)
+        {
+            stack.deleteReference(timer.function);
+        }
+    }
+}
+
+void TimerWheel::loadLibs(const char * id)
+{
+    static const luaL_reg regs[] =
+    {
+        { "after", luaAfter },
+        { "every", luaEvery },
+        { "cancel", luaCancel },
+        { nullptr, nullptr }
+    };
+
+    Stack stack;
+    stack.loadLibs(id, regs, this);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(const double delay, const Function & function, const double interval)
+{
+    Stack stack;
+    const int reference = stack.copyReference(function.getRef());
+    if (LUA_NOREF == reference || LUA_REFNIL == reference) return kInvalidTimer;
+
+    return add(delay, reference, interval);
+}
+
+bool TimerWheel::cancel(const TimerId timer)
+{
+    const uint32_t index = find(timer);
+    if (kNone == index) return false;
+
+    Timer & entry = m_timers[index];
+    if (TimerState::Firing == entry.state)
+    {
+        // firing loop owns the entry until the call returns
+        entry.isCancelled = true;
+    }
+    else
+    {
+        unlink(index);
+        release(index);
+    }
+    --m_count;
+    return true;
+}
+
+bool TimerWheel::isPending(const TimerId timer) const
+{
+    return kNone != find(timer);
+}
+
+size_t TimerWheel::update(const double dt, std::vector<std::string> * errors)
+{
+    if (m_isUpdating) return 0;
+
+    m_isUpdating = true;
+    m_elapsed += dt;
+    size_t calls = 0;
+    while (m_elapsed >= m_tickSeconds)
+    {
+        m_elapsed -= m_tickSeconds;
+        calls += advance(errors);
+    }
+    m_isUpdating = false;
+    return calls;
+}
+
+TimerWheel::TimerId TimerWheel::add(const double delay, const int function, const double interval)
+{
+    uint32_t index = m_free;
+    if (kNone == index)
+    {
+        index = (uint32_t)m_timers.size();
+        m_timers.push_back(Timer());
+        m_timers.back().generation = 1;
+    }
+    else
+    {
+        m_free = m_timers[index].next;
+    }
+
+    Timer & timer = m_timers[index];
+    timer.expiry = m_tick + toTicks(delay);
+    timer.interval = interval > 0.0 ? toTicks(interval) : 0;
+    timer.function = function;
+    timer.state = TimerState::Pending;
+    timer.isCancelled = false;
+    insert(index);
+    ++m_count;
+    return makeId(index, timer.generation);
+}
+
+uint32_t TimerWheel::toTicks(const double seconds) const
+{
+    const double ticks = std::ceil(seconds / m_tickSeconds);
+    if (!(ticks >= 1.0)) return 1;
+    return ticks < (double)UINT32_MAX ? (uint32_t)ticks : UINT32_MAX;
+}
+
+uint32_t TimerWheel::find(const TimerId timer) const
+{
+    const uint32_t index = (uint32_t)timer;
+    if (index >= m_timers.size()) return kNone;
+
+    const Timer & entry = m_timers[index];
+    if (TimerState::Free == entry.state || entry.isCancelled || entry.generation != (uint32_t)(timer >> 32)) return kNone;
+    return index;
+}
+
+void TimerWheel::insert(const uint32_t index)
+{
+    Timer & timer = m_timers[index];
+    // lowest level where expiry shares all upper bits with the current tick, so its slot is still ahead;
+    // expiries beyond the top level wait there for another rotation
+    int level = 0;
+    while (level < kLevels - 1 && (timer.expiry >> (kSlotBits * (level + 1))) != (m_tick >> (kSlotBits * (level + 1))))
+    {
+        ++level;
+    }
+    const uint32_t slot = level * kSlots + (uint32_t)((timer.expiry >> (kSlotBits * level)) & (kSlots - 1));
+
+    timer.slot = slot;
+    timer.prev = kNone;
+    timer.next = m_slots[slot];
+    if (kNone != timer.next)
+    {
+        m_timers[timer.next].prev = index;
+    }
+    m_slots[slot] = index;
+}
+
+void TimerWheel::unlink(const uint32_t index)
+{
+    Timer & timer = m_timers[index];
+    if (kNone != timer.prev)
+    {
+        m_timers[timer.prev].next = timer.next;
+    }
+    else
+    {
+        m_slots[timer.slot] = timer.next;
+    }
+    if (kNone != timer.next)
+    {
+        m_timers[timer.next].prev = timer.prev;
+    }
+    timer.prev = kNone;
+    timer.next = kNone;
+}
+
+void TimerWheel::release(const uint32_t index)
+{
+    Timer & timer = m_timers[index];
+    Stack stack;
+    stack.deleteReference(timer.function);
+    timer.function = LUA_NOREF;
+    timer.state = TimerState::Free;
+    timer.isCancelled = false;
+    timer.generation = (timer.generation + 1) & kGenerationMask;
+    if (0 == timer.generation)
+    {
+        timer.generation = 1;
+    }
+    timer.next = m_free;
+    m_free = index;
+}
+
+size_t TimerWheel::advance(std::vector<std::string> * errors)
+{
+    ++m_tick;
+    for (int level = 1; level < kLevels; ++level)
+    {
+        if (0 != (m_tick & ((1ull << (kSlotBits * level)) - 1))) break;
+        cascade(level);
+    }
+
+    const uint32_t slot = (uint32_t)(m_tick & (kSlots - 1));
+    if (kNone == m_slots[slot]) return 0;
+
+    // take the whole slot first, callbacks may schedule and cancel timers
+    for (uint32_t index = m_slots[slot]; kNone != index; index = m_timers[index].next)
+    {
+        m_timers[index].state = TimerState::Firing;
+        m_due.push_back(index);
+    }
+    m_slots[slot] = kNone;
+
+    Stack stack;
+    std::string error;
+    size_t calls = 0;
+    for (const uint32_t index : m_due)
+    {
+        if (!m_timers[index].isCancelled && stack.pushFunction(m_timers[index].function))
+        {
+            lua_pushnumber(stack.getState(), (lua_Number)makeId(index, m_timers[index].generation));
+            ++calls;
+            if (!stack.call(1, 0, &error))
+            {
+                if (errors)
+                {
+                    errors->push_back(std::move(error));
+                }
+                else
+                {
+                    stren::assertMessage(false, error.c_str());
+                }
+                error.clear();
+            }
+        }
+
+        // slab may have grown during the call
+        Timer & timer = m_timers[index];
+        if (timer.isCancelled || 0 == timer.interval)
+        {
+            if (!timer.isCancelled)
+            {
+                --m_count;
+            }
+            release(index);
+        }
+        else
+        {
+            timer.expiry = m_tick + timer.interval;
+            timer.state = TimerState::Pending;
+            insert(index);
+        }
+    }
+    m_due.clear();
+    return calls;
+}
+
+void TimerWheel::cascade(const int level)
+{
+    const uint32_t slot = level * kSlots + (uint32_t)((m_tick >> (kSlotBits * level)) & (kSlots - 1));
+    uint32_t index = m_slots[slot];
+    m_slots[slot] = kNone;
+    while (kNone != index)
+    {
+        const uint32_t next = m_timers[index].next;
+        insert(index);
+        index = next;
+    }
+}
+
+TimerWheel * TimerWheel::getTimerWheel(lua_State * state)
+{
+    return static_cast<TimerWheel *>(lua_touserdata(state, lua_upvalueindex(1)));
+}
+
+int TimerWheel::pushTimer(lua_State * state, const bool isRepeating)
+{
+    TimerWheel * wheel = getTimerWheel(state);
+    const double seconds = luaL_checknumber(state, 1);
+    luaL_checktype(state, 2, LUA_TFUNCTION);
+
+    // callback may run on a coroutine, references are made on the main state
+    Stack stack;
+    lua_pushvalue(state, 2);
+    lua_xmove(state, stack.getState(), 1);
+    const int reference = stack.popReference("TimerWheel::schedule");
+    const TimerId id = wheel->add(seconds, reference, isRepeating ? seconds : 0.0);
+    lua_pushnumber(state, (lua_Number)id);
+    return 1;
+}
+
+int TimerWheel::luaAfter(lua_State * state)
+{
+    return pushTimer(state, false);
+}
+
+int TimerWheel::luaEvery(lua_State * state)
+{
+    return pushTimer(state, true);
+}
+
+int TimerWheel::luaCancel(lua_State * state)
+{
+    TimerWheel * wheel = getTimerWheel(state);
+    const TimerId id = (TimerId)luaL_checknumber(state, 1);
+    lua_pushboolean(state, wheel->cancel(id));
+    return 1;
+}
+} // lua
@@ -0,0 +1,166 @@
+#ifndef STREN_LUA_TIMER_WHEEL_H
+#define STREN_LUA_TIMER_WHEEL_H
+
+#include "lua_ext.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lua
+{
+class Function;
+///
+/// class TimerWheel
+///
+/// Delayed and repeating lua callbacks on a hierarchical timing wheel: four levels of 256 slots, each
+/// level spans 256 ticks of the level below. Scheduling and cancelling are O(1), update only touches
+/// the slot of the current tick and, every 256 ticks, redistributes one slot of an upper level.
+/// Timers live in a slab indexed by id, a repeating timer keeps its function reference for its whole life.
+/// Callbacks are called as callback(id), scripts use
+///     timers.after(seconds, function)     - call once, returns id
+///     timers.every(seconds, function)     - call repeatedly, returns id
+///     timers.cancel(id)                   - returns false if timer is already gone
+///
+class TimerWheel
+{
+public:
+    typedef uint64_t TimerId;
+    static const TimerId kInvalidTimer = 0;     ///< id which is never given to a timer
+private:
+    static const int      kLevels = 4;          ///< wheel levels
+    static const int      kSlotBits = 8;        ///< log2 of slots per level
+    static const int      kSlots = 1 << kSlotBits;
+    static const uint32_t kNone = UINT32_MAX;   ///< end of slot list
+    ///
+    /// timer states
+    ///
+    enum class TimerState : uint8_t
+    {
+        Free,           ///< slab entry is unused
+        Pending,        ///< timer waits in a slot
+        Firing          ///< timer is due and waits for its call in the current tick
+    };
+    ///
+    /// struct Timer
+    ///
+    struct Timer
+    {
+        uint64_t   expiry;          ///< tick to fire at
+        uint32_t   interval;        ///< repeat interval in ticks, 0 - fire once
+        uint32_t   generation;      ///< bumped on reuse, so stale ids miss
+        uint32_t   prev;            ///< previous timer in slot
+        uint32_t   next;            ///< next timer in slot, or next free entry
+        uint32_t   slot;            ///< slot holding the timer
+        int        function;        ///< callback reference
+        TimerState state;           ///< current state
+        bool       isCancelled;     ///< cancelled while firing
+    };
+
+    std::vector<Timer>    m_timers;         ///< slab
+    std::vector<uint32_t> m_slots;          ///< heads of slot lists, level after level
+    std::vector<uint32_t> m_due;            ///< timers of the current tick, keeps capacity between ticks
+    uint32_t              m_free;           ///< head of free slab entries
+    uint64_t              m_tick;           ///< current tick
+    double                m_tickSeconds;    ///< tick duration
+    double                m_elapsed;        ///< time not yet turned into ticks
+    size_t                m_count;          ///< amount of active timers
+    bool                  m_isUpdating;     ///< true while firing timers
+public:
+    ///
+    /// Constructor, delays are rounded up to whole ticks
+    ///
+    TimerWheel(const double tickSeconds = 0.01);
+    ///
+    /// Destructor, releases callbacks
+    ///
+    ~TimerWheel();
+    ///
+    /// register lua api in the global table with the given name
+    ///
+    void loadLibs(const char * id = "timers");
+    ///
+    /// call function after delay, and then every interval if it is positive
+    ///
+    TimerId schedule(const double delay, const Function & function, const double interval = 0.0);
+    ///
+    /// cancel timer, returns false if it already fired or was cancelled
+    ///
+    bool cancel(const TimerId timer);
+    ///
+    /// check if timer is still going to fire
+    ///
+    bool isPending(const TimerId timer) const;
+    ///
+    /// get amount of active timers
+    ///
+    inline size_t getCount() const { return m_count; }
+    ///
+    /// get current tick
+    ///
+    inline uint64_t getTick() const { return m_tick; }
+    ///
+    /// advance time and fire due timers, returns amount of calls; errors receives messages of failed
+    /// callbacks, without it failures assert
+    ///
+    size_t update(const double dt, std::vector<std::string> * errors = nullptr);
+private:
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel & operator=(const TimerWheel &) = delete;
+    ///
+    /// add timer with callback reference, the wheel takes ownership of the reference
+    ///
+    TimerId add(const double delay, const int function, const double interval);
+    ///
+    /// convert seconds to ticks, at least one
+    ///
+    uint32_t toTicks(const double seconds) const;
+    ///
+    /// get slab index of a live timer, kNone if id is stale
+    ///
+    uint32_t find(const TimerId timer) const;
+    ///
+    /// put timer into the slot matching its expiry
+    ///
+    void insert(const uint32_t index);
+    ///
+    /// remove timer from its slot
+    ///
+    void unlink(const uint32_t index);
+    ///
+    /// release callback and return entry to the free list
+    ///
+    void release(const uint32_t index);
+    ///
+    /// move one tick forward, returns amount of calls
+    ///
+    size_t advance(std::vector<std::string> * errors);
+    ///
+    /// move timers of an upper level slot closer to the current tick
+    ///
+    void cascade(const int level);
+    ///
+    /// get timer wheel from upvalue
+    ///
+    static TimerWheel * getTimerWheel(lua_State * state);
+    ///
+    /// schedule lua callback at stack index 2
+    ///
+    static int pushTimer(lua_State * state, const bool isRepeating);
+    ///
+    /// lua: timers.after(seconds, function)
+    ///
+    static int luaAfter(lua_State * state);
+    ///
+    /// lua: timers.every(seconds, function)
+    ///
+    static int luaEvery(lua_State * state);
+    ///
+    /// lua: timers.cancel(id)
+    ///
+    static int luaCancel(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_TIMER_WHEEL_H
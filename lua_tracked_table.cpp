@@ -0,0 +1,437 @@
+#include "lua_tracked_table.h"
+#include "lua_stack.h"
+#include "lua_value.h"
+#include "utils.h"
+
+namespace lua
+{
+namespace
+{
+// proxy metatable fields, __index is the real table
+const char * kStorage = "__index";
+const char * kDirty = "__dirty";
+const char * kParent = "__parent";
+const char * kKey = "__key";
+
+// marks of changed keys
+const int kSet = 1;
+const int kNewTable = 2;
+const int kChild = 3;
+
+inline bool isScalarKey(lua_State * state, const int index)
+{
+    const int type = lua_type(state, index);
+    return LUA_TNUMBER == type || LUA_TSTRING == type || LUA_TBOOLEAN == type;
+}
+} // anonymous
+
+TrackedTable::TrackedTable()
+{
+    Stack stack;
+    const int reference = stack.createTable();
+    track(reference);
+    stack.deleteReference(reference);
+}
+
+TrackedTable::TrackedTable(const Table & table)
+{
+    track(table.getRef());
+}
+
+void TrackedTable::track(const int reference)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    registerLib(state);
+    lua_getref(state, reference);
+    const int table = lua_gettop(state);
+    if (!lua_istable(state, table))
+    {
+        stack.pop(1);
+        stren::assertMessage(false, "[lua] table not found");
+        return;
+    }
+
+    if (isProxy(state, table))
+    {
+        lua_pushvalue(state, table);
+    }
+    else
+    {
+        lua_newtable(state);
+        wrap(state, table, 0, 0, table + 1);
+        lua_remove(state, table + 1);
+    }
+    m_proxy = Table(stack.popReference("TrackedTable"));
+    stack.pop(1);
+}
+
+void TrackedTable::makeGlobal(const char * name) const
+{
+    Stack stack;
+    stack.makeTableGlobal(m_proxy.getRef(), name);
+}
+
+void TrackedTable::set(const Value & key, const Value & value)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return;
+
+    // proxy is always empty, so any assignment ends up in __newindex
+    lua_pushcfunction(state, luaNewIndex);
+    lua_getref(state, m_proxy.getRef());
+    stack.push(key);
+    stack.push(value);
+    stack.call(3, 0);
+}
+
+Value TrackedTable::get(const Value & key) const
+{
+    return m_proxy.get(key);
+}
+
+bool TrackedTable::hasChanges() const
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return false;
+
+    lua_getref(state, m_proxy.getRef());
+    bool hasChanges = false;
+    if (lua_getmetatable(state, -1))
+    {
+        lua_getfield(state, -1, kDirty);
+        lua_pushnil(state);
+        if (lua_next(state, -2))
+        {
+            hasChanges = true;
+            stack.pop(2);
+        }
+        stack.pop(2);
+    }
+    stack.pop(1);
+    return hasChanges;
+}
+
+size_t TrackedTable::drainChanges(const Callback & callback)
+{
+    Stack stack;
+    lua_State * state = stack.getState();
+    if (!state) return 0;
+
+    ValueVector path;
+    lua_getref(state, m_proxy.getRef());
+    const size_t count = isProxy(state, -1) ? drain(state, lua_gettop(state), path, callback) : 0;
+    stack.pop(1);
+    return count;
+}
+
+void TrackedTable::registerLib(lua_State * state)
+{
+    static const luaL_reg kFunctions[] =
+    {
+        { "pairs", luaPairs },
+        { "len", luaLen },
+        { "raw", luaRaw },
+        { nullptr, nullptr }
+    };
+
+    lua_getglobal(state, "tracked");
+    const bool isRegistered = lua_istable(state, -1);
+    lua_pop(state, 1);
+    if (!isRegistered)
+    {
+        Stack stack;
+        stack.loadLibs("tracked", kFunctions);
+    }
+}
+
+bool TrackedTable::isProxy(lua_State * state, const int index)
+{
+    if (!lua_istable(state, index) || !lua_getmetatable(state, index)) return false;
+
+    lua_pushstring(state, "__newindex");
+    lua_rawget(state, -2);
+    const bool isTracked = luaNewIndex == lua_tocfunction(state, -1);
+    lua_pop(state, 2);
+    return isTracked;
+}
+
+void TrackedTable::pushStorage(lua_State * state, const int index)
+{
+    if (isProxy(state, index))
+    {
+        lua_getmetatable(state, index);
+        lua_getfield(state, -1, kStorage);
+        lua_remove(state, -2);
+    }
+    else
+    {
+        lua_pushvalue(state, index);
+    }
+}
+
+void TrackedTable::wrap(lua_State * state, const int table, const int parent, const int key, const int seen)
+{
+    // tables reachable twice, cycles included, share one proxy
+    lua_pushvalue(state, table);
+    lua_rawget(state, seen);
+    if (!lua_isnil(state, -1)) return;
+    lua_pop(state, 1);
+
+    luaL_checkstack(state, 8, "tracked table is too deep");
+    lua_newtable(state);
+    const int proxy = lua_gettop(state);
+    lua_createtable(state, 0, 5);
+    lua_pushvalue(state, table);
+    lua_setfield(state, -2, kStorage);
+    lua_pushcfunction(state, luaNewIndex);
+    lua_setfield(state, -2, "__newindex");
+    lua_newtable(state);
+    lua_setfield(state, -2, kDirty);
+    if (parent)
+    {
+        lua_pushvalue(state, parent);
+        lua_setfield(state, -2, kParent);
+        lua_pushvalue(state, key);
+        lua_setfield(state, -2, kKey);
+    }
+    lua_setmetatable(state, proxy);
+
+    lua_pushvalue(state, table);
+    lua_pushvalue(state, proxy);
+    lua_rawset(state, seen);
+
+    lua_pushnil(state);
+    while (lua_next(state, table))
+    {
+        if (lua_istable(state, -1) && !isProxy(state, -1))
+        {
+            const int value = lua_gettop(state);
+            wrap(state, value, proxy, value - 1, seen);
+            lua_pushvalue(state, value - 1);
+            lua_insert(state, -2);
+            // assigning existing fields during traversal is allowed
+            lua_rawset(state, table);
+        }
+        lua_pop(state, 1);
+    }
+}
+
+void TrackedTable::markParents(lua_State * state, const int metatable)
+{
+    lua_pushvalue(state, metatable);
+    for (;;)
+    {
+        lua_getfield(state, -1, kParent);
+        if (lua_isnil(state, -1) || !lua_getmetatable(state, -1))
+        {
+            lua_pop(state, 2);
+            return;
+        }
+        // metatable, parent, parent metatable
+        lua_getfield(state, -1, kDirty);
+        lua_getfield(state, -4, kKey);
+        lua_pushvalue(state, -1);
+        lua_rawget(state, -3);
+        if (!lua_isnil(state, -1))
+        {
+            // parent is already marked, so are its ancestors
+            lua_pop(state, 6);
+            return;
+        }
+        lua_pop(state, 1);
+        lua_pushinteger(state, kChild);
+        lua_rawset(state, -3);
+        lua_pop(state, 1);
+        lua_replace(state, -3);
+        lua_pop(state, 1);
+    }
+}
+
+size_t TrackedTable::drain(lua_State * state, const int proxy, ValueVector & path, const Callback & callback)
+{
+    Stack stack;
+    luaL_checkstack(state, 8, "tracked table is too deep");
+    lua_getmetatable(state, proxy);
+    const int metatable = lua_gettop(state);
+    lua_getfield(state, metatable, kStorage);
+    lua_getfield(state, metatable, kDirty);
+    const int storage = metatable + 1;
+    const int dirty = metatable + 2;
+    lua_newtable(state);
+    lua_setfield(state, metatable, kDirty);
+
+    size_t count = 0;
+    lua_pushnil(state);
+    while (lua_next(state, dirty))
+    {
+        const int mark = (int)lua_tointeger(state, -1);
+        lua_pop(state, 1);
+        if (!isScalarKey(state, -1)) continue;
+
+        const Value key = stack.get(-1);
+        lua_pushvalue(state, -1);
+        lua_rawget(state, storage);
+        const int value = lua_gettop(state);
+        if (kChild == mark)
+        {
+            if (isProxy(state, value))
+            {
+                path.push_back(key);
+                count += drain(state, value, path, callback);
+                path.pop_back();
+            }
+        }
+        else if (lua_isnil(state, value))
+        {
+            callback(ChangeType::Removed, path, key, Value());
+            ++count;
+        }
+        else if (isProxy(state, value))
+        {
+            callback(ChangeType::Table, path, key, Value());
+            path.push_back(key);
+            count += 1 + dump(state, value, path, callback);
+            path.pop_back();
+        }
+        else if (!lua_isfunction(state, value))
+        {
+            callback(ChangeType::Set, path, key, stack.get(value));
+            ++count;
+        }
+        lua_pop(state, 1);
+    }
+    lua_pop(state, 3);
+    return count;
+}
+
+size_t TrackedTable::dump(lua_State * state, const int proxy, ValueVector & path, const Callback & callback)
+{
+    Stack stack;
+    luaL_checkstack(state, 8, "tracked table is too deep");
+    lua_getmetatable(state, proxy);
+    const int metatable = lua_gettop(state);
+    lua_getfield(state, metatable, kStorage);
+    const int storage = metatable + 1;
+    lua_newtable(state);
+    lua_setfield(state, metatable, kDirty);
+
+    size_t count = 0;
+    lua_pushnil(state);
+    while (lua_next(state, storage))
+    {
+        const int value = lua_gettop(state);
+        if (isScalarKey(state, value - 1) && !lua_isfunction(state, value))
+        {
+            const Value key = stack.get(value - 1);
+            if (isProxy(state, value))
+            {
+                callback(ChangeType::Table, path, key, Value());
+                path.push_back(key);
+                count += 1 + dump(state, value, path, callback);
+                path.pop_back();
+            }
+            else
+            {
+                callback(ChangeType::Set, path, key, stack.get(value));
+                ++count;
+            }
+        }
+        lua_pop(state, 1);
+    }
+    lua_pop(state, 2);
+    return count;
+}
+
+int TrackedTable::luaNewIndex(lua_State * state)
+{
+    // proxy, key, value
+    lua_settop(state, 3);
+    if (lua_isnil(state, 2))
+    {
+        return luaL_error(state, "table index is nil");
+    }
+    lua_getmetatable(state, 1);
+    lua_getfield(state, 4, kStorage);
+    lua_getfield(state, 4, kDirty);
+    lua_pushvalue(state, 2);
+    lua_rawget(state, 5);
+    // 4 - metatable, 5 - storage, 6 - dirty, 7 - old value
+    if (lua_rawequal(state, 3, 7)) return 0;
+
+    int mark = kSet;
+    if (lua_istable(state, 3))
+    {
+        if (isProxy(state, 3))
+        {
+            // tracked table moved here reports to the new parent
+            lua_getmetatable(state, 3);
+            lua_pushvalue(state, 1);
+            lua_setfield(state, -2, kParent);
+            lua_pushvalue(state, 2);
+            lua_setfield(state, -2, kKey);
+            lua_pop(state, 1);
+        }
+        else
+        {
+            lua_newtable(state);
+            wrap(state, 3, 1, 2, 8);
+            lua_replace(state, 3);
+            lua_settop(state, 7);
+        }
+        mark = kNewTable;
+    }
+
+    // replaced subtable stops reporting to this proxy
+    if (isProxy(state, 7))
+    {
+        lua_getmetatable(state, 7);
+        lua_getfield(state, -1, kParent);
+        const bool isChild = lua_rawequal(state, -1, 1);
+        lua_pop(state, 1);
+        if (isChild)
+        {
+            lua_pushnil(state);
+            lua_setfield(state, -2, kParent);
+        }
+        lua_pop(state, 1);
+    }
+
+    lua_pushvalue(state, 2);
+    lua_pushvalue(state, 3);
+    lua_rawset(state, 5);
+    lua_pushvalue(state, 2);
+    lua_pushinteger(state, mark);
+    lua_rawset(state, 6);
+    markParents(state, 4);
+    return 0;
+}
+
+int TrackedTable::luaPairs(lua_State * state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+    lua_getglobal(state, "next");
+    pushStorage(state, 1);
+    lua_pushnil(state);
+    return 3;
+}
+
+int TrackedTable::luaLen(lua_State * state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+    pushStorage(state, 1);
+    lua_pushinteger(state, (lua_Integer)lua_objlen(state, -1));
+    return 1;
+}
+
+int TrackedTable::luaRaw(lua_State * state)
+{
+    luaL_checktype(state, 1, LUA_TTABLE);
+    pushStorage(state, 1);
+    return 1;
+}
+} // lua
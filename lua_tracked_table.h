@@ -0,0 +1,128 @@
+#ifndef STREN_LUA_TRACKED_TABLE_H
+#define STREN_LUA_TRACKED_TABLE_H
+
+#include "lua_table.h"
+
+#include <cstddef>
+#include <functional>
+
+namespace lua
+{
+class Value;
+///
+/// class TrackedTable
+///
+/// Table which remembers keys changed since the last drain, so C++ mirrors of script state are updated
+/// incrementally. Scripts get an empty proxy: reads go straight to the real table through __index,
+/// writes go through __newindex which stores the value and marks the key. Nested tables are wrapped into
+/// proxies as well and mark their parents, so drain visits only changed branches.
+/// Proxies are invisible to pairs, ipairs, next and # in lua 5.1, scripts use tracked.pairs(t), tracked.len(t)
+/// and tracked.raw(t) instead. Writes with rawset and Table::set bypass tracking, use TrackedTable::set.
+///
+class TrackedTable
+{
+public:
+    ///
+    /// kind of change
+    ///
+    enum class ChangeType
+    {
+        Set,        ///< key has a new value
+        Removed,    ///< key is removed
+        Table       ///< key holds a new table, its content follows as changes with longer path
+    };
+    ///
+    /// change receiver, path holds keys from the root to the changed table;
+    /// value is nil for removed keys and new tables, function values are not reported
+    ///
+    typedef std::function<void(ChangeType type, const ValueVector & path, const Value & key, const Value & value)> Callback;
+private:
+    Table m_proxy;      ///< root proxy
+public:
+    ///
+    /// Constructor, tracks a new empty table
+    ///
+    TrackedTable();
+    ///
+    /// Constructor, tracks existing table, its subtables are replaced with proxies in place
+    ///
+    explicit TrackedTable(const Table & table);
+    ///
+    /// get proxy to hand to scripts
+    ///
+    inline const Table & getTable() const { return m_proxy; }
+    ///
+    /// make proxy global
+    ///
+    void makeGlobal(const char * name) const;
+    ///
+    /// set t[key] = value with tracking
+    ///
+    void set(const Value & key, const Value & value);
+    ///
+    /// get value by key, subtables are returned as proxies
+    ///
+    Value get(const Value & key) const;
+    ///
+    /// check if anything changed since the last drain
+    ///
+    bool hasChanges() const;
+    ///
+    /// report and forget changes, returns amount of reported changes;
+    /// callback must not modify the tracked table
+    ///
+    size_t drainChanges(const Callback & callback);
+private:
+    ///
+    /// wrap table from reference
+    ///
+    void track(const int reference);
+    ///
+    /// register tracked library
+    ///
+    static void registerLib(lua_State * state);
+    ///
+    /// check if value at index is a proxy
+    ///
+    static bool isProxy(lua_State * state, const int index);
+    ///
+    /// push real table behind the proxy at index, other values are pushed as they are
+    ///
+    static void pushStorage(lua_State * state, const int index);
+    ///
+    /// wrap table at index and its subtables into proxies and push the proxy, parent is 0 for the root;
+    /// seen maps wrapped tables to their proxies
+    ///
+    static void wrap(lua_State * state, const int table, const int parent, const int key, const int seen);
+    ///
+    /// mark changed child in every parent up to the first already marked one
+    ///
+    static void markParents(lua_State * state, const int metatable);
+    ///
+    /// report changes of the proxy at index
+    ///
+    static size_t drain(lua_State * state, const int proxy, ValueVector & path, const Callback & callback);
+    ///
+    /// report whole content of the proxy at index as changes
+    ///
+    static size_t dump(lua_State * state, const int proxy, ValueVector & path, const Callback & callback);
+    ///
+    /// lua: proxy[key] = value
+    ///
+    static int luaNewIndex(lua_State * state);
+    ///
+    /// lua: tracked.pairs(t)
+    ///
+    static int luaPairs(lua_State * state);
+    ///
+    /// lua: tracked.len(t)
+    ///
+    static int luaLen(lua_State * state);
+    ///
+    /// lua: tracked.raw(t)
+    ///
+    static int luaRaw(lua_State * state);
+};
+} // lua
+
+#endif // STREN_LUA_TRACKED_TABLE_H
@@ -1,5 +1,8 @@
 #include "lua_value.h"
 
+#include <algorithm>
+#include <cstdio>
+
 namespace lua
 {
 Value::Value()
@@ -11,96 +14,185 @@ Value::Value()
 {
 }
 
-Value::Value(const bool value)
-    : m_type(Type::Bool)
-    , m_iValue(value ? 1 : 0)
-    , m_dValue(0.f)
-    , m_strValue(value ? "true" : "false")
-    , m_userData(nullptr)
+Value::Value(const bool value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(value);
 }
 
-Value::Value(const int value)
-    : m_type(Type::Int)
-    , m_iValue(value)
-    , m_dValue(value)
-    , m_strValue(std::to_string(value))
-    , m_userData(nullptr)
+Value::Value(const int value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(value);
 }
 
-Value::Value(const size_t value)
-    : m_type(Type::Int)
-    , m_iValue(static_cast<int>(value))
-    , m_dValue(static_cast<int>(value))
-    , m_strValue(std::to_string(value))
-    , m_userData(nullptr)
+Value::Value(const size_t value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    // text keeps the unsigned value, the number is truncated like before
+    assign(static_cast<long>(static_cast<int>(value)));
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%zu", value);
+    m_strValue.assign(buffer, length > 0 ? length : 0);
 }
 
-Value::Value(const long value)
-    : m_type(Type::Int)
-    , m_iValue(static_cast<int>(value))
-    , m_dValue(static_cast<int>(value))
-    , m_strValue(std::to_string(value))
-    , m_userData(nullptr)
+Value::Value(const long value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(value);
 }
 
-Value::Value(const double value)
-    : m_type(Type::Double)
-    , m_iValue(static_cast<int>(value))
-    , m_dValue(value)
-    , m_strValue(std::to_string(value))
-    , m_userData(nullptr)
+Value::Value(const double value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(value);
 }
 
-Value::Value(const float value)
-    : m_type(Type::Double)
-    , m_iValue(static_cast<int>(value))
-    , m_dValue(static_cast<double>(value))
-    , m_strValue(std::to_string(value))
-    , m_userData(nullptr)
+Value::Value(const float value, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(static_cast<double>(value));
 }
 
-Value::Value(const char * value)
+Value::Value(const char * value, const allocator_type & allocator)
     : m_type(Type::String)
     , m_iValue(LUA_NOREF)
     , m_dValue(0.f)
-    , m_strValue(value)
+    , m_strValue(value, allocator)
     , m_userData(nullptr)
 {
 }
 
-Value::Value(const std::string & value)
+Value::Value(const char * value, const size_t length, const allocator_type & allocator)
     : m_type(Type::String)
     , m_iValue(LUA_NOREF)
     , m_dValue(0.f)
-    , m_strValue(value)
+    , m_strValue(value, length, allocator)
     , m_userData(nullptr)
 {
 }
 
-Value::Value(void * userdata)
-    : m_type(Type::UserData)
+Value::Value(const std::string & value, const allocator_type & allocator)
+    : m_type(Type::String)
     , m_iValue(LUA_NOREF)
     , m_dValue(0.f)
-    , m_strValue("userdata")
-    , m_userData(userdata)
+    , m_strValue(value.data(), value.size(), allocator)
+    , m_userData(nullptr)
+{
+}
+
+Value::Value(void * userdata, const allocator_type & allocator)
+    : m_strValue(allocator)
+{
+    assign(userdata);
+}
+
+Value::Value(const int value, const bool isTable, const allocator_type & allocator)
+    : m_strValue(allocator)
 {
+    assign(value, isTable);
 }
 
-Value::Value(const int value, const bool isTable)
-    : m_type(isTable ? Type::Table : Type::Function)
-    , m_iValue(value)
+Value::Value(const allocator_type & allocator)
+    : m_type(Type::Nil)
+    , m_iValue(0)
     , m_dValue(0.f)
-    , m_strValue(isTable ? "table" : "function")
+    , m_strValue("nil", allocator)
     , m_userData(nullptr)
 {
 }
 
+Value::Value(const Value & other, const allocator_type & allocator)
+    : m_type(other.m_type)
+    , m_iValue(other.m_iValue)
+    , m_dValue(other.m_dValue)
+    , m_strValue(other.m_strValue, allocator)
+    , m_userData(other.m_userData)
+{
+}
+
+Value::Value(Value && other, const allocator_type & allocator)
+    : m_type(other.m_type)
+    , m_iValue(other.m_iValue)
+    , m_dValue(other.m_dValue)
+    , m_strValue(std::move(other.m_strValue), allocator)
+    , m_userData(other.m_userData)
+{
+}
+
+void Value::setNil()
+{
+    m_type = Type::Nil;
+    m_iValue = 0;
+    m_dValue = 0.f;
+    m_strValue.assign("nil", 3);
+    m_userData = nullptr;
+}
+
+void Value::assign(const bool value)
+{
+    m_type = Type::Bool;
+    m_iValue = value ? 1 : 0;
+    m_dValue = 0.f;
+    m_strValue.assign(value ? "true" : "false");
+    m_userData = nullptr;
+}
+
+void Value::assign(const int value)
+{
+    assign(static_cast<long>(value));
+}
+
+void Value::assign(const long value)
+{
+    char buffer[32];
+    const int length = snprintf(buffer, sizeof(buffer), "%ld", value);
+    m_type = Type::Int;
+    m_iValue = static_cast<int>(value);
+    m_dValue = static_cast<int>(value);
+    m_strValue.assign(buffer, length > 0 ? length : 0);
+    m_userData = nullptr;
+}
+
+void Value::assign(const double value)
+{
+    // same text as std::to_string, largest doubles take over 300 characters
+    char buffer[512];
+    const int length = snprintf(buffer, sizeof(buffer), "%f", value);
+    m_type = Type::Double;
+    m_iValue = static_cast<int>(value);
+    m_dValue = value;
+    m_strValue.assign(buffer, length > 0 ? std::min<size_t>(length, sizeof(buffer) - 1) : 0);
+    m_userData = nullptr;
+}
+
+void Value::assign(const char * value, const size_t length)
+{
+    m_type = Type::String;
+    m_iValue = LUA_NOREF;
+    m_dValue = 0.f;
+    m_strValue.assign(value, length);
+    m_userData = nullptr;
+}
+
+void Value::assign(void * userdata)
+{
+    m_type = Type::UserData;
+    m_iValue = LUA_NOREF;
+    m_dValue = 0.f;
+    m_strValue.assign("userdata", 8);
+    m_userData = userdata;
+}
+
+void Value::assign(const int reference, const bool isTable)
+{
+    m_type = isTable ? Type::Table : Type::Function;
+    m_iValue = reference;
+    m_dValue = 0.f;
+    m_strValue.assign(isTable ? "table" : "function");
+    m_userData = nullptr;
+}
+
 bool Value::operator<(const Value & other) const
 {
     return m_type < other.m_type ||
@@ -6,13 +6,22 @@
 
 #include "lua_ext.h"
 
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
 namespace lua
 {
 ///
 /// class Value
 ///
+/// Strings are kept in a std::pmr::string, so values stored in std::pmr containers place their strings
+/// into the container's memory resource, e.g. a per frame monotonic arena.
+///
 class Value
 {
+public:
+    typedef std::pmr::polymorphic_allocator<char> allocator_type;
 private:
     enum class Type
     {
@@ -26,11 +35,11 @@ private:
         Function
     };                          ///< possible lua values list
 
-    Type        m_type;         ///< value type
-    int         m_iValue;       ///< lua integer value or boolean or table, function reference
-    void *      m_userData;     ///< pointer to light user data
-    double      m_dValue;       ///< lua number value
-    std::string m_strValue;     ///< lua string value
+    Type             m_type;        ///< value type
+    int              m_iValue;      ///< lua integer value or boolean or table, function reference
+    void *           m_userData;    ///< pointer to light user data
+    double           m_dValue;      ///< lua number value
+    std::pmr::string m_strValue;    ///< lua string value
 public:
     ///
     /// Create nil value
@@ -39,37 +48,81 @@ public:
     ///
     /// Create bool value
     ///
-    Value(const bool value);
+    Value(const bool value, const allocator_type & allocator = allocator_type());
     ///
     /// Create number value
     ///
-    Value(const int value);
+    Value(const int value, const allocator_type & allocator = allocator_type());
     ///
     /// Create reference to the table or function
     ///
-    Value(const int value, const bool isTable);
+    Value(const int value, const bool isTable, const allocator_type & allocator = allocator_type());
     ///
     /// Create number value
     ///
-    Value(const size_t value);
+    Value(const size_t value, const allocator_type & allocator = allocator_type());
 
     /// Create number value
-    Value(const long value);
+    Value(const long value, const allocator_type & allocator = allocator_type());
 
     /// Create number value
-    Value(const double value);
+    Value(const double value, const allocator_type & allocator = allocator_type());
 
     /// Create number value
-    Value(const float value);
+    Value(const float value, const allocator_type & allocator = allocator_type());
+
+    /// Create string value
+    Value(const char * value, const allocator_type & allocator = allocator_type());
 
     /// Create string value
-    Value(const char * value);
+    Value(const char * value, const size_t length, const allocator_type & allocator);
 
     /// Create string value
-    Value(const std::string & value);
+    Value(const std::string & value, const allocator_type & allocator = allocator_type());
 
     /// Create value with user data
-    Value(void * userdata);
+    Value(void * userdata, const allocator_type & allocator = allocator_type());
+
+    /// Create nil value using allocator
+    explicit Value(const allocator_type & allocator);
+
+    /// Copy value using allocator
+    Value(const Value & other, const allocator_type & allocator);
+
+    /// Move value using allocator, string is copied if allocators differ
+    Value(Value && other, const allocator_type & allocator);
+
+    Value(const Value & other) = default;
+    Value(Value && other) = default;
+    Value & operator=(const Value & other) = default;
+    Value & operator=(Value && other) = default;
+
+    /// get allocator of the string
+    inline allocator_type get_allocator() const { return m_strValue.get_allocator(); }
+
+    /// make value nil, assign functions keep the string storage, so a reused value does not allocate
+    void setNil();
+
+    /// assign bool value
+    void assign(const bool value);
+
+    /// assign number value
+    void assign(const int value);
+
+    /// assign number value
+    void assign(const long value);
+
+    /// assign number value
+    void assign(const double value);
+
+    /// assign string value
+    void assign(const char * value, const size_t length);
+
+    /// assign user data
+    void assign(void * userdata);
+
+    /// assign reference to the table or function
+    void assign(const int reference, const bool isTable);
 
     /// check if value is nil
     inline bool isNil() const { return Type::Nil == m_type; }
@@ -107,8 +160,11 @@ public:
     /// return double value
     inline double getDouble() const { return m_dValue; }
 
-    /// return string value
-    inline const std::string & getString() const { return m_strValue; }
+    /// return copy of string value
+    inline std::string getString() const { return std::string(m_strValue.data(), m_strValue.size()); }
+
+    /// return string value without copying, valid while the value is alive and not changed
+    inline std::string_view getStringView() const { return std::string_view(m_strValue.data(), m_strValue.size()); }
     ///
     /// return pointer to user data
     ///
@@ -0,0 +1,35 @@
+#include "lua_value_buffer.h"
+
+namespace lua
+{
+ValueBuffer::ValueBuffer()
+    : m_size(0)
+{
+}
+
+void ValueBuffer::clear()
+{
+    m_size = 0;
+}
+
+Value & ValueBuffer::add()
+{
+    const size_t index = m_size++;
+    if (index < kInlineSize)
+    {
+        return m_inline[index];
+    }
+
+    const size_t overflowIndex = index - kInlineSize;
+    if (overflowIndex == m_overflow.size())
+    {
+        m_overflow.emplace_back();
+    }
+    return m_overflow[overflowIndex];
+}
+
+void ValueBuffer::push_back(const Value & value)
+{
+    add() = value;
+}
+} // lua
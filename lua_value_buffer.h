@@ -0,0 +1,63 @@
+#ifndef STREN_LUA_VALUE_BUFFER_H
+#define STREN_LUA_VALUE_BUFFER_H
+
+#include "lua_value.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace lua
+{
+///
+/// class ValueBuffer
+///
+/// Reusable container for call results. The first kInlineSize values live inside the buffer, clear() keeps
+/// all storage and results are assigned into the existing slots, so a buffer reused between calls does not
+/// allocate once it has grown to the needed size and its strings to the needed lengths. Table and function
+/// results still take a new registry reference on every call, the caller owns it.
+///
+class ValueBuffer
+{
+public:
+    static const size_t kInlineSize = 4;    ///< amount of values stored without heap allocation
+private:
+    Value              m_inline[kInlineSize];   ///< inline storage
+    std::vector<Value> m_overflow;              ///< storage for values after kInlineSize
+    size_t             m_size;                  ///< amount of stored values
+public:
+    ///
+    /// Constructor
+    ///
+    ValueBuffer();
+    ///
+    /// remove all values, storage is kept
+    ///
+    void clear();
+    ///
+    /// get slot for a new value at the end of the buffer
+    ///
+    Value & add();
+    ///
+    /// add value to the end of the buffer
+    ///
+    void push_back(const Value & value);
+    ///
+    /// get amount of stored values
+    ///
+    inline size_t size() const { return m_size; }
+    ///
+    /// check if buffer has no values
+    ///
+    inline bool empty() const { return 0 == m_size; }
+    ///
+    /// get value by index
+    ///
+    inline const Value & operator[](const size_t index) const { return index < kInlineSize ? m_inline[index] : m_overflow[index - kInlineSize]; }
+    ///
+    /// get value by index
+    ///
+    inline Value & operator[](const size_t index) { return index < kInlineSize ? m_inline[index] : m_overflow[index - kInlineSize]; }
+};
+} // lua
+
+#endif // STREN_LUA_VALUE_BUFFER_H
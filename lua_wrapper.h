@@ -5,5 +5,27 @@
 #include "lua_value.h"
 #include "lua_table.h"
 #include "lua_function.h"
+#include "lua_value_buffer.h"
+#include "lua_key.h"
+#include "lua_gc.h"
+#include "lua_memory_profiler.h"
+#include "lua_scheduler.h"
+#include "lua_budget.h"
+#include "lua_snapshot.h"
+#include "lua_frozen_table.h"
+#include "lua_json.h"
+#include "lua_msgpack.h"
+#include "lua_script_pack.h"
+#include "lua_module_loader.h"
+#include "lua_reference_tracker.h"
+#include "lua_tracked_table.h"
+#include "lua_table_diff.h"
+#include "lua_release_queue.h"
+#include "lua_event_bus.h"
+#include "lua_timer_wheel.h"
+#include "lua_num_buffer.h"
+#include "lua_channel.h"
+#include "lua_memoized_function.h"
+#include "lua_script_compiler.h"
 
 #endif // STREN_LUA_WRAPPER_H
\ No newline at end of file